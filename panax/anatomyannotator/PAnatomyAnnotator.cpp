@@ -7,6 +7,7 @@
 */
 
 #include "PAnatomyAnnotator.h"
+#include "PMeshBundle.h"
 #include <QMainWindow>
 #include <QtGui>
 #include <QComboBox>
@@ -223,12 +224,18 @@ void PAnatomyAnnotator::insertAnatomyInfo(const QModelIndex &parent, int row, in
 {
     qDebug() << "Insert Row: " << row;
 
-    anatomyLabels.insert(row, "Label");
-    anatomyAnnotations.insert(row, "Annotation!");
+    // The part is appended to the mesh list before its row.
+    PMeshPart part;
+    if (row < meshList.size())
+        part = meshList[row];
+    anatomyLabels.insert(row,
+        part.label.isEmpty() ? QString("Label") : part.label);
+    anatomyAnnotations.insert(row, part.annotation.isEmpty() ?
+        QString("Annotation!") : part.annotation);
     labelsWidgets.insert(row, vtkCaptionWidget::New());
-    anchorPosList.insert(row*3, 0.0);
-    anchorPosList.insert(row*3+1, 0.0);
-    anchorPosList.insert(row*3+2, 0.0);
+    anchorPosList.insert(row*3, part.anchor[0]);
+    anchorPosList.insert(row*3+1, part.anchor[1]);
+    anchorPosList.insert(row*3+2, part.anchor[2]);
 
     anchorPos2DList.insert(row*4, .05);
     anchorPos2DList.insert(row*4+1, .15+.15*row);
@@ -334,7 +341,16 @@ void PAnatomyAnnotator::openProject()
     QXmlStreamReader Rxml;
     fileName = QFileDialog::getOpenFileName(this,
                                             tr("Open Lesson"), ".",
-                                            tr("Xml files (*.xml)"));
+                                            tr("Atlas bundles (*.pax);;Xml files (*.xml)"));
+    if (fileName.isEmpty())
+        return;
+
+    if (isBundle(fileName))
+    {
+        if (loadBundle(fileName))
+            statusBar()->showMessage(tr("Lesson Opened"));
+        return;
+    }
 
     QFile file(fileName);
     if (!file.open(QFile::ReadOnly | QFile::Text))
@@ -396,7 +412,16 @@ void PAnatomyAnnotator::openProject()
 void PAnatomyAnnotator::saveProject()
 {
     if (fileName.isEmpty())
-        fileName = QFileDialog::getSaveFileName(this, tr("Save Lesson Plan"), ".", tr("Xml files (*.xml)"));
+        fileName = QFileDialog::getSaveFileName(this, tr("Save Lesson Plan"), ".", tr("Atlas bundles (*.pax);;Xml files (*.xml)"));
+    if (fileName.isEmpty())
+        return;
+
+    if (isBundle(fileName))
+    {
+        if (saveBundle(fileName))
+            statusBar()->showMessage(tr("Lesson saved"));
+        return;
+    }
 
     QFile file(fileName);
     file.open(QIODevice::WriteOnly);
@@ -443,6 +468,36 @@ void PAnatomyAnnotator::saveProjectAs()
 }
 
 
+// Supporting methods
+
+bool PAnatomyAnnotator::isBundle(const QString &fileName)
+{
+    return fileName.endsWith(".pax", Qt::CaseInsensitive);
+}
+
+
+// The bundle holds the meshes as rendered, with the names, colours and
+// visibility of the mesh table and the labels of the annotator.
+
+bool PAnatomyAnnotator::saveBundle(const QString &fileName)
+{
+    QList<PMeshPart> parts = meshList;
+    for (int i = 0; i < parts.size(); ++i)
+    {
+        PMeshPart &part = parts[i];
+        part.name = meshTable->item(i, 2)->text();
+        part.visible = part.actor->GetVisibility();
+        part.label = anatomyLabels[i];
+        part.annotation = anatomyAnnotations[i];
+        for (int k = 0; k < 3; ++k)
+            part.anchor[k] = anchorPosList[3 * i + k];
+    }
+
+    PMeshBundle bundle;
+    return bundle.save(fileName, parts);
+}
+
+
 // Callback
 
 AnatomyLabelsCallback::AnatomyLabelsCallback()
@@ -460,23 +515,11 @@ void AnatomyLabelsCallback::Execute(vtkObject *caller,
 {
     vtkRenderWindowInteractor *interactor = viewer->getInteractor();
     int *pos = interactor->GetEventPosition();
-    vtkRenderer *renderer = viewer->getRenderer();
 
     // Pick at the mouse location provided by the interactor
-    vtkPropPicker *picker = vtkPropPicker::New();
-    int found = picker->PickProp(pos[0], pos[1], renderer);
-
-    if (found)
-    {
-        //qDebug() << "...";
-        //qDebug() << picker->GetActor()->GetClassName();
-
-        double* pos = picker->GetPickPosition();
-        //qDebug() << sizeof(pos);
-        qDebug() << "Get actor " <<pos[0]<<" "<<pos[1]<<" "<<pos[2];
-
-        viewer->updateLabelAnchor(pos);
-    }
+    double point[3];
+    if (viewer->pick(pos[0], pos[1], point))
+        viewer->updateLabelAnchor(point);
 }
 
 
@@ -48,7 +48,8 @@ protected:
     void addActions();
     void addMenus();
     void addToolBars();
-
+    bool isBundle(const QString &fileName);
+    bool saveBundle(const QString &fileName);
 
 
     // Annotator
@@ -0,0 +1,205 @@
+/* PMeshBundle.cpp
+
+   Atlas bundle: the parts of an annotated model packed in one file.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PMeshBundle.h"
+#include <QFile>
+#include <QDataStream>
+#include "PParallel.h"
+#include "PMeshCache.h"
+
+#include <iostream>
+#include <cstring>
+using namespace std;
+
+#define BundleMagic "PAX1"
+#define MaxParts 100000
+
+
+// Compresses the mesh of each part in a range
+
+struct PBundleCompressKernel
+{
+    const QList<PMeshPart> *parts;
+    QByteArray *blocks;
+
+    void operator()(int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            const PMeshPart &part = parts->at(i);
+            vtkPolyData *mesh = part.normals ?
+                part.normals->GetOutput() : part.data;
+            blocks[i] = qCompress(PMeshCache::pack(mesh));
+        }
+    }
+};
+
+
+// PMeshBundle class
+
+bool PMeshBundle::save(const QString &fileName,
+    const QList<PMeshPart> &parts)
+{
+    QVector<QByteArray> compressed(parts.size());
+    PBundleCompressKernel kernel;
+    kernel.parts = &parts;
+    kernel.blocks = compressed.data();
+    parallelFor(parts.size(), kernel, 1);
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        cerr << "Error in save: cannot write "
+             << qPrintable(fileName) << "\n" << flush;
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_6);
+    out.writeRawData(BundleMagic, 4);
+    out << (qint32) parts.size();
+    for (int i = 0; i < parts.size(); ++i)
+    {
+        const PMeshPart &part = parts[i];
+        out << part.name << part.source << part.color << part.visible
+            << part.label << part.annotation << part.anchor[0]
+            << part.anchor[1] << part.anchor[2]
+            << (qint32) compressed[i].size();
+    }
+    for (int i = 0; i < parts.size(); ++i)
+        out.writeRawData(compressed[i].constData(), compressed[i].size());
+
+    if (out.status() != QDataStream::Ok || file.error() != QFile::NoError)
+    {
+        cerr << "Error in save: cannot write "
+             << qPrintable(fileName) << "\n" << flush;
+        file.close();
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+
+bool PMeshBundle::open(const QString &name)
+{
+    clear();
+    fileName = name;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        cerr << "Error in open: cannot read "
+             << qPrintable(fileName) << "\n" << flush;
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_6);
+    char magic[4];
+    qint32 numParts = -1;
+    if (in.readRawData(magic, 4) != 4 || memcmp(magic, BundleMagic, 4))
+        numParts = -1;
+    else
+        in >> numParts;
+    if (numParts < 0 || numParts > MaxParts)
+    {
+        cerr << "Error in open: " << qPrintable(fileName)
+             << " is not a bundle\n" << flush;
+        return false;
+    }
+
+    sizes.resize(numParts);
+    for (int i = 0; i < numParts; ++i)
+    {
+        PMeshPart part;
+        in >> part.name >> part.source >> part.color >> part.visible
+           >> part.label >> part.annotation >> part.anchor[0]
+           >> part.anchor[1] >> part.anchor[2] >> sizes[i];
+        parts.append(part);
+    }
+
+    // The meshes follow the table of contents back to back.
+    offsets.resize(numParts);
+    qint64 offset = file.pos();
+    for (int i = 0; i < numParts && in.status() == QDataStream::Ok; ++i)
+    {
+        if (sizes[i] < 0 || offset + sizes[i] > file.size())
+        {
+            in.setStatus(QDataStream::ReadPastEnd);
+            break;
+        }
+        offsets[i] = offset;
+        offset += sizes[i];
+    }
+
+    if (in.status() != QDataStream::Ok)
+    {
+        cerr << "Error in open: " << qPrintable(fileName)
+             << " is truncated or corrupt\n" << flush;
+        clear();
+        return false;
+    }
+    return true;
+}
+
+
+void PMeshBundle::clear()
+{
+    fileName.clear();
+    parts.clear();
+    offsets.clear();
+    sizes.clear();
+}
+
+
+int PMeshBundle::count() const
+{
+    return parts.size();
+}
+
+
+PMeshPart PMeshBundle::getPart(int i) const
+{
+    return parts[i];
+}
+
+
+// Each call opens the file on its own, so blocks may be read from several
+// threads at once.
+
+QByteArray PMeshBundle::getBlock(int i) const
+{
+    QFile file(fileName);
+    QByteArray block;
+    if (file.open(QIODevice::ReadOnly) && file.seek(offsets[i]))
+        block = file.read(sizes[i]);
+    if (block.size() != sizes[i])
+    {
+        cerr << "Error in getBlock: cannot read part " << i << " of "
+             << qPrintable(fileName) << "\n" << flush;
+        block.clear();
+    }
+    return block;
+}
+
+
+vtkPolyData *PMeshBundle::getMesh(int i) const
+{
+    QByteArray block = getBlock(i);
+    return block.isEmpty() ? NULL : unpack(block);
+}
+
+
+vtkPolyData *PMeshBundle::unpack(const QByteArray &block)
+{
+    QByteArray packed = qUncompress(block);
+    vtkPolyData *mesh = PMeshCache::unpack(packed.constData(),
+        packed.size());
+    if (!mesh)
+        cerr << "Error in unpack: corrupt mesh\n" << flush;
+    return mesh;
+}
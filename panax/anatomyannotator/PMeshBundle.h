@@ -0,0 +1,55 @@
+/* PMeshBundle.h
+
+   Atlas bundle: the parts of an annotated model packed in one file.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PMESHBUNDLE_H
+#define PMESHBUNDLE_H
+
+#include <QList>
+#include <QVector>
+#include <QByteArray>
+#include "PMeshViewer.h"
+
+
+// A bundle (.pax) is written by QDataStream as a header, a table of
+// contents and the compressed meshes of the parts, in this order:
+//
+//   "PAX1", number of parts
+//   for each part: name, source, colour, visibility, label, annotation,
+//                  anchor x, y, z, size of compressed mesh
+//   for each part: compressed mesh
+//
+// A mesh is the one the viewer renders, with its normals, packed by
+// PMeshCache::pack() and compressed by qCompress(), so nothing is
+// computed on opening.  Parts are compressed in parallel on saving.
+//
+// open() reads only the header and the table of contents, from which it
+// finds where each mesh starts.  A mesh is read, decompressed and unpacked
+// only when it is asked for, by getMesh() or unpack() on its block, from
+// any thread, so the file must stay in place while the bundle is used.
+
+class PMeshBundle
+{
+public:
+    bool save(const QString &fileName, const QList<PMeshPart> &parts);
+    bool open(const QString &fileName);
+    void clear();
+
+    int count() const;
+    PMeshPart getPart(int i) const;  // With no mesh
+    QByteArray getBlock(int i) const;  // Compressed mesh, empty on error
+    vtkPolyData *getMesh(int i) const;  // New mesh, or NULL
+
+    static vtkPolyData *unpack(const QByteArray &block);
+
+protected:
+    QString fileName;
+    QList<PMeshPart> parts;
+    QVector<qint64> offsets;  // Of each compressed mesh in the file
+    QVector<qint32> sizes;
+};
+
+#endif
@@ -8,12 +8,12 @@
 
 #include "PMeshViewer.h"
 #include <QtGui>
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
 #include "vtkCommand.h"
-#include "vtkOBJReader.h"
-#include "vtkPLYReader.h"
-#include "vtkSTLReader.h"
-#include "vtkPLYWriter.h"
-#include "vtkSTLWriter.h"
+#include "PMeshReader.h"
+#include "PMeshWriter.h"
+#include "PMeshBundle.h"
 #include "vtkWindowToImageFilter.h"
 #include "vtkJPEGWriter.h"
 #include "vtkPNGWriter.h"
@@ -21,6 +21,12 @@
 #include "vtkCamera.h"
 #include "vtkProperty.h"
 #include "vtkCellArray.h"
+#include "vtkCameraPass.h"
+#include "vtkSequencePass.h"
+#include "vtkRenderPassCollection.h"
+#include "vtkLightsPass.h"
+#include "vtkOpaquePass.h"
+#include "vtkOverlayPass.h"
 
 #include "vtkButtonWidget.h"
 #include "vtkButtonRepresentation.h"
@@ -28,7 +34,6 @@
 #include "vtkTextActor.h"
 #include "vtkTextProperty.h"
 
-#include <unistd.h>
 using namespace std;
 
 
@@ -50,6 +55,21 @@ protected:
 };
 
 
+// PMeshPart class
+
+PMeshPart::PMeshPart()
+{
+    data = NULL;
+    normals = NULL;
+    bvh = NULL;
+    mapper = NULL;
+    actor = NULL;
+    color = QColor(255, 255, 255);
+    visible = true;
+    anchor[0] = anchor[1] = anchor[2] = 0.0;
+}
+
+
 // PMeshViewer class
 
 PMeshViewer::PMeshViewer()
@@ -59,6 +79,10 @@ PMeshViewer::PMeshViewer()
     projectName = QString("Untitled");
     loaded = false;
     hideFrontFace = 0;
+    updateDepth = 0;
+    renderPending = false;
+    generation = 0;
+    loadDone = loadTotal = 0;
     
     // Create GUI
     createWidgets();
@@ -72,7 +96,23 @@ PMeshViewer::PMeshViewer()
 
 PMeshViewer::~PMeshViewer()
 {
+    // Wait for meshes still being read.
+    QMap<QObject *, int>::iterator it;
+    for (it = loads.begin(); it != loads.end(); ++it)
+    {
+        QFutureWatcher<PMeshPart> *watcher =
+            static_cast<QFutureWatcher<PMeshPart> *>(it.key());
+        watcher->waitForFinished();
+        releaseMesh(watcher->result());
+    }
+    
     uninstallPipeline();
+    delete lod;
+    culler->Delete();
+    renderWindow->MakeCurrent();
+    blendingPass->ReleaseGraphicsResources(renderWindow);
+    blendingPass->Delete();
+    blender->Delete();
     style->Delete();
 }
 
@@ -123,14 +163,49 @@ void PMeshViewer::createWidgets()
 
     // QVTKWidget has already created a render window and interactor
     renderWindow = vtkWidget->GetRenderWindow();
+    culler = PMeshCuller::New();  // Shared by the renderers
     renderer = vtkRenderer::New();
     renderer->SetBackground(0.0, 0.0, 0.0);
+    renderer->AddCuller(culler);
     renderWindow->AddRenderer(renderer);
+
+    // Passes of the renderer when translucent parts are blended, as the
+    // default passes but for the translucent one.
+    blender = PBlendedPass::New();
+    vtkLightsPass *lightsPass = vtkLightsPass::New();
+    vtkOpaquePass *opaquePass = vtkOpaquePass::New();
+    vtkOverlayPass *overlayPass = vtkOverlayPass::New();
+    vtkRenderPassCollection *passes = vtkRenderPassCollection::New();
+    passes->AddItem(lightsPass);
+    passes->AddItem(opaquePass);
+    passes->AddItem(blender);
+    passes->AddItem(overlayPass);
+    vtkSequencePass *sequencePass = vtkSequencePass::New();
+    sequencePass->SetPasses(passes);
+    vtkCameraPass *cameraPass = vtkCameraPass::New();
+    cameraPass->SetDelegatePass(sequencePass);
+    blendingPass = cameraPass;
+    lightsPass->Delete();
+    opaquePass->Delete();
+    overlayPass->Delete();
+    passes->Delete();
+    sequencePass->Delete();
     
     interactor = renderWindow->GetInteractor();
     style = vtkInteractorStyleTrackballCamera::New();
     interactor->SetInteractorStyle(style);
 
+    // Draw decimated meshes while the camera moves.
+    lod = new PLodManager(this);
+    lod->setInteractorStyle(style);
+
+    // Blink parts without blocking the event loop.
+    highlighter = new PHighlighter(this);
+    highlighter->setRenderWindow(renderWindow);
+    connect(highlighter,
+        SIGNAL(colorChanged(vtkActor *, double, double, double)),
+        this, SLOT(showPartColor(vtkActor *, double, double, double)));
+
     PMeshViewerCallback *callback = PMeshViewerCallback::New();
     callback->viewer = this;
     interactor->AddObserver(vtkCommand::RightButtonPressEvent, callback);
@@ -164,7 +239,7 @@ void PMeshViewer::createWidgets()
     meshTable->setPalette(palette);
     meshTable->verticalHeader()->hide();
     meshTable->setShowGrid(false);
-    meshTable->setSelectionMode(QTableWidget::SingleSelection);
+    meshTable->setSelectionMode(QTableWidget::ExtendedSelection);
     
     QStringList labels;
     labels << "" << "Colour" << "Name" << "Annotation";
@@ -282,6 +357,31 @@ void PMeshViewer::createActions()
     connect(frontFaceAction, SIGNAL(triggered()), this,
             SLOT(toggleFrontFace()));
 
+    mergePartsAction = new QAction(tr("Merge &Parts"), this);
+    mergePartsAction->setStatusTip(
+        tr("Draw all parts in a few merged batches"));
+    mergePartsAction->setCheckable(true);
+    connect(mergePartsAction, SIGNAL(triggered()), this,
+            SLOT(toggleMergeParts()));
+
+    occlusionAction = new QAction(tr("&Occlusion Culling"), this);
+    occlusionAction->setStatusTip(
+        tr("Skip parts hidden behind large opaque parts in still views"));
+    occlusionAction->setCheckable(true);
+    connect(occlusionAction, SIGNAL(triggered()), this,
+            SLOT(toggleOcclusion()));
+
+    blendingAction = new QAction(tr("&Blended Transparency"), this);
+    blendingAction->setStatusTip(
+        tr("Draw translucent parts in one pass without sorting"));
+    blendingAction->setCheckable(true);
+    connect(blendingAction, SIGNAL(triggered()), this,
+            SLOT(toggleBlending()));
+
+    newGroupAction = new QAction(tr("&New Group..."), this);
+    newGroupAction->setStatusTip(tr("Name the selected parts as a group"));
+    connect(newGroupAction, SIGNAL(triggered()), this, SLOT(newGroup()));
+
     smoothSurfaceAction = new QAction(tr("&Smooth Surface"), this);
     smoothSurfaceAction->setShortcut(tr("Shift+S"));
     smoothSurfaceAction->setStatusTip(tr("Smooth surface"));
@@ -363,6 +463,9 @@ void PMeshViewer::createMenus()
     viewMenu = menuBar()->addMenu(tr("&View"));
     viewMenu->addAction(saveViewAction);
     viewMenu->addAction(frontFaceAction);
+    viewMenu->addAction(mergePartsAction);
+    viewMenu->addAction(occlusionAction);
+    viewMenu->addAction(blendingAction);
     
     meshModeMenu = viewMenu->addMenu(tr("&Mesh Mode"));
     meshModeMenu->addAction(smoothSurfaceAction);
@@ -370,6 +473,11 @@ void PMeshViewer::createMenus()
     meshModeMenu->addAction(flatLinesAction);
     meshModeMenu->addAction(wireFrameAction);
 
+    groupMenu = viewMenu->addMenu(tr("&Groups"));
+    groupMenu->addAction(newGroupAction);
+    connect(groupMenu, SIGNAL(aboutToShow()), this,
+            SLOT(updateGroupMenu()));
+
     viewMenu->addAction(toggleRightDockWidgetAction);
     viewMenu->addAction(infoAction);
 
@@ -416,6 +524,9 @@ void PMeshViewer::newProject()
     uninstallPipeline();
     renderer = vtkRenderer::New();
     renderer->SetBackground(0.0, 0.0, 0.0);
+    renderer->AddCuller(culler);
+    if (blendingAction->isChecked())
+        renderer->SetPass(blendingPass);
     renderWindow->AddRenderer(renderer);
     renderWindow->Render();
 
@@ -472,9 +583,7 @@ void PMeshViewer::loadDir()
             QStringList fileNames;
             for (int i = 0; i < list.size(); ++i)
                 fileNames.append(dirName + "/" + list[i]);
-            QApplication::setOverrideCursor(Qt::WaitCursor);
             loadMesh(fileNames);
-            QApplication::restoreOverrideCursor();
         }
     }
 }
@@ -487,11 +596,7 @@ void PMeshViewer::loadMesh()
                                                           tr("3D mesh files: *.obj, *.ply, *.stl (*.obj *.ply *.stl)"));
 
     if (!fileNames.isEmpty())
-    {
-        QApplication::setOverrideCursor(Qt::WaitCursor);
         loadMesh(fileNames);
-        QApplication::restoreOverrideCursor();
-    }
 }
 
 
@@ -502,76 +607,49 @@ void PMeshViewer::addMesh()
                                                           tr("3D mesh files: *.obj, *.ply, *.stl (*.obj *.ply *.stl)"));
 
     if (!fileNames.isEmpty())
-    {
-        QApplication::setOverrideCursor(Qt::WaitCursor);
         addMesh(fileNames);
-        QApplication::restoreOverrideCursor();
-    }
 }
 
 
 void PMeshViewer::deleteMesh()
 {
-    QList<QTableWidgetSelectionRange> list = meshTable->selectedRanges();
-    if (list.isEmpty())
+    QList<int> rows = selectedRows();
+    if (rows.isEmpty())
         return;
 
-    QTableWidgetSelectionRange range = list[0];  // Only 1 range.
-    for (int i = range.bottomRow(); i >= range.topRow(); --i)
+    // From the last row, so the rows still to go keep their numbers.
+    QMap<QString, QList<vtkActor *> >::iterator it;
+    for (int k = rows.size() - 1; k >= 0; --k)
     {
+        int i = rows[k];
         meshTable->removeRow(i);
         renderer->RemoveActor(meshList[i].actor);
-        meshList[i].normals->Delete();
-        meshList[i].mapper->Delete();
-        meshList[i].actor->Delete();
+        lod->remove(meshList[i].actor);
+        picker.remove(meshList[i].actor);
+        culler->remove(meshList[i].actor);
+        blender->remove(meshList[i].actor);
+        highlighter->stop(meshList[i].actor);
+        for (it = groups.begin(); it != groups.end(); ++it)
+            it.value().removeAll(meshList[i].actor);
+        releaseMesh(meshList[i]);
         meshList.removeAt(i);
     }
 
-    renderWindow->Render();
+    indexParts();
+    remergeParts();
+    render();
 }
 
 
 void PMeshViewer::saveDirPly()
 {
-    QString dirName = QFileDialog::getExistingDirectory(this,
-                                                        tr("Save visible meshes into a directory in PLY format"), ".");
-
-    if (!dirName.isEmpty() && !meshList.isEmpty())
-    {
-        for (int i = 0; i < meshList.size(); ++i)
-            if (meshList[i].actor->GetVisibility())
-            {
-                QString fileName = dirName + QString("/%1.ply").
-                        arg(i, 8, 10, QChar('0'));
-                vtkPLYWriter *writer = vtkPLYWriter::New();
-                writer->SetFileName(fileName.toAscii().data());
-                writer->SetInput(meshList[i].data);
-                writer->Update();
-                writer->Delete();
-            }
-    }
+    saveDir(tr("Save visible meshes into a directory in PLY format"), "ply");
 }
 
 
 void PMeshViewer::saveDirStl()
 {
-    QString dirName = QFileDialog::getExistingDirectory(this,
-                                                        tr("Save visible meshes into a directory in STL format"), ".");
-
-    if (!dirName.isEmpty() && !meshList.isEmpty())
-    {
-        for (int i = 0; i < meshList.size(); ++i)
-            if (meshList[i].actor->GetVisibility())
-            {
-                QString fileName = dirName + QString("/%1.stl").
-                        arg(i, 8, 10, QChar('0'));
-                vtkSTLWriter *writer = vtkSTLWriter::New();
-                writer->SetFileName(fileName.toAscii().data());
-                writer->SetInput(meshList[i].data);
-                writer->Update();
-                writer->Delete();
-            }
-    }
+    saveDir(tr("Save visible meshes into a directory in STL format"), "stl");
 }
 
 
@@ -601,7 +679,91 @@ void PMeshViewer::toggleFrontFace()
     for (int i = 0; i < meshList.size(); ++i)
         meshList[i].actor->GetProperty()->
                 SetFrontfaceCulling(hideFrontFace);
-    renderWindow->Render();
+    batcher.getProperty()->SetFrontfaceCulling(hideFrontFace);
+    render();
+}
+
+
+void PMeshViewer::toggleMergeParts()
+{
+    if (mergePartsAction->isChecked())
+        mergeParts();
+    else
+        splitParts();
+    render();
+}
+
+
+void PMeshViewer::toggleOcclusion()
+{
+    culler->setOcclusion(occlusionAction->isChecked());
+    render();
+}
+
+
+// Translucent parts are sorted by VTK unless blended.
+
+void PMeshViewer::toggleBlending()
+{
+    if (!renderer)
+        return;
+    renderer->SetPass(blendingAction->isChecked() ? blendingPass : NULL);
+    render();
+}
+
+
+void PMeshViewer::newGroup()
+{
+    QList<int> rows = selectedRows();
+    if (rows.isEmpty())
+    {
+        QMessageBox::information(this, appName,
+            "Select the parts of the group in the mesh list first.");
+        return;
+    }
+
+    bool ok;
+    QString name = QInputDialog::getText(this, appName, "Group name:",
+        QLineEdit::Normal, QString(), &ok).trimmed();
+    if (!ok || name.isEmpty())
+        return;
+    setGroup(name, rows);
+}
+
+
+// The group's action is checked while the group is shown.
+
+void PMeshViewer::toggleGroup()
+{
+    QAction *action = qobject_cast<QAction *>(sender());
+    if (action)
+        setGroupVisibility(action->data().toString(), action->isChecked());
+}
+
+
+// One checkable action per group, in the order of their names, checked
+// while any part of the group is shown.  Rebuilt whenever it is shown.
+
+void PMeshViewer::updateGroupMenu()
+{
+    groupMenu->clear();
+    groupMenu->addAction(newGroupAction);
+    if (!groups.isEmpty())
+        groupMenu->addSeparator();
+
+    QMap<QString, QList<vtkActor *> >::iterator it;
+    for (it = groups.begin(); it != groups.end(); ++it)
+    {
+        bool shown = false;
+        for (int i = 0; i < it.value().size() && !shown; ++i)
+            shown = it.value()[i]->GetVisibility();
+
+        QAction *action = groupMenu->addAction(it.key());
+        action->setData(it.key());
+        action->setCheckable(true);
+        action->setChecked(shown);
+        connect(action, SIGNAL(triggered()), this, SLOT(toggleGroup()));
+    }
 }
 
 
@@ -649,8 +811,12 @@ void PMeshViewer::setMeshMode(int mode)
         property->SetInterpolation(interpol);
         property->SetEdgeVisibility(edgeOn);
     }
+    vtkProperty *property = batcher.getProperty();
+    property->SetRepresentation(rep);
+    property->SetInterpolation(interpol);
+    property->SetEdgeVisibility(edgeOn);
     
-    renderWindow->Render();
+    render();
 }
 
 
@@ -702,6 +868,8 @@ void PMeshViewer::info()
         
         msg += QString("%1 faces, %2 MB<br>").
                 arg(numFaces).arg(memSize / 1000.0, 0, 'f', 2);
+        msg += QString("%1 of %2 parts culled in the last frame<br>").
+                arg(culler->getNumCulled()).arg(meshList.size());
     }
     else
         msg = QString("No mesh loaded.");
@@ -748,67 +916,43 @@ void PMeshViewer::setAppName(const QString &name)
 }
 
 
+// The check box of row was clicked; the selected rows follow it.
+
 void PMeshViewer::setVisibility(int row, int col)
 {
     if (col != 0)
         return;
 
-    int visibility;
-    Qt::CheckState state;
+    bool visible = meshTable->item(row, col)->checkState() == Qt::Checked;
+    QList<int> rows = selectedRows();
     
-    if (meshTable->item(row, col)->checkState() == Qt::Checked)
-    {
-        visibility = 1;
-        state = Qt::Checked;
-    }
-    else
-    {
-        visibility = 0;
-        state = Qt::Unchecked;
-    }
-
-    QList<QTableWidgetSelectionRange> list = meshTable->selectedRanges();
-    
-    if (list.isEmpty() || list[0].rowCount() == 1)
-    {
-        meshList[row].actor->SetVisibility(visibility);
-    }
-    else
-    {
-        int top = list[0].topRow();
-        int bot = list[0].bottomRow();
-        for (int r = top; r <= bot; ++r)
-        {
-            meshList[r].actor->SetVisibility(visibility);
-            meshTable->item(r, col)->setCheckState(state);
-        }
-        meshList[row].actor->SetVisibility(visibility);
-    }
-
-    renderWindow->Render();
+    beginUpdate();
+    if (rows.size() > 1)
+        for (int i = 0; i < rows.size(); ++i)
+            setPartVisibility(rows[i], visible);
+    setPartVisibility(row, visible);
+    endUpdate();
     
-    if (!list.isEmpty())
-        meshTable->setRangeSelected(list[0], false);
+    if (!rows.isEmpty())
+        meshTable->clearSelection();
 }
 
 
+// The colour dialog sets the opacity of the part too, as its alpha.
+
 void PMeshViewer::setColor(int row, int col)
 {
     if (col != 1)
         return;
 
-    QColor color = QColorDialog::getColor();
+    QColor color = QColorDialog::getColor(meshList[row].color, this,
+        tr("Part Colour"), QColorDialog::ShowAlphaChannel);
     if (!color.isValid())
         return;
-
-    QTableWidgetItem *item = meshTable->item(row, col);
-    item->setBackground(QBrush(color));
-    
-    double red = color.red() / 255.0;
-    double green = color.green() / 255.0;
-    double blue = color.blue() / 255.0;
-    meshList[row].actor->GetProperty()->SetColor(red, green, blue);
-    renderWindow->Render();
+    beginUpdate();
+    setPartColor(row, color);
+    setPartOpacity(row, color.alphaF());
+    endUpdate();
 }
 
 
@@ -816,20 +960,116 @@ void PMeshViewer::blink(int row, int col)
 {
     if (col < 2 || col == 3)
         return;
+    highlighter->start(meshList[row].actor);
+}
+
+
+// Follows the colour of a blinking part in its batch when merged.
+
+void PMeshViewer::showPartColor(vtkActor *actor, double red, double green,
+    double blue)
+{
+    batcher.setColor(partRows.value(actor, -1), red, green, blue);
+}
+
+
+#define RowHeight 20
+#define MaxHeight 600
+
+// Add a part whose read has finished.  The mapper and actor are made
+// here, as rendering objects belong to the GUI thread.
 
-    double red, green, blue, r, g, b;
-    vtkProperty *property = meshList[row].actor->GetProperty();
-    property->GetColor(red, green, blue);
-    r = g = b = 0.5;
+void PMeshViewer::meshLoaded()
+{
+    QFutureWatcher<PMeshPart> *watcher =
+        static_cast<QFutureWatcher<PMeshPart> *>(sender());
+    PMeshPart part = watcher->result();
+    int partGeneration = loads.take(watcher);
+    watcher->deleteLater();
+    
+    if (partGeneration != generation)  // Mesh list cleared since
+    {
+        releaseMesh(part);
+        return;
+    }
+    ++loadDone;
     
-    for (int i = 0; i < 2; ++i)
+    if (part.data)  // Read errors are reported by the reader.
     {
-        property->SetColor(r, g, b);
+        // Append to mesh list
+        part.mapper = vtkPolyDataMapper::New();
+        if (part.normals)
+            part.mapper->SetInput(part.normals->GetOutput());
+        else
+            part.mapper->SetInput(part.data);
+        part.actor = vtkActor::New();
+        part.actor->SetMapper(part.mapper);
+        part.actor->GetProperty()->SetFrontfaceCulling(hideFrontFace);
+        part.actor->GetProperty()->SetColor(part.color.redF(),
+            part.color.greenF(), part.color.blueF());
+        part.actor->GetProperty()->SetOpacity(part.color.alphaF());
+        part.actor->SetVisibility(part.visible);
+        lod->add(part.actor, part.data);
+        picker.add(part.actor, part.bvh);
+        culler->add(part.actor);
+        blender->add(part.actor);
+        partRows.insert(part.actor, meshList.size());
+        meshList.append(part);
+        renderer->AddActor(part.actor);
+
+        // Append to mesh table
+        int j = meshTable->rowCount();
+        meshTable->insertRow(j);
+        meshTable->setRowHeight(j, RowHeight);
+
+        QTableWidgetItem *item = new QTableWidgetItem;
+        item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
+        item->setCheckState(part.visible ? Qt::Checked : Qt::Unchecked);
+        meshTable->setItem(j, 0, item);
+
+        item = new QTableWidgetItem;
+        item->setFlags(Qt::ItemIsEnabled);
+        item->setBackground(QBrush(part.color));
+        if (part.color.alpha() < 255)
+            item->setText(QString("%1%").arg(qRound(100 *
+                part.color.alphaF())));
+        meshTable->setItem(j, 1, item);
+
+        item = new QTableWidgetItem(part.name);
+        item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable |
+                       Qt::ItemIsEditable);
+        item->setTextAlignment(Qt::AlignLeft | Qt::AlignVCenter);
+        meshTable->setItem(j, 2, item);
+
+        if (!part.label.isEmpty())
+            meshTable->setItem(j, 3, new QTableWidgetItem(part.label));
+        
+        item = new QTableWidgetItem(part.source);
+        item->setFlags(Qt::ItemIsEnabled);
+        item->setTextAlignment(Qt::AlignLeft | Qt::AlignVCenter);
+        meshTable->setItem(j, 4, item);
+
+        int width = meshTable->width();
+        int height = meshTable->height();
+        int bestHeight = qMin(MaxHeight,
+                              (meshTable->rowCount() + 2) * RowHeight);
+        if (height < bestHeight)
+            meshTable->resize(width, bestHeight);
+
+        renderer->ResetCamera();
         renderWindow->Render();
-        usleep(250000);
-        property->SetColor(red, green, blue);
+    }
+    
+    if (loadDone < loadTotal)
+        statusBar()->showMessage(QString("Loading meshes: %1 of %2").
+            arg(loadDone).arg(loadTotal));
+    else
+    {
+        remergeParts();
         renderWindow->Render();
-        usleep(250000);
+        QApplication::restoreOverrideCursor();
+        statusBar()->showMessage(QString("%1 meshes loaded").
+            arg(meshList.size()), 2000);
     }
 }
 
@@ -854,6 +1094,9 @@ void PMeshViewer::installPipeline(int startIndex)
     {
         renderer = vtkRenderer::New();  // Camera is also reset.
         renderer->SetBackground(0.0, 0.0, 0.0);
+        renderer->AddCuller(culler);
+        if (blendingAction->isChecked())
+            renderer->SetPass(blendingPass);
         renderWindow->AddRenderer(renderer);
     }
     
@@ -871,6 +1114,7 @@ void PMeshViewer::installPipeline(int startIndex)
 
 void PMeshViewer::uninstallPipeline()
 {   
+    batcher.clear();
     if (renderer)
     {
         renderer->RemoveAllViewProps();
@@ -879,21 +1123,114 @@ void PMeshViewer::uninstallPipeline()
         renderer = NULL;
     }
     
+    lod->clear();
+    highlighter->clear();
+    picker.clear();
+    culler->clear();
+    blender->clear();
+    partRows.clear();
+    groups.clear();
     for (int i = 0; i < meshList.size(); ++i)
     {
-        meshList[i].normals->Delete();
-        meshList[i].mapper->Delete();
-        meshList[i].actor->Delete();
+        releaseMesh(meshList[i]);
         meshTable->removeRow(0);  // Remove row 0 size times.
     }
     meshList.clear();
+    
+    // Meshes still being read are dropped when they arrive.
+    if (loadDone < loadTotal)
+        QApplication::restoreOverrideCursor();
+    loadDone = loadTotal = 0;
+    ++generation;
     projectName = QString("Untitled");
     loaded = false;
 }
 
 
-#define RowHeight 20
-#define MaxHeight 600
+// While merged, the part actors are out of the renderer but keep their
+// colours and visibility, which are also set in the batches.  Parts
+// added while merged are drawn by their own actors until all reads have
+// finished, and the batches are then rebuilt.  Translucent parts are
+// hidden in the batches and drawn by their own actors, so that the
+// batches stay opaque.
+
+void PMeshViewer::mergeParts()
+{
+    if (!renderer || meshList.isEmpty())
+        return;
+
+    QList<vtkActor *> actors;
+    for (int i = 0; i < meshList.size(); ++i)
+    {
+        actors.append(meshList[i].actor);
+        if (meshList[i].color.alpha() == 255)
+            renderer->RemoveActor(meshList[i].actor);
+    }
+    batcher.getProperty()->DeepCopy(meshList[0].actor->GetProperty());
+    batcher.getProperty()->SetOpacity(1.0);
+    batcher.build(renderer, actors);
+    for (int i = 0; i < meshList.size(); ++i)
+        if (meshList[i].color.alpha() < 255)
+            batcher.setVisibility(i, false);
+}
+
+
+void PMeshViewer::splitParts()
+{
+    if (batcher.isEmpty())
+        return;
+
+    batcher.clear();
+    for (int i = 0; i < meshList.size(); ++i)
+        renderer->AddActor(meshList[i].actor);
+}
+
+
+void PMeshViewer::remergeParts()
+{
+    if (!mergePartsAction->isChecked())
+        return;
+    splitParts();
+    mergeParts();
+}
+
+
+// The rows of all selected ranges, in order and each once.
+
+QList<int> PMeshViewer::selectedRows()
+{
+    QList<QTableWidgetSelectionRange> list = meshTable->selectedRanges();
+    QList<int> rows;
+    for (int i = 0; i < list.size(); ++i)
+        for (int r = list[i].topRow(); r <= list[i].bottomRow(); ++r)
+            if (!rows.contains(r))
+                rows.append(r);
+    qSort(rows);
+    return rows;
+}
+
+
+void PMeshViewer::indexParts()
+{
+    partRows.clear();
+    for (int i = 0; i < meshList.size(); ++i)
+        partRows.insert(meshList[i].actor, i);
+}
+
+
+// Renders now, or at the end of the current update.
+
+void PMeshViewer::render()
+{
+    if (updateDepth > 0)
+    {
+        renderPending = true;
+        return;
+    }
+    batcher.update();
+    renderWindow->Render();
+}
+
 
 void PMeshViewer::loadMesh(const QStringList &fileNames)
 {
@@ -902,96 +1239,189 @@ void PMeshViewer::loadMesh(const QStringList &fileNames)
 }
 
 
+// The meshes are read and their normals computed, or both are taken from
+// the mesh cache, in the global thread pool.  Each part is added to the
+// scene and the mesh table as its read finishes, so parts may arrive out
+// of order.
+
 void PMeshViewer::addMesh(const QStringList &fileNames)
 {
-    int startIndex = meshList.size();
-    
+    if (fileNames.isEmpty())
+        return;
+        
+    startLoads(fileNames.size());
     for (int i = 0; i < fileNames.size(); ++i)
-    {
-        QString suffix = QFileInfo(fileNames[i]).suffix();
+        watchLoad(QtConcurrent::run(readMesh, fileNames[i], &meshCache));
+}
 
-        vtkPolyDataAlgorithm *reader = NULL;
 
-        if (suffix == "obj")
-        {
-            vtkOBJReader *rd = vtkOBJReader::New();
-            rd->SetFileName(fileNames[i].toAscii().data());
-            reader = rd;
-        }
-        else if (suffix == "ply")
-        {
-            vtkPLYReader *rd = vtkPLYReader::New();
-            rd->SetFileName(fileNames[i].toAscii().data());
-            reader = rd;
-        }
-        else if (suffix == "stl")
-        {
-            vtkSTLReader *rd = vtkSTLReader::New();
-            rd->SetFileName(fileNames[i].toAscii().data());
-            reader = rd;
-        }
-        else // This should not happen, but just in case.
-        {
-            uninstallPipeline();
-            cout << "Error in loadMesh: file type " <<
-                    suffix.toAscii().data() << " is unsupported.\n" << flush;
-            return;
-        }
+// Opening a bundle reads only its table of contents.  The meshes are read
+// and unpacked in the global thread pool, as addMesh() reads files, and
+// the parts keep their colours, visibility and labels.
 
-        // Append to mesh list
-        PMeshPart part;
-        part.name = QFileInfo(fileNames[i]).baseName();
-        part.source = fileNames[i];
-        part.data = reader->GetOutput();
-        reader->Update();
-        
-        part.normals = vtkPolyDataNormals::New();
-        part.normals->SetInput(part.data);
-        part.mapper = vtkPolyDataMapper::New();
-        part.mapper->SetInput(part.normals->GetOutput());
-        part.mapper->Update();
-        part.actor = vtkActor::New();
-        part.actor->SetMapper(part.mapper);
-        meshList.append(part);
-        reader->Delete();
+bool PMeshViewer::loadBundle(const QString &fileName)
+{
+    PMeshBundle bundle;
+    if (!bundle.open(fileName))
+        return false;
 
-        // Append to mesh table
-        int j = meshTable->rowCount();
-        meshTable->insertRow(j);
-        meshTable->setRowHeight(j, RowHeight);
+    uninstallPipeline();
+    if (bundle.count() == 0)
+        return true;
 
-        QTableWidgetItem *item = new QTableWidgetItem;
-        item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
-        item->setCheckState(Qt::Checked);
-        meshTable->setItem(j, 0, item);
+    startLoads(bundle.count());
+    for (int i = 0; i < bundle.count(); ++i)
+        watchLoad(QtConcurrent::run(unpackMesh, bundle, i));
+    return true;
+}
 
-        item = new QTableWidgetItem;
-        item->setFlags(Qt::ItemIsEnabled);
-        item->setBackground(QBrush(QColor(255, 255, 255)));
-        meshTable->setItem(j, 1, item);
 
-        item = new QTableWidgetItem(part.name);
-        item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable |
-                       Qt::ItemIsEditable);
-        item->setTextAlignment(Qt::AlignLeft | Qt::AlignVCenter);
-        meshTable->setItem(j, 2, item);
+void PMeshViewer::startLoads(int count)
+{
+    if (loadDone == loadTotal)  // No reads in progress
+    {
+        installPipeline(meshList.size());
+        loadDone = loadTotal = 0;
+        QApplication::setOverrideCursor(Qt::BusyCursor);
+    }
+    loadTotal += count;
+    
+    statusBar()->showMessage(QString("Loading meshes: %1 of %2").
+        arg(loadDone).arg(loadTotal));
+    setWindowTitle(QString("%1 - %2").arg(appName).arg(projectName));
+}
+
+
+void PMeshViewer::watchLoad(const QFuture<PMeshPart> &future)
+{
+    QFutureWatcher<PMeshPart> *watcher = new QFutureWatcher<PMeshPart>(this);
+    connect(watcher, SIGNAL(finished()), this, SLOT(meshLoaded()));
+    loads.insert(watcher, generation);
+    watcher->setFuture(future);
+}
+
+
+// Runs in the global thread pool.  The part has no mapper or actor yet,
+// and no data if the file cannot be read.  A cached part has no normals
+// filter: its data is the output of the filter when it was cached.  The
+// filter does not split sharp edges, so that output has the points of the
+// file and the data is the same geometry either way.  The picking tree is
+// built here too, as it takes a while for large meshes.
+
+PMeshPart PMeshViewer::readMesh(const QString &fileName, PMeshCache *cache)
+{
+    PMeshPart part;
+    part.name = QFileInfo(fileName).baseName();
+    part.source = fileName;
+    
+    part.data = cache->read(fileName);
+    if (part.data)
+    {
+        part.bvh = new PMeshBvh;
+        part.bvh->build(part.data);
+        return part;
+    }
+    
+    PMeshReader reader;
+    reader.setFileName(fileName);
+    if (!reader.update())
+        return part;
         
-        item = new QTableWidgetItem(part.source);
-        item->setFlags(Qt::ItemIsEnabled);
-        item->setTextAlignment(Qt::AlignLeft | Qt::AlignVCenter);
-        meshTable->setItem(j, 4, item);
+    part.data = reader.getOutput();
+    part.data->Register(NULL);
+    part.normals = vtkPolyDataNormals::New();
+    part.normals->SetInput(part.data);
+    part.normals->SplittingOff();
+    part.normals->Update();
+    cache->write(fileName, part.normals->GetOutput());
+    part.bvh = new PMeshBvh;
+    part.bvh->build(part.data);
+    return part;
+}
+
+
+// Runs in the global thread pool.  The part is as it was saved, with the
+// mesh that was rendered, so it needs no normals filter.
+
+PMeshPart PMeshViewer::unpackMesh(const PMeshBundle &bundle, int i)
+{
+    PMeshPart part = bundle.getPart(i);
+    part.data = bundle.getMesh(i);
+    if (part.data)
+    {
+        part.bvh = new PMeshBvh;
+        part.bvh->build(part.data);
     }
+    return part;
+}
 
-    int width = meshTable->width();
-    int height = meshTable->height();
-    int bestHeight = qMin(MaxHeight,
-                          (meshTable->rowCount() + 2) * RowHeight);
-    if (height < bestHeight)
-        meshTable->resize(width, bestHeight);
 
-    installPipeline(startIndex);
+void PMeshViewer::releaseMesh(const PMeshPart &part)
+{
+    if (part.data)
+        part.data->Delete();
+    if (part.normals)
+        part.normals->Delete();
+    delete part.bvh;
+    if (part.mapper)
+        part.mapper->Delete();
+    if (part.actor)
+        part.actor->Delete();
+}
 
-    setWindowTitle(QString("%1 - %2").arg(appName).arg(projectName));
+
+// The visible meshes are written in the global thread pool, one per
+// task, while a progress dialog runs the event loop.  Cancelling stops
+// meshes not yet started; the files already written are kept.
+
+void PMeshViewer::saveDir(const QString &title, const QString &suffix)
+{
+    QString dirName = QFileDialog::getExistingDirectory(this, title, ".");
+    if (dirName.isEmpty() || meshList.isEmpty())
+        return;
+
+    QList<PMeshExport> jobs;
+    for (int i = 0; i < meshList.size(); ++i)
+        if (meshList[i].actor->GetVisibility())
+        {
+            PMeshExport job;
+            job.fileName = dirName + QString("/%1.%2").
+                arg(i, 8, 10, QChar('0')).arg(suffix);
+            job.mesh = meshList[i].data;
+            jobs.append(job);
+        }
+    if (jobs.isEmpty())
+        return;
+
+    QProgressDialog progress(tr("Saving meshes..."), tr("Cancel"), 0,
+        jobs.size(), this);
+    progress.setWindowModality(Qt::WindowModal);
+    QFutureWatcher<bool> watcher;
+    connect(&watcher, SIGNAL(progressValueChanged(int)),
+        &progress, SLOT(setValue(int)));
+    connect(&watcher, SIGNAL(finished()), &progress, SLOT(reset()));
+    connect(&progress, SIGNAL(canceled()), &watcher, SLOT(cancel()));
+    watcher.setFuture(QtConcurrent::mapped(jobs, writeMesh));
+    progress.exec();
+    watcher.waitForFinished();
+
+    int numSaved = 0;
+    for (int i = 0; i < jobs.size(); ++i)
+        if (watcher.future().isResultReadyAt(i) && watcher.resultAt(i))
+            ++numSaved;
+    statusBar()->showMessage(QString("%1 of %2 meshes saved").
+        arg(numSaved).arg(jobs.size()), 2000);
+}
+
+
+// Runs in the global thread pool.  Errors are reported by the writer.
+
+bool PMeshViewer::writeMesh(const PMeshExport &job)
+{
+    PMeshWriter writer;
+    writer.setFileName(job.fileName);
+    writer.setInput(job.mesh);
+    return writer.update();
 }
 
 
@@ -1043,12 +1473,132 @@ void PMeshViewer::highlight(vtkActor *actor)
 {
     if (!actor)
         meshTable->setCurrentCell(-1, -1);
-    else
-        for (int i = 0; i < meshList.size(); ++i)
-            if (meshList[i].actor == actor)
-            {
-                meshTable->setCurrentCell(i, 2);
-            }
+    else if (partRows.contains(actor))
+        meshTable->setCurrentCell(partRows.value(actor), 2);
+}
+
+
+// Parts are picked through their trees, so merged parts are picked as
+// they are, and point is exactly on the surface hit.
+
+vtkActor *PMeshViewer::pick(int x, int y, double *point)
+{
+    if (!renderer)
+        return NULL;
+    return picker.pick(renderer, x, y, point);
+}
+
+
+// The mesh table is not repainted during an update either.
+
+void PMeshViewer::beginUpdate()
+{
+    if (updateDepth++ == 0)
+        meshTable->setUpdatesEnabled(false);
+}
+
+
+void PMeshViewer::endUpdate()
+{
+    if (updateDepth == 0 || --updateDepth > 0)
+        return;
+    meshTable->setUpdatesEnabled(true);
+    if (renderPending)
+    {
+        renderPending = false;
+        render();
+    }
+}
+
+
+void PMeshViewer::setPartVisibility(int row, bool visible)
+{
+    if (row < 0 || row >= meshList.size())
+        return;
+    meshList[row].actor->SetVisibility(visible);
+    batcher.setVisibility(row, visible &&
+        meshList[row].color.alpha() == 255);
+    meshTable->item(row, 0)->setCheckState(visible ? Qt::Checked :
+        Qt::Unchecked);
+    render();
+}
+
+
+void PMeshViewer::setPartColor(int row, const QColor &color)
+{
+    if (row < 0 || row >= meshList.size())
+        return;
+    QColor partColor = color;
+    partColor.setAlpha(meshList[row].color.alpha());
+    meshTable->item(row, 1)->setBackground(QBrush(partColor));
+    meshList[row].color = partColor;
+
+    double red = color.red() / 255.0;
+    double green = color.green() / 255.0;
+    double blue = color.blue() / 255.0;
+    highlighter->stop(meshList[row].actor);
+    meshList[row].actor->GetProperty()->SetColor(red, green, blue);
+    batcher.setColor(row, red, green, blue);
+    render();
+}
+
+
+// A part becoming translucent or opaque while merged moves between its
+// batch and its own actor.
+
+void PMeshViewer::setPartOpacity(int row, double opacity)
+{
+    if (row < 0 || row >= meshList.size())
+        return;
+    PMeshPart &part = meshList[row];
+    bool wasOpaque = part.color.alpha() == 255;
+    part.color.setAlphaF(qBound(0.0, opacity, 1.0));
+    bool opaque = part.color.alpha() == 255;
+
+    QTableWidgetItem *item = meshTable->item(row, 1);
+    item->setBackground(QBrush(part.color));
+    item->setText(opaque ? QString() :
+        QString("%1%").arg(qRound(100 * part.color.alphaF())));
+    part.actor->GetProperty()->SetOpacity(part.color.alphaF());
+
+    if (!batcher.isEmpty() && opaque != wasOpaque)
+    {
+        if (opaque)
+            renderer->RemoveActor(part.actor);
+        else
+            renderer->AddActor(part.actor);
+        batcher.setVisibility(row, opaque && part.actor->GetVisibility());
+    }
+    render();
+}
+
+
+// Groups hold actors, so they survive the deletion of other rows.
+
+void PMeshViewer::setGroup(const QString &name, const QList<int> &rows)
+{
+    QList<vtkActor *> actors;
+    for (int i = 0; i < rows.size(); ++i)
+        if (rows[i] >= 0 && rows[i] < meshList.size() &&
+            !actors.contains(meshList[rows[i]].actor))
+            actors.append(meshList[rows[i]].actor);
+    groups.insert(name, actors);
+}
+
+
+void PMeshViewer::removeGroup(const QString &name)
+{
+    groups.remove(name);
+}
+
+
+void PMeshViewer::setGroupVisibility(const QString &name, bool visible)
+{
+    const QList<vtkActor *> actors = groups.value(name);
+    beginUpdate();
+    for (int i = 0; i < actors.size(); ++i)
+        setPartVisibility(partRows.value(actors[i], -1), visible);
+    endUpdate();
 }
 
 
@@ -1069,18 +1619,9 @@ void PMeshViewerCallback::Execute(vtkObject *caller,
 {
     vtkRenderWindowInteractor *interactor = viewer->getInteractor();
     int *pos = interactor->GetEventPosition();
-    vtkRenderer *renderer = viewer->getRenderer();
     
     // Pick at the mouse location provided by the interactor
-    vtkPropPicker *picker = vtkPropPicker::New();
-    int found = picker->PickProp(pos[0], pos[1], renderer);
-    
-    if (found)
-    {
-        vtkProp *prop = picker->GetViewProp();
-        viewer->highlight(vtkActor::SafeDownCast(prop));
-    }
-    else
-        viewer->highlight(NULL);
+    double point[3];
+    viewer->highlight(viewer->pick(pos[0], pos[1], point));
 }
 
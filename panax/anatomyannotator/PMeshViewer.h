@@ -11,9 +11,13 @@
 
 #include <QMainWindow>
 #include <QTableWidget>
+#include <QFutureWatcher>
+#include <QMap>
+#include <QHash>
 
 class QAction;
 class QComboBox;
+class PMeshBundle;
 
 #include "QVTKWidget.h"
 #include "vtkPolyDataAlgorithm.h"
@@ -24,20 +28,42 @@ class QComboBox;
 #include "vtkRenderWindow.h"
 #include "vtkRenderWindowInteractor.h"
 #include "vtkInteractorStyleTrackballCamera.h"
-#include "vtkPropPicker.h"
+#include "PLodManager.h"
+#include "PMeshCache.h"
+#include "PMeshBatcher.h"
+#include "PMeshPicker.h"
+#include "PHighlighter.h"
+#include "PMeshCuller.h"
+#include "PBlendedPass.h"
 
 
 class PMeshPart
 {
     friend class PMeshViewer;
     friend class PAnatomyAnnotator;
+    friend class PMeshBundle;
     QString name;
     QString source;
     vtkPolyData *data;
-    vtkPolyDataNormals *normals;
+    vtkPolyDataNormals *normals;  // NULL if data has cached normals
+    PMeshBvh *bvh;  // For picking
     vtkPolyDataMapper *mapper;
     vtkActor *actor;
-    QColor color;
+    QColor color;  // Opacity in alpha
+    bool visible;  // On loading
+    QString label, annotation;  // Empty for defaults
+    double anchor[3];  // Of the label
+
+public:
+    PMeshPart();
+};
+
+
+class PMeshExport
+{
+    friend class PMeshViewer;
+    QString fileName;
+    vtkPolyData *mesh;
 };
 
 
@@ -58,6 +84,20 @@ public:
     vtkRenderWindowInteractor *getInteractor();
     vtkRenderer *getRenderer();
     void highlight(vtkActor *actor);
+    vtkActor *pick(int x, int y, double *point);  // Part actor or NULL
+
+    // Scene changes between beginUpdate() and the matching endUpdate()
+    // are rendered once, by the outermost endUpdate().
+    void beginUpdate();
+    void endUpdate();
+    void setPartVisibility(int row, bool visible);
+    void setPartColor(int row, const QColor &color);  // Keeps opacity
+    void setPartOpacity(int row, double opacity);
+
+    // Named groups of parts, shown or hidden together
+    void setGroup(const QString &name, const QList<int> &rows);
+    void removeGroup(const QString &name);
+    void setGroupVisibility(const QString &name, bool visible);
     
 protected:
     void closeEvent(QCloseEvent *event);
@@ -75,6 +115,12 @@ protected slots:
     void saveDirStl();
     void saveView();
     void toggleFrontFace();
+    void toggleMergeParts();
+    void toggleOcclusion();
+    void toggleBlending();
+    void newGroup();
+    void toggleGroup();
+    void updateGroupMenu();
     void setMeshMode(int);
     void setSmoothSurface();
     void setFlatSurface();
@@ -87,6 +133,9 @@ protected slots:
     void setVisibility(int row, int col);
     void setColor(int row, int col);
     void blink(int row, int col);
+    void showPartColor(vtkActor *actor, double red, double green,
+        double blue);
+    void meshLoaded();
 
 protected:
     void createWidgets();
@@ -108,6 +157,10 @@ protected:
     QAction *exitAction;
     QAction *saveViewAction;
     QAction *frontFaceAction;
+    QAction *mergePartsAction;
+    QAction *occlusionAction;
+    QAction *blendingAction;
+    QAction *newGroupAction;
     QAction *smoothSurfaceAction;
     QAction *flatSurfaceAction;
     QAction *flatLinesAction;
@@ -121,6 +174,7 @@ protected:
     QMenu *saveMeshMenu;
     QMenu *viewMenu;
     QMenu *meshModeMenu;
+    QMenu *groupMenu;
     QMenu *windowMenu;
     QMenu *helpMenu;
     
@@ -140,6 +194,21 @@ protected:
     vtkRenderWindow *renderWindow;
     vtkRenderWindowInteractor *interactor;
     vtkInteractorStyleTrackballCamera *style;
+    PLodManager *lod;
+    PMeshCuller *culler;  // Of parts outside the view or hidden
+    PHighlighter *highlighter;
+    PBlendedPass *blender;  // Of translucent parts
+    vtkRenderPass *blendingPass;  // Of the renderer when blending
+    PMeshBatcher batcher;  // Of all parts when merged
+    PMeshPicker picker;  // Of all parts
+    QHash<vtkActor *, int> partRows;  // Row of each part actor
+    QMap<QString, QList<vtkActor *> > groups;
+    
+    // Meshes being read in the background
+    QMap<QObject *, int> loads;  // Watcher to generation
+    int generation;  // Of the current mesh list
+    int loadDone, loadTotal;
+    PMeshCache meshCache;
     
     // Internal variables.
     QString appName;
@@ -147,14 +216,30 @@ protected:
     bool loaded;
     int winWidth, winHeight;
     int hideFrontFace;
+    int updateDepth;     // Of nested beginUpdate()
+    bool renderPending;  // Scene changed during an update
     
     // Supporting methods
     void initSize();
     void installPipeline(int startIndex);
     void uninstallPipeline();
+    void mergeParts();
+    void splitParts();
+    void remergeParts();
+    void indexParts();
+    QList<int> selectedRows();
+    void render();
     void loadMesh(const QStringList &fileNames);
     void addMesh(const QStringList &fileNames);
+    bool loadBundle(const QString &fileName);
+    void startLoads(int count);
+    void watchLoad(const QFuture<PMeshPart> &future);
+    static PMeshPart readMesh(const QString &fileName, PMeshCache *cache);
+    static PMeshPart unpackMesh(const PMeshBundle &bundle, int i);
+    void releaseMesh(const PMeshPart &part);
     bool saveImage(const QString &fileName);
+    void saveDir(const QString &title, const QString &suffix);
+    static bool writeMesh(const PMeshExport &job);
 };
 
 #endif
@@ -5,11 +5,11 @@
 TEMPLATE = app
 TARGET = 
 DEPENDPATH += .
-INCLUDEPATH += .
+INCLUDEPATH += . ../strokeanalyser/src
 include(vtk.pro)
 
 # Input
-HEADERS += PAnatomyAnnotator.h PMeshViewer.h \
+HEADERS += PAnatomyAnnotator.h PMeshViewer.h PMeshBundle.h \
     qmyassessment.h \
     qeditassessment.h \
     question.h \
@@ -22,8 +22,19 @@ HEADERS += PAnatomyAnnotator.h PMeshViewer.h \
     assessmentwidget.h \
     lessonwidget.h \
     textedit.h \
-    editlesson.h
-SOURCES += main.cpp PAnatomyAnnotator.cpp PMeshViewer.cpp \
+    editlesson.h \
+    ../strokeanalyser/src/PParallel.h \
+    ../strokeanalyser/src/PMeshDecimator.h \
+    ../strokeanalyser/src/PLodManager.h \
+    ../strokeanalyser/src/PMeshBatcher.h \
+    ../strokeanalyser/src/PMeshPicker.h \
+    ../strokeanalyser/src/PHighlighter.h \
+    ../strokeanalyser/src/PMeshCuller.h \
+    ../strokeanalyser/src/PBlendedPass.h \
+    ../strokeanalyser/src/PMeshReader.h \
+    ../strokeanalyser/src/PMeshWriter.h \
+    ../strokeanalyser/src/PMeshCache.h
+SOURCES += main.cpp PAnatomyAnnotator.cpp PMeshViewer.cpp PMeshBundle.cpp \
     qmyassessment.cpp \
     qeditassessment.cpp \
     qmylesson.cpp \
@@ -32,5 +43,16 @@ SOURCES += main.cpp PAnatomyAnnotator.cpp PMeshViewer.cpp \
     assessmentwidget.cpp \
     lessonwidget.cpp \
     textedit.cpp \
-    editlesson.cpp
+    editlesson.cpp \
+    ../strokeanalyser/src/PParallel.cpp \
+    ../strokeanalyser/src/PMeshDecimator.cpp \
+    ../strokeanalyser/src/PLodManager.cpp \
+    ../strokeanalyser/src/PMeshBatcher.cpp \
+    ../strokeanalyser/src/PMeshPicker.cpp \
+    ../strokeanalyser/src/PHighlighter.cpp \
+    ../strokeanalyser/src/PMeshCuller.cpp \
+    ../strokeanalyser/src/PBlendedPass.cpp \
+    ../strokeanalyser/src/PMeshReader.cpp \
+    ../strokeanalyser/src/PMeshWriter.cpp \
+    ../strokeanalyser/src/PMeshCache.cpp
 RESOURCES += panax.qrc
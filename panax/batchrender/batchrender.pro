@@ -0,0 +1,27 @@
+######################################################################
+# Offscreen batch renderer of volume and mesh snapshots
+######################################################################
+
+TEMPLATE = app
+TARGET = batchrender
+CONFIG += console
+DEPENDPATH += .
+INCLUDEPATH += . ../strokeanalyser/src
+include(../anatomyannotator/vtk.pro)
+
+# Input
+HEADERS += ../strokeanalyser/src/PBatchRenderer.h \
+    ../strokeanalyser/src/PRayCastMapper.h \
+    ../strokeanalyser/src/PGradientCache.h \
+    ../strokeanalyser/src/PVolumePresets.h \
+    ../strokeanalyser/src/PImageSaver.h \
+    ../strokeanalyser/src/PMeshReader.h \
+    ../strokeanalyser/src/PParallel.h
+SOURCES += main.cpp \
+    ../strokeanalyser/src/PBatchRenderer.cpp \
+    ../strokeanalyser/src/PRayCastMapper.cpp \
+    ../strokeanalyser/src/PGradientCache.cpp \
+    ../strokeanalyser/src/PVolumePresets.cpp \
+    ../strokeanalyser/src/PImageSaver.cpp \
+    ../strokeanalyser/src/PMeshReader.cpp \
+    ../strokeanalyser/src/PParallel.cpp
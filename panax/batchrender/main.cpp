@@ -0,0 +1,53 @@
+// main.cpp
+//
+// Usage: batchrender [-j jobs] job.ini ...
+//
+// Renders each job file offscreen, up to the given number of jobs at once,
+// and encodes the movies they ask for.  The shots of a job are rendered
+// by "batchrender --threads n --shots first count --job job.ini" in
+// processes of their own.
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <iostream>
+#include "PBatchRenderer.h"
+#include "PParallel.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    PBatchRenderer renderer;
+    QStringList args = app.arguments();
+    QStringList jobFiles;
+    QString job;
+    int first = 0, count = -1;
+
+    for (int i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-j" && i + 1 < args.size())
+            renderer.setMaxJobs(args[++i].toInt());
+        else if (args[i] == "--threads" && i + 1 < args.size())
+            parallelPool()->setMaxThreadCount(qMax(1, args[++i].toInt() - 1));
+        else if (args[i] == "--shots" && i + 2 < args.size())
+        {
+            first = args[++i].toInt();
+            count = args[++i].toInt();
+        }
+        else if (args[i] == "--job" && i + 1 < args.size())
+            job = args[++i];
+        else
+            jobFiles << args[i];
+    }
+
+    if (!job.isEmpty())
+        return renderer.renderJob(job, first, count) ? 0 : 1;
+
+    if (jobFiles.isEmpty())
+    {
+        cerr << "Usage: batchrender [-j jobs] job.ini ...\n";
+        return 2;
+    }
+    return renderer.run(jobFiles) == 0 ? 0 : 1;
+}
@@ -0,0 +1,627 @@
+/* PBatchRenderer.cpp
+
+   Offscreen batch rendering of volume and mesh snapshots and movies.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PBatchRenderer.h"
+#include "PRayCastMapper.h"
+#include "PImageSaver.h"
+#include "PMeshReader.h"
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QThread>
+#include <QColor>
+#include "vtkDICOMImageReader.h"
+#include "vtkVolumeProperty.h"
+#include "vtkVolume.h"
+#include "vtkPolyDataNormals.h"
+#include "vtkPolyDataMapper.h"
+#include "vtkActor.h"
+#include "vtkProperty.h"
+#include "vtkMath.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#define DefaultWidth 800
+#define DefaultHeight 600
+#define DefaultPreset "CT Bone"
+
+
+// Entry i of a list setting, the last entry past its end.
+
+static double listValue(const QStringList &list, int i)
+{
+    if (list.isEmpty())
+        return 0.0;
+    return list[qMin(i, list.size() - 1)].trimmed().toDouble();
+}
+
+
+// Three numbers of a setting such as a colour.
+
+static void tripleValue(QSettings &job, const QString &key, double fallback,
+    double *v)
+{
+    QStringList list = job.value(key).toStringList();
+    for (int i = 0; i < 3; ++i)
+        v[i] = i < list.size() ? list[i].trimmed().toDouble() : fallback;
+}
+
+
+// PBatchRenderer class
+
+PBatchRenderer::PBatchRenderer()
+{
+    maxJobs = qMax(1, QThread::idealThreadCount());
+    program = QCoreApplication::applicationFilePath();
+    done = total = 0;
+    volumeMapper = NULL;
+    presets.addStandard();
+}
+
+
+PBatchRenderer::~PBatchRenderer()
+{
+    QList<QProcess *> processes = running.keys();
+    for (int i = 0; i < processes.size(); ++i)
+    {
+        processes[i]->disconnect(this);
+        processes[i]->kill();
+        processes[i]->waitForFinished();
+    }
+}
+
+
+void PBatchRenderer::setMaxJobs(int n)
+{
+    maxJobs = qMax(1, n);
+}
+
+
+int PBatchRenderer::getMaxJobs()
+{
+    return maxJobs;
+}
+
+
+void PBatchRenderer::setProgram(const QString &fileName)
+{
+    program = fileName;
+}
+
+
+// Queue the jobs and start as many tasks as may run.  The shots of a job
+// are split so that a few long jobs also keep every child busy.
+
+void PBatchRenderer::start(const QStringList &jobFiles)
+{
+    failedJobs.clear();
+    done = total = 0;
+    int pieces = qMax(1, maxJobs / qMax(1, jobFiles.size()));
+
+    for (int i = 0; i < jobFiles.size(); ++i)
+    {
+        QSettings job(jobFiles[i], QSettings::IniFormat);
+        int numShots = countShots(job);
+        int chunk = (numShots + pieces - 1) / pieces;
+
+        PBatchTask task;
+        task.jobFile = jobFiles[i];
+        remaining[task.jobFile] = 0;
+        for (task.first = 0; task.first < numShots; task.first += chunk)
+        {
+            task.count = qMin(chunk, numShots - task.first);
+            pending.append(task);
+            ++remaining[task.jobFile];
+            ++total;
+        }
+        if (job.contains("output/movie"))
+            ++total;
+    }
+    startTasks();
+}
+
+
+int PBatchRenderer::run(const QStringList &jobFiles)
+{
+    start(jobFiles);
+    if (isRunning())
+        loop.exec();
+    return failedJobs.size();
+}
+
+
+bool PBatchRenderer::isRunning()
+{
+    return !running.isEmpty();
+}
+
+
+// Render shots [first, first + count) of one job.  Errors are reported
+// on the standard error.
+
+bool PBatchRenderer::renderJob(const QString &jobFile, int first, int count)
+{
+    if (!QFileInfo(jobFile).isReadable())
+    {
+        cerr << "Error in renderJob: cannot read " <<
+            jobFile.toAscii().data() << ".\n" << flush;
+        return false;
+    }
+    QSettings job(jobFile, QSettings::IniFormat);
+    QDir dir = QFileInfo(jobFile).absoluteDir();
+
+    vtkRenderWindow *window = vtkRenderWindow::New();
+    window->SetOffScreenRendering(1);
+    window->SetSize(job.value("render/width", DefaultWidth).toInt(),
+        job.value("render/height", DefaultHeight).toInt());
+    vtkRenderer *renderer = vtkRenderer::New();
+    double background[3];
+    tripleValue(job, "render/background", 0.0, background);
+    renderer->SetBackground(background);
+    window->AddRenderer(renderer);
+
+    bool ok;
+    volumeMapper = NULL;
+    if (job.contains("input/dicom"))
+        ok = addVolume(renderer, job, dir);
+    else if (job.contains("input/meshes"))
+        ok = addMeshes(renderer, job, dir);
+    else
+    {
+        cerr << "Error in renderJob: " << jobFile.toAscii().data() <<
+            " has no input.\n" << flush;
+        ok = false;
+    }
+
+    if (ok && job.value("output/file").toString().isEmpty())
+    {
+        cerr << "Error in renderJob: " << jobFile.toAscii().data() <<
+            " has no output file.\n" << flush;
+        ok = false;
+    }
+
+    if (ok)
+    {
+        // Every shot starts from the same camera.  Shots are encoded while
+        // the next one renders.
+        vtkCamera *camera = renderer->GetActiveCamera();
+        if (job.contains("camera/position"))
+        {
+            double v[3];
+            tripleValue(job, "camera/position", 0.0, v);
+            camera->SetPosition(v);
+            tripleValue(job, "camera/focalPoint", 0.0, v);
+            camera->SetFocalPoint(v);
+            tripleValue(job, "camera/viewUp", 0.0, v);
+            camera->SetViewUp(v);
+            camera->SetViewAngle(job.value("camera/viewAngle", 30.0).
+                toDouble());
+
+            // A cine switches to parallel projection.  Without a recorded
+            // scale it frames what the perspective view did at the focal
+            // point.
+            double scale = camera->GetDistance() *
+                tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle() / 2));
+            camera->SetParallelScale(job.value("camera/parallelScale",
+                scale).toDouble());
+        }
+        else
+            renderer->ResetCamera();
+
+        // Zoom once, for perspective and parallel projection alike, so
+        // that the shots do not compound it.
+        double zoom = job.value("camera/zoom", 1.0).toDouble();
+        if (zoom > 0.0)
+        {
+            camera->SetViewAngle(camera->GetViewAngle() / zoom);
+            camera->SetParallelScale(camera->GetParallelScale() / zoom);
+        }
+        double base[9];
+        camera->GetPosition(base);
+        camera->GetFocalPoint(base + 3);
+        camera->GetViewUp(base + 6);
+
+        int numShots = countShots(job);
+        if (count < 0 || first + count > numShots)
+            count = numShots - first;
+        QString pattern = shotPattern(job, dir, numShots);
+        dir.mkpath(QFileInfo(pattern).absolutePath());
+        PImageSaver saver;
+        connect(&saver, SIGNAL(message(const QString &)),
+            this, SLOT(report(const QString &)), Qt::DirectConnection);
+
+        for (int i = first; ok && i < first + count; ++i)
+        {
+            placeCamera(renderer, job, base, i, numShots);
+            window->Render();
+
+            QString fileName = pattern.contains("%1") ?
+                pattern.arg(i, 3, 10, QChar('0')) : pattern;
+            if (!saver.save(window, fileName))
+            {
+                cerr << "Error in renderJob: file type of " <<
+                    fileName.toAscii().data() << " is unsupported.\n" <<
+                    flush;
+                ok = false;
+            }
+        }
+        ok = saver.waitForDone() && ok;
+    }
+
+    renderer->RemoveAllViewProps();
+    window->RemoveRenderer(renderer);
+    renderer->Delete();
+    window->Delete();
+    volumeMapper = NULL;
+    return ok;
+}
+
+
+int PBatchRenderer::countShots(QSettings &job)
+{
+    int turntable = job.value("camera/turntable", 0).toInt();
+    int cine = job.value("camera/cine", 0).toInt();
+    if (turntable > 0)
+        return turntable;
+    if (cine > 0)
+        return cine;
+
+    int azimuth = job.value("camera/azimuth", "0").toStringList().size();
+    int elevation = job.value("camera/elevation", "0").toStringList().size();
+    return qMax(1, qMax(azimuth, elevation));
+}
+
+
+void PBatchRenderer::setTriple(QSettings &job, const QString &key,
+    const double *v)
+{
+    QStringList list;
+    for (int i = 0; i < 3; ++i)
+        list << QString::number(v[i], 'g', 10);
+    job.setValue(key, list);
+}
+
+
+void PBatchRenderer::setCamera(QSettings &job, vtkCamera *camera)
+{
+    setTriple(job, "camera/position", camera->GetPosition());
+    setTriple(job, "camera/focalPoint", camera->GetFocalPoint());
+    setTriple(job, "camera/viewUp", camera->GetViewUp());
+    job.setValue("camera/viewAngle", camera->GetViewAngle());
+    if (camera->GetParallelProjection())
+        job.setValue("camera/parallelScale", camera->GetParallelScale());
+}
+
+
+// A movie file gets its frames in a directory beside it; an image file
+// names a sequence.
+
+void PBatchRenderer::setOutput(QSettings &job, const QString &fileName)
+{
+    QFileInfo info(fileName);
+    QString base = info.absolutePath() + "/" + info.completeBaseName();
+    QString suffix = info.suffix();
+    if (suffix == "jpg" || suffix == "png" || suffix == "tif")
+    {
+        job.setValue("output/file", base + "_%1." + suffix);
+        job.remove("output/movie");
+    }
+    else
+    {
+        job.setValue("output/file", base + "_frames/frame_%1.png");
+        job.setValue("output/movie", info.absoluteFilePath());
+    }
+}
+
+
+// Slot methods
+
+// Failed writes of shots, from the writer threads
+
+void PBatchRenderer::report(const QString &text)
+{
+    if (text.startsWith("Cannot"))
+        cerr << "Error in renderJob: " << text.toAscii().data() << ".\n" <<
+            flush;
+}
+
+
+void PBatchRenderer::taskFinished(int exitCode, QProcess::ExitStatus status)
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    PBatchTask task = running.take(process);
+    process->deleteLater();
+
+    endTask(task, status == QProcess::NormalExit && exitCode == 0);
+    startTasks();
+}
+
+
+// Supporting methods
+
+// Start tasks until maxJobs are running.  A render task runs this program
+// on a share of the shots of its job and of the cores; an encoding task
+// runs ffmpeg.
+
+void PBatchRenderer::startTasks()
+{
+    int threads = qMax(1, QThread::idealThreadCount() / maxJobs);
+    while (running.size() < maxJobs && !pending.isEmpty())
+    {
+        PBatchTask task = pending.takeFirst();
+        QString fileName = program;
+        QStringList args;
+        if (task.count > 0)
+            args << "--threads" << QString::number(threads) <<
+                "--shots" << QString::number(task.first) <<
+                QString::number(task.count) << "--job" << task.jobFile;
+        else
+        {
+            QSettings job(task.jobFile, QSettings::IniFormat);
+            QDir dir = QFileInfo(task.jobFile).absoluteDir();
+            QString pattern = shotPattern(job, dir, countShots(job));
+            fileName = "ffmpeg";
+            args << "-y" << "-loglevel" << "error" << "-framerate" <<
+                job.value("output/frameRate", 24).toString() <<
+                "-start_number" << "0" << "-i" <<
+                pattern.replace("%1", "%03d") << "-pix_fmt" << "yuv420p" <<
+                dir.absoluteFilePath(job.value("output/movie").toString());
+        }
+
+        QProcess *process = new QProcess(this);
+        process->setProcessChannelMode(QProcess::ForwardedChannels);
+        connect(process, SIGNAL(finished(int, QProcess::ExitStatus)),
+            this, SLOT(taskFinished(int, QProcess::ExitStatus)));
+        process->start(fileName, args);
+        if (!process->waitForStarted())
+        {
+            cerr << "Error in startTasks: cannot start " <<
+                fileName.toAscii().data() << ".\n" << flush;
+            delete process;
+            endTask(task, false);
+            continue;
+        }
+        running.insert(process, task);
+    }
+
+    if (running.isEmpty() && pending.isEmpty())
+    {
+        emit finished(failedJobs.size());
+        loop.quit();
+    }
+}
+
+
+// Count the task done and, after the last shots of a job, queue its movie
+// ahead of the other jobs, or skip it if the job failed.
+
+void PBatchRenderer::endTask(const PBatchTask &task, bool ok)
+{
+    if (!ok && !failedJobs.contains(task.jobFile))
+    {
+        cerr << "Job " << task.jobFile.toAscii().data() << " failed.\n" <<
+            flush;
+        failedJobs.insert(task.jobFile);
+    }
+    ++done;
+
+    if (task.count > 0 && --remaining[task.jobFile] == 0)
+    {
+        QSettings job(task.jobFile, QSettings::IniFormat);
+        if (job.contains("output/movie"))
+        {
+            PBatchTask movie = task;
+            movie.first = movie.count = 0;
+            if (failedJobs.contains(task.jobFile))
+                ++done;
+            else
+                pending.prepend(movie);
+        }
+    }
+    emit progress(done, total);
+}
+
+
+// The new objects are released here and kept alive by the renderer.
+
+bool PBatchRenderer::addVolume(vtkRenderer *renderer, QSettings &job,
+    const QDir &dir)
+{
+    QString dirName = dir.absoluteFilePath(job.value("input/dicom").
+        toString());
+    QString name = job.value("render/preset", DefaultPreset).toString();
+    int preset = presets.find(name);
+    if (preset < 0)
+    {
+        cerr << "Error in addVolume: unknown preset " <<
+            name.toAscii().data() << ".\n" << flush;
+        return false;
+    }
+
+    vtkDICOMImageReader *reader = vtkDICOMImageReader::New();
+    reader->SetDirectoryName(dirName.toAscii().data());
+    reader->Update();
+    int *ip = reader->GetDataExtent();
+    if (ip[1] < ip[0] || ip[3] < ip[2] || ip[5] < ip[4])
+    {
+        cerr << "Error in addVolume: directory " <<
+            dirName.toAscii().data() << " does not contain DICOM volume.\n"
+            << flush;
+        reader->Delete();
+        return false;
+    }
+
+    vtkVolumeProperty *property = vtkVolumeProperty::New();
+    property->SetIndependentComponents(true);
+    presets.apply(preset, property);
+    property->SetInterpolationTypeToLinear();
+    int mode = presets.getBlendMode(preset);
+    if (mode == vtkVolumeMapper::COMPOSITE_BLEND)
+    {
+        property->ShadeOn();
+        property->SetAmbient(job.value("render/ambient", 0.1).toDouble());
+        property->SetDiffuse(0.9);
+        property->SetSpecular(job.value("render/specular", 0.2).toDouble());
+        property->SetSpecularPower(10.0);
+    }
+
+    PRayCastMapper *mapper = PRayCastMapper::New();
+    mapper->SetBlendMode(mode);
+    mapper->setSampleDistance(
+        job.value("render/sampleDistance", 1.0).toDouble());
+    mapper->setSlabThickness(job.value("render/slab", 0.0).toDouble());
+    mapper->SetInputConnection(reader->GetOutputPort());
+
+    volumeMapper = mapper;
+
+    vtkVolume *volume = vtkVolume::New();
+    volume->SetMapper(mapper);
+    volume->SetProperty(property);
+    renderer->AddVolume(volume);
+
+    volume->Delete();
+    mapper->Delete();
+    property->Delete();
+    reader->Delete();
+    return true;
+}
+
+
+bool PBatchRenderer::addMeshes(vtkRenderer *renderer, QSettings &job,
+    const QDir &dir)
+{
+    QStringList fileNames = job.value("input/meshes").toStringList();
+    QStringList colors = job.value("render/colors").toStringList();
+    double defaultColor[3];
+    tripleValue(job, "render/color", 1.0, defaultColor);
+
+    for (int i = 0; i < fileNames.size(); ++i)
+    {
+        QString fileName = dir.absoluteFilePath(fileNames[i].trimmed());
+        PMeshReader reader;
+        reader.setFileName(fileName);
+        if (!reader.update())
+            return false;
+        if (reader.getOutput()->GetNumberOfPoints() == 0)
+        {
+            cerr << "Error in addMeshes: no mesh in " <<
+                fileName.toAscii().data() << ".\n" << flush;
+            return false;
+        }
+
+        vtkPolyDataNormals *normals = vtkPolyDataNormals::New();
+        normals->SetInput(reader.getOutput());
+        vtkPolyDataMapper *mapper = vtkPolyDataMapper::New();
+        mapper->SetInput(normals->GetOutput());
+        vtkActor *actor = vtkActor::New();
+        actor->SetMapper(mapper);
+        QColor color(i < colors.size() ? colors[i].trimmed() : QString());
+        if (color.isValid())
+            actor->GetProperty()->SetColor(color.redF(), color.greenF(),
+                color.blueF());
+        else
+            actor->GetProperty()->SetColor(defaultColor);
+        renderer->AddActor(actor);
+
+        actor->Delete();
+        mapper->Delete();
+        normals->Delete();
+    }
+    return true;
+}
+
+
+// Turn the camera from the base (position, focal point, view up) to
+// the given shot.  A cine step moves the camera along its direction of
+// projection to the next slab of the scene.  A projecting volume is cut
+// to the slab; anything else is cut at the focal plane.
+
+void PBatchRenderer::placeCamera(vtkRenderer *renderer, QSettings &job,
+    const double *base, int shot, int numShots)
+{
+    vtkCamera *camera = renderer->GetActiveCamera();
+    camera->SetPosition(base);
+    camera->SetFocalPoint(base + 3);
+    camera->SetViewUp(base + 6);
+
+    int cine = job.value("camera/cine", 0).toInt();
+    if (job.value("camera/turntable", 0).toInt() > 0)
+        camera->Azimuth(360.0 * shot / numShots);
+    else if (cine <= 0)
+    {
+        camera->Azimuth(listValue(
+            job.value("camera/azimuth", "0").toStringList(), shot));
+        camera->Elevation(listValue(
+            job.value("camera/elevation", "0").toStringList(), shot));
+        camera->OrthogonalizeViewUp();
+    }
+
+    if (cine <= 0)
+    {
+        renderer->ResetCameraClippingRange();
+        return;
+    }
+
+    // Depth range of the scene along the direction of projection
+    double bounds[6], d[3];
+    renderer->ComputeVisiblePropBounds(bounds);
+    camera->GetDirectionOfProjection(d);
+    double lo = VTK_DOUBLE_MAX, hi = -VTK_DOUBLE_MAX;
+    for (int i = 0; i < 8; ++i)
+    {
+        double t = 0.0;
+        for (int j = 0; j < 3; ++j)
+            t += (bounds[2*j + (i >> j & 1)] - base[3 + j]) * d[j];
+        lo = min(lo, t);
+        hi = max(hi, t);
+    }
+    double step = (hi - lo) / numShots;
+    double t = lo + (shot + 0.5) * step;
+
+    double position[3], focalPoint[3];
+    for (int j = 0; j < 3; ++j)
+    {
+        position[j] = base[j] + t * d[j];
+        focalPoint[j] = base[3 + j] + t * d[j];
+    }
+    camera->ParallelProjectionOn();
+    camera->SetPosition(position);
+    camera->SetFocalPoint(focalPoint);
+    renderer->ResetCameraClippingRange();
+
+    if (volumeMapper &&
+        volumeMapper->GetBlendMode() != vtkVolumeMapper::COMPOSITE_BLEND)
+    {
+        double slab = job.value("render/slab", 0.0).toDouble();
+        volumeMapper->setSlabThickness(slab > 0.0 ? slab : step);
+    }
+    else
+    {
+        double range[2];
+        camera->GetClippingRange(range);
+        camera->SetClippingRange(camera->GetDistance(), range[1]);
+    }
+}
+
+
+// Output file name with %1 for the shot number if there is more than one.
+
+QString PBatchRenderer::shotPattern(QSettings &job, const QDir &dir,
+    int numShots)
+{
+    QString pattern = dir.absoluteFilePath(job.value("output/file").
+        toString());
+    if (numShots > 1 && !pattern.contains("%1"))
+    {
+        QFileInfo info(pattern);
+        pattern = info.absolutePath() + "/" + info.completeBaseName() +
+            "_%1." + info.suffix();
+    }
+    return pattern;
+}
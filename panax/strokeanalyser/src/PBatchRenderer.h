@@ -0,0 +1,144 @@
+/* PBatchRenderer.h
+
+   Offscreen batch rendering of volume and mesh snapshots and movies.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PBATCHRENDERER_H
+#define PBATCHRENDERER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QProcess>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QEventLoop>
+#include <QSettings>
+#include <QDir>
+#include "vtkRenderer.h"
+#include "vtkRenderWindow.h"
+#include "vtkCamera.h"
+#include "PVolumePresets.h"
+
+class PRayCastMapper;
+
+
+// A job is an INI file that names a DICOM series or a list of meshes, the
+// look and the camera path, and the image file to write:
+//
+//   [input]
+//   dicom = study01/series3        ; or meshes = skull.ply, brain.stl
+//   [render]
+//   width = 800
+//   height = 600
+//   preset = CT Bone               ; see PVolumePresets::addStandard()
+//   sampleDistance = 0.5
+//   slab = 0                       ; thickness of MIP/MinIP slabs in mm
+//   ambient = 0.1
+//   specular = 0.2
+//   background = 0, 0, 0
+//   color = 1, 1, 1                ; of meshes
+//   colors = #ff8080, #ffffff      ; of each mesh, overriding color
+//   [camera]
+//   azimuth = 0, 90, 180, 270      ; degrees, one snapshot per entry
+//   elevation = 0
+//   zoom = 1.0
+//   turntable = 0                  ; number of shots around the view up
+//   cine = 0                       ; number of slabs through the volume
+//   [output]
+//   file = snapshots/study01_%1.png
+//   movie = snapshots/study01.mp4  ; encoded from the shots by ffmpeg
+//   frameRate = 24
+//
+// Relative paths are taken from the directory of the job file.  Lists in
+// the camera section are repeated from their last entry to the length of
+// the longest, and %1 in the file name is replaced by the shot number.
+// The camera starts reset to the scene unless position, focalPoint,
+// viewUp and viewAngle are given, as the viewers do when exporting; a
+// cine then uses parallelScale if given, or else the height of the
+// perspective view at the focal point.
+//
+// A turntable of n shots turns the camera 360 / n degrees each shot.  A
+// cine of n shots switches to parallel projection and moves the camera
+// through the volume in n steps, drawing each as a slab of render/slab
+// thickness, or of the step if that is 0, so MIP and MinIP presets give
+// thick-slab cine loops.
+//
+// A job renders in a render window of its own with offscreen rendering
+// on.  With VTK built on OSMesa the window has a software OpenGL context
+// and needs no display.  Volumes are drawn by the CPU ray caster, which
+// does not depend on the OpenGL driver.
+//
+// Rendering is not thread-safe in VTK, so a batch runs each job in child
+// processes, up to maxJobs at once, with the cores shared between them.
+// The shots of a long job are split between several children, and once
+// all are written the movie, if any, is encoded.  start() returns at
+// once and the batch runs in the event loop; run() waits for it.
+
+class PBatchTask
+{
+    friend class PBatchRenderer;
+    QString jobFile;
+    int first, count;  // Shots; no shots to encode the movie
+};
+
+
+class PBatchRenderer: public QObject
+{
+    Q_OBJECT
+
+public:
+    PBatchRenderer();
+    ~PBatchRenderer();
+
+    void setMaxJobs(int n);
+    int getMaxJobs();
+    void setProgram(const QString &fileName);  // Default: this program
+
+    void start(const QStringList &jobFiles);
+    int run(const QStringList &jobFiles);  // Returns number of failed jobs
+    bool isRunning();
+
+    // In this process.  count -1 renders all shots from first.
+    bool renderJob(const QString &jobFile, int first = 0, int count = -1);
+    static int countShots(QSettings &job);
+
+    // For viewers writing jobs
+    static void setTriple(QSettings &job, const QString &key,
+        const double *v);
+    static void setCamera(QSettings &job, vtkCamera *camera);
+    static void setOutput(QSettings &job, const QString &fileName);
+
+signals:
+    void progress(int done, int total);  // In tasks
+    void finished(int failed);
+
+protected slots:
+    void taskFinished(int exitCode, QProcess::ExitStatus status);
+    void report(const QString &text);
+
+protected:
+    int maxJobs;
+    QString program;
+    QList<PBatchTask> pending;
+    QHash<QProcess *, PBatchTask> running;
+    QHash<QString, int> remaining;  // Render tasks left of each job
+    QSet<QString> failedJobs;
+    int done, total;
+    QEventLoop loop;
+    PVolumePresets presets;
+    PRayCastMapper *volumeMapper;  // Of the job being rendered
+
+    // Supporting methods
+    void startTasks();
+    void endTask(const PBatchTask &task, bool ok);
+    bool addVolume(vtkRenderer *renderer, QSettings &job, const QDir &dir);
+    bool addMeshes(vtkRenderer *renderer, QSettings &job, const QDir &dir);
+    void placeCamera(vtkRenderer *renderer, QSettings &job,
+        const double *base, int shot, int numShots);
+    QString shotPattern(QSettings &job, const QDir &dir, int numShots);
+};
+
+#endif
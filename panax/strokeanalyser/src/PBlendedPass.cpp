@@ -0,0 +1,565 @@
+/* PBlendedPass.cpp
+
+   Order-independent transparency of mesh actors.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PBlendedPass.h"
+#include "vtkRenderState.h"
+#include "vtkRenderer.h"
+#include "vtkOpenGLRenderWindow.h"
+#include "vtkOpenGLExtensionManager.h"
+#include "vtkTranslucentPass.h"
+#include "vtkPolyDataMapper.h"
+#include "vtkProperty.h"
+#include "vtkMatrix4x4.h"
+#include "vtkPoints.h"
+#include "vtkPointData.h"
+#include "vtkCellArray.h"
+#include "vtkOpenGL.h"
+#include "vtkgl.h"
+
+#include <iostream>
+using namespace std;
+
+#define KeepFrames 500  // Meshes not drawn for longer lose their indices
+
+
+// Supporting functions
+
+// Colours are weighted by opacity and a weight that falls off with the
+// depth, bounded so that dozens of layers fit in half floats.
+
+static const char *DrawVertexShader =
+    "varying vec3 position;\n"
+    "varying vec3 normal;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 p = gl_ModelViewMatrix * gl_Vertex;\n"
+    "    position = p.xyz / p.w;\n"
+    "    normal = gl_NormalMatrix * gl_Normal;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+static const char *DrawFragmentShader =
+    "uniform vec4 color;\n"     // Opacity in alpha
+    "uniform vec4 lighting;\n"  // Ambient, diffuse, specular, power
+    "uniform int faceted;\n"
+    "varying vec3 position;\n"
+    "varying vec3 normal;\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 n = faceted != 0 ?\n"
+    "        cross(dFdx(position), dFdy(position)) : normal;\n"
+    "    float d = abs(dot(normalize(n), normalize(-position)));\n"
+    "    vec3 c = color.rgb * (lighting.x + lighting.y * d) +\n"
+    "        lighting.z * pow(max(2.0 * d * d - 1.0, 0.0), lighting.w);\n"
+    "    float z = 1.0 - gl_FragCoord.z;\n"
+    "    float w = color.a * clamp(3e3 * z * z * z, 1e-2, 3e2);\n"
+    "    gl_FragData[0] = vec4(c * w, color.a);\n"
+    "    gl_FragData[1] = vec4(w);\n"
+    "}\n";
+
+static const char *CompositeFragmentShader =
+    "uniform sampler2D accum;\n"
+    "uniform sampler2D weight;\n"
+    "uniform vec2 origin;\n"  // Of the viewport
+    "uniform vec2 size;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 t = (gl_FragCoord.xy - origin) / size;\n"
+    "    vec4 a = texture2D(accum, t);\n"
+    "    if (a.a >= 1.0)\n"
+    "        discard;\n"
+    "    float w = texture2D(weight, t).r;\n"
+    "    gl_FragColor = vec4(a.rgb / clamp(w, 1e-4, 5e4), 1.0 - a.a);\n"
+    "}\n";
+
+
+static GLuint compileShader(GLenum type, const char *source)
+{
+    GLuint shader = vtkgl::CreateShader(type);
+    const vtkgl::GLchar *text = source;
+    vtkgl::ShaderSource(shader, 1, &text, NULL);
+    vtkgl::CompileShader(shader);
+
+    GLint compiled = 0;
+    vtkgl::GetShaderiv(shader, vtkgl::COMPILE_STATUS, &compiled);
+    if (!compiled)
+    {
+        vtkgl::DeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+
+// The vertex shader may be NULL, for the fixed pipeline.
+
+static GLuint linkProgram(const char *vertexSource,
+    const char *fragmentSource)
+{
+    GLuint vertex = 0;
+    if (vertexSource)
+    {
+        vertex = compileShader(vtkgl::VERTEX_SHADER, vertexSource);
+        if (!vertex)
+            return 0;
+    }
+    GLuint fragment = compileShader(vtkgl::FRAGMENT_SHADER,
+        fragmentSource);
+    if (!fragment)
+    {
+        if (vertex)
+            vtkgl::DeleteShader(vertex);
+        return 0;
+    }
+
+    GLuint program = vtkgl::CreateProgram();
+    if (vertex)
+        vtkgl::AttachShader(program, vertex);
+    vtkgl::AttachShader(program, fragment);
+    vtkgl::LinkProgram(program);
+
+    // The shaders are freed with the program.
+    if (vertex)
+        vtkgl::DeleteShader(vertex);
+    vtkgl::DeleteShader(fragment);
+
+    GLint linked = 0;
+    vtkgl::GetProgramiv(program, vtkgl::LINK_STATUS, &linked);
+    if (!linked)
+    {
+        vtkgl::DeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+
+static void setTexture(GLuint texture, GLint format, GLenum pixelFormat,
+    GLenum type, int width, int height)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, vtkgl::CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, vtkgl::CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, pixelFormat,
+        type, NULL);
+}
+
+
+static GLenum glType(vtkDataArray *array)
+{
+    if (array->GetDataType() == VTK_FLOAT)
+        return GL_FLOAT;
+    if (array->GetDataType() == VTK_DOUBLE)
+        return GL_DOUBLE;
+    return 0;
+}
+
+
+// PBlendedPass class
+
+PBlendedPass::PBlendedPass()
+{
+    delegatePass = vtkTranslucentPass::New();
+    frame = 0;
+    supported = -1;
+    frameBuffer = 0;
+    accumTexture = weightTexture = depthTexture = 0;
+    drawProgram = compositeProgram = 0;
+    width = height = 0;
+}
+
+
+// The OpenGL objects are freed by ReleaseGraphicsResources(), while the
+// context is current.
+
+PBlendedPass::~PBlendedPass()
+{
+    delegatePass->Delete();
+}
+
+
+void PBlendedPass::add(vtkActor *actor)
+{
+    actors.insert(actor);
+}
+
+
+void PBlendedPass::remove(vtkActor *actor)
+{
+    actors.remove(actor);
+}
+
+
+void PBlendedPass::clear()
+{
+    actors.clear();
+    meshes.clear();
+}
+
+
+void PBlendedPass::setDelegatePass(vtkRenderPass *pass)
+{
+    if (!pass || pass == delegatePass)
+        return;
+    pass->Register(this);
+    delegatePass->UnRegister(this);
+    delegatePass = pass;
+}
+
+
+void PBlendedPass::Render(const vtkRenderState *s)
+{
+    NumberOfRenderedProps = 0;
+    ++frame;
+    vtkRenderer *ren = s->GetRenderer();
+    int w, h, x, y;
+    ren->GetTiledSizeAndOrigin(&w, &h, &x, &y);
+
+    // Split the props between the blending and the delegate pass.
+    vtkProp **props = s->GetPropArray();
+    int numProps = s->GetPropArrayCount();
+    vector<vtkProp *> others;
+    vector<vtkActor *> blended;
+    for (int i = 0; i < numProps; ++i)
+    {
+        vtkActor *actor = vtkActor::SafeDownCast(props[i]);
+        if (actor && actors.contains(actor) &&
+            actor->GetProperty()->GetOpacity() < 1.0)
+            blended.push_back(actor);
+        else
+            others.push_back(props[i]);
+    }
+    if (!blended.empty() && !(initialize(vtkOpenGLRenderWindow::
+        SafeDownCast(ren->GetRenderWindow())) && resize(w, h)))
+    {
+        others.insert(others.end(), blended.begin(), blended.end());
+        blended.clear();
+    }
+
+    if (!others.empty())
+    {
+        vtkRenderState state(ren);
+        state.SetPropArrayAndCount(&others[0], (int) others.size());
+        state.SetFrameBuffer(s->GetFrameBuffer());
+        delegatePass->Render(&state);
+        NumberOfRenderedProps += delegatePass->GetNumberOfRenderedProps();
+    }
+    if (blended.empty())
+        return;
+
+    glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+        GL_ENABLE_BIT | GL_POLYGON_BIT | GL_SCISSOR_BIT | GL_TEXTURE_BIT |
+        GL_VIEWPORT_BIT);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+
+    // Copy the opaque depth, then draw into the textures.
+    GLint previous;
+    glGetIntegerv(vtkgl::FRAMEBUFFER_BINDING_EXT, &previous);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, x, y, w, h);
+    vtkgl::BindFramebufferEXT(vtkgl::FRAMEBUFFER_EXT, frameBuffer);
+    glViewport(0, 0, w, h);
+    glDisable(GL_SCISSOR_TEST);
+
+    glDrawBuffer(vtkgl::COLOR_ATTACHMENT0_EXT);
+    glClearColor(0.0, 0.0, 0.0, 1.0);  // Nothing hidden yet
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDrawBuffer(vtkgl::COLOR_ATTACHMENT1_EXT);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    GLenum buffers[2] = { vtkgl::COLOR_ATTACHMENT0_EXT,
+                          vtkgl::COLOR_ATTACHMENT1_EXT };
+    vtkgl::DrawBuffers(2, buffers);
+
+    // Colours and weights add up; transparencies multiply in alpha.
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    vtkgl::BlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO,
+        GL_ONE_MINUS_SRC_ALPHA);
+    vtkgl::UseProgram(drawProgram);
+    for (size_t i = 0; i < blended.size(); ++i)
+        drawActor(blended[i]);
+    NumberOfRenderedProps += (int) blended.size();
+
+    vtkgl::BindFramebufferEXT(vtkgl::FRAMEBUFFER_EXT, previous);
+    glPopAttrib();
+    glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+        GL_ENABLE_BIT | GL_TEXTURE_BIT);
+    composite(x, y);
+    vtkgl::UseProgram(0);
+    glPopClientAttrib();
+    glPopAttrib();
+
+    prune();
+}
+
+
+void PBlendedPass::ReleaseGraphicsResources(vtkWindow *w)
+{
+    if (frameBuffer)
+    {
+        vtkgl::DeleteFramebuffersEXT(1, &frameBuffer);
+        glDeleteTextures(1, &accumTexture);
+        glDeleteTextures(1, &weightTexture);
+        glDeleteTextures(1, &depthTexture);
+    }
+    if (drawProgram)
+        vtkgl::DeleteProgram(drawProgram);
+    if (compositeProgram)
+        vtkgl::DeleteProgram(compositeProgram);
+
+    supported = -1;
+    frameBuffer = 0;
+    accumTexture = weightTexture = depthTexture = 0;
+    drawProgram = compositeProgram = 0;
+    width = height = 0;
+    delegatePass->ReleaseGraphicsResources(w);
+}
+
+
+// Protected methods
+
+// Checked once per context, with the extensions loaded and the programs
+// built.
+
+bool PBlendedPass::initialize(vtkOpenGLRenderWindow *context)
+{
+    if (supported >= 0)
+        return supported == 1;
+    supported = 0;
+    if (!context)
+        return false;
+
+    vtkOpenGLExtensionManager *extensions = context->GetExtensionManager();
+    if (!extensions->LoadSupportedExtension("GL_VERSION_1_3") ||
+        !extensions->LoadSupportedExtension("GL_VERSION_1_4") ||
+        !extensions->LoadSupportedExtension("GL_VERSION_2_0") ||
+        !extensions->LoadSupportedExtension("GL_EXT_framebuffer_object") ||
+        !extensions->LoadSupportedExtension("GL_ARB_texture_float"))
+    {
+        cerr << "Error in initialize: OpenGL 2 with floating point "
+             << "frame buffers is needed for blending\n" << flush;
+        return false;
+    }
+
+    drawProgram = linkProgram(DrawVertexShader, DrawFragmentShader);
+    compositeProgram = linkProgram(NULL, CompositeFragmentShader);
+    if (!drawProgram || !compositeProgram)
+    {
+        cerr << "Error in initialize: cannot build the blending "
+             << "shaders\n" << flush;
+        return false;
+    }
+    colorLocation = vtkgl::GetUniformLocation(drawProgram, "color");
+    lightingLocation = vtkgl::GetUniformLocation(drawProgram, "lighting");
+    facetedLocation = vtkgl::GetUniformLocation(drawProgram, "faceted");
+    accumLocation = vtkgl::GetUniformLocation(compositeProgram, "accum");
+    weightLocation = vtkgl::GetUniformLocation(compositeProgram, "weight");
+    originLocation = vtkgl::GetUniformLocation(compositeProgram, "origin");
+    sizeLocation = vtkgl::GetUniformLocation(compositeProgram, "size");
+
+    vtkgl::GenFramebuffersEXT(1, &frameBuffer);
+    glGenTextures(1, &accumTexture);
+    glGenTextures(1, &weightTexture);
+    glGenTextures(1, &depthTexture);
+    supported = 1;
+    return true;
+}
+
+
+// The textures follow the size of the viewport.
+
+bool PBlendedPass::resize(int w, int h)
+{
+    if (w == width && h == height)
+        return true;
+
+    glPushAttrib(GL_TEXTURE_BIT);
+    setTexture(accumTexture, vtkgl::RGBA16F_ARB, GL_RGBA, GL_FLOAT, w, h);
+    setTexture(weightTexture, vtkgl::RGBA16F_ARB, GL_RGBA, GL_FLOAT, w,
+        h);
+    setTexture(depthTexture, vtkgl::DEPTH_COMPONENT24, GL_DEPTH_COMPONENT,
+        GL_UNSIGNED_INT, w, h);
+    glPopAttrib();
+
+    GLint previous;
+    glGetIntegerv(vtkgl::FRAMEBUFFER_BINDING_EXT, &previous);
+    vtkgl::BindFramebufferEXT(vtkgl::FRAMEBUFFER_EXT, frameBuffer);
+    vtkgl::FramebufferTexture2DEXT(vtkgl::FRAMEBUFFER_EXT,
+        vtkgl::COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, accumTexture, 0);
+    vtkgl::FramebufferTexture2DEXT(vtkgl::FRAMEBUFFER_EXT,
+        vtkgl::COLOR_ATTACHMENT1_EXT, GL_TEXTURE_2D, weightTexture, 0);
+    vtkgl::FramebufferTexture2DEXT(vtkgl::FRAMEBUFFER_EXT,
+        vtkgl::DEPTH_ATTACHMENT_EXT, GL_TEXTURE_2D, depthTexture, 0);
+    GLenum status = vtkgl::CheckFramebufferStatusEXT(vtkgl::FRAMEBUFFER_EXT);
+    vtkgl::BindFramebufferEXT(vtkgl::FRAMEBUFFER_EXT, previous);
+
+    if (status != vtkgl::FRAMEBUFFER_COMPLETE_EXT)
+    {
+        cerr << "Error in resize: cannot draw into floating point "
+             << "textures\n" << flush;
+        supported = 0;
+        width = height = 0;
+        return false;
+    }
+    width = w;
+    height = h;
+    return true;
+}
+
+
+// Drawn with the view already in the modelview matrix, as the camera
+// pass leaves it.
+
+void PBlendedPass::drawActor(vtkActor *actor)
+{
+    vtkPolyDataMapper *mapper =
+        vtkPolyDataMapper::SafeDownCast(actor->GetMapper());
+    vtkPolyData *mesh = mapper ? mapper->GetInput() : NULL;
+    if (!mesh || !mesh->GetPoints() || !glType(mesh->GetPoints()->GetData()))
+        return;
+    const PBlendedMesh &entry = index(mesh);
+    if (entry.indices.empty())
+        return;
+
+    vtkProperty *property = actor->GetProperty();
+    double *rgb = property->GetColor();
+    vtkgl::Uniform4f(colorLocation, rgb[0], rgb[1], rgb[2],
+        property->GetOpacity());
+    vtkgl::Uniform4f(lightingLocation, property->GetAmbient(),
+        property->GetDiffuse(), property->GetSpecular(),
+        property->GetSpecularPower());
+
+    if (property->GetRepresentation() == VTK_WIREFRAME)
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    else if (property->GetRepresentation() == VTK_POINTS)
+        glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+    else
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    if (property->GetBackfaceCulling() || property->GetFrontfaceCulling())
+    {
+        glEnable(GL_CULL_FACE);
+        glCullFace(property->GetFrontfaceCulling() ? GL_FRONT : GL_BACK);
+    }
+    else
+        glDisable(GL_CULL_FACE);
+
+    vtkDataArray *points = mesh->GetPoints()->GetData();
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, glType(points), 0, points->GetVoidPointer(0));
+
+    // Without point normals, or for a flat surface, each triangle is lit
+    // by its own plane.
+    vtkDataArray *normals = mesh->GetPointData()->GetNormals();
+    bool faceted = !normals || !glType(normals) ||
+        property->GetInterpolation() == VTK_FLAT;
+    vtkgl::Uniform1i(facetedLocation, faceted);
+    if (faceted)
+        glDisableClientState(GL_NORMAL_ARRAY);
+    else
+    {
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(glType(normals), 0, normals->GetVoidPointer(0));
+    }
+
+    double matrix[16];
+    vtkMatrix4x4::Transpose(*actor->GetMatrix()->Element, matrix);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glMultMatrixd(matrix);
+    glDrawElements(GL_TRIANGLES, entry.indices.size(), GL_UNSIGNED_INT,
+        &entry.indices[0]);
+    glPopMatrix();
+}
+
+
+// Lays the mean colour over the viewport with a quad covering it.
+
+void PBlendedPass::composite(int x, int y)
+{
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    vtkgl::UseProgram(compositeProgram);
+    vtkgl::ActiveTexture(vtkgl::TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumTexture);
+    vtkgl::ActiveTexture(vtkgl::TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, weightTexture);
+    vtkgl::ActiveTexture(vtkgl::TEXTURE0);
+    vtkgl::Uniform1i(accumLocation, 0);
+    vtkgl::Uniform1i(weightLocation, 1);
+    vtkgl::Uniform2f(originLocation, x, y);
+    vtkgl::Uniform2f(sizeLocation, width, height);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glBegin(GL_QUADS);
+    glVertex2f(-1.0, -1.0);
+    glVertex2f(1.0, -1.0);
+    glVertex2f(1.0, 1.0);
+    glVertex2f(-1.0, 1.0);
+    glEnd();
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+
+const PBlendedMesh &PBlendedPass::index(vtkPolyData *mesh)
+{
+    QHash<vtkPolyData *, PBlendedMesh>::iterator it = meshes.find(mesh);
+    if (it == meshes.end())
+    {
+        PBlendedMesh entry;
+        entry.time = 0;
+        it = meshes.insert(mesh, entry);
+    }
+    PBlendedMesh &entry = it.value();
+    entry.frame = frame;
+
+    vtkCellArray *polys = mesh->GetPolys();
+    if (entry.time == polys->GetMTime())
+        return entry;
+    entry.time = polys->GetMTime();
+    entry.indices.clear();
+    entry.indices.reserve(3 * polys->GetNumberOfCells());
+
+    vtkIdType numIds, *ids;
+    for (polys->InitTraversal(); polys->GetNextCell(numIds, ids); )
+        for (vtkIdType k = 2; k < numIds; ++k)
+        {
+            entry.indices.push_back(ids[0]);
+            entry.indices.push_back(ids[k - 1]);
+            entry.indices.push_back(ids[k]);
+        }
+    return entry;
+}
+
+
+// Level of detail proxies come and go with each interaction, so meshes
+// are forgotten only once unused for a while.
+
+void PBlendedPass::prune()
+{
+    QHash<vtkPolyData *, PBlendedMesh>::iterator it = meshes.begin();
+    while (it != meshes.end())
+        if (frame - it.value().frame > KeepFrames)
+            it = meshes.erase(it);
+        else
+            ++it;
+}
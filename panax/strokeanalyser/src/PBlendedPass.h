@@ -0,0 +1,87 @@
+/* PBlendedPass.h
+
+   Order-independent transparency of mesh actors.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PBLENDEDPASS_H
+#define PBLENDEDPASS_H
+
+#include <QSet>
+#include <QHash>
+#include <vector>
+#include "vtkRenderPass.h"
+#include "vtkActor.h"
+#include "vtkPolyData.h"
+
+class vtkOpenGLRenderWindow;
+
+
+// Takes the place of the translucent pass.  The translucent added actors
+// are drawn in a single pass, in any order, by weighted blended
+// transparency: each fragment adds its colour, weighted by its opacity
+// and nearness, to one buffer and the weight to another, while the
+// product of the fragments' transparencies gathers in the first buffer's
+// alpha.  The weighted mean colour is then laid over the opaque scene by
+// one minus that product, so nothing is sorted or peeled.  The depth of
+// the opaque scene is copied first, so that it hides translucent
+// fragments behind it.
+//
+// An actor is drawn from the points, point normals and triangles of its
+// mapper's input, lit by a headlight with the colour, opacity and
+// lighting of its property.  The triangles are indexed once per mesh, and
+// again only when its polygons change.  Other translucent props, and all
+// of them without OpenGL 2 and floating point frame buffers, go to the
+// delegate pass, a vtkTranslucentPass unless set.
+
+class PBlendedMesh
+{
+    friend class PBlendedPass;
+    unsigned long time;  // Of the polygons indexed
+    int frame;           // Last drawn in
+    std::vector<unsigned int> indices;  // Triangles, polygons as fans
+};
+
+
+class PBlendedPass: public vtkRenderPass
+{
+public:
+    static PBlendedPass *New() { return new PBlendedPass; }
+
+    void add(vtkActor *actor);
+    void remove(vtkActor *actor);
+    void clear();
+
+    void setDelegatePass(vtkRenderPass *pass);  // For other props
+
+    void Render(const vtkRenderState *s);
+    void ReleaseGraphicsResources(vtkWindow *w);
+
+protected:
+    PBlendedPass();
+    ~PBlendedPass();
+
+    QSet<vtkProp *> actors;
+    vtkRenderPass *delegatePass;
+    QHash<vtkPolyData *, PBlendedMesh> meshes;
+    int frame;  // Number of frames drawn
+
+    // OpenGL objects, made on the first frame with translucent actors
+    int supported;  // -1 until known
+    unsigned int frameBuffer;
+    unsigned int accumTexture, weightTexture, depthTexture;
+    unsigned int drawProgram, compositeProgram;
+    int colorLocation, lightingLocation, facetedLocation;
+    int accumLocation, weightLocation, originLocation, sizeLocation;
+    int width, height;  // Of the textures
+
+    bool initialize(vtkOpenGLRenderWindow *context);
+    bool resize(int w, int h);
+    void drawActor(vtkActor *actor);
+    void composite(int x, int y);
+    const PBlendedMesh &index(vtkPolyData *mesh);
+    void prune();
+};
+
+#endif
@@ -13,16 +13,15 @@
 #include "vtkCellArray.h"
 #include "vtkProperty.h"
 #include "vtkCommand.h"
+#include "vtkExecutive.h"
 #include "vtkInteractorStyleImage.h"
-#include "vtkWindowToImageFilter.h"
-#include "vtkJPEGWriter.h"
-#include "vtkPNGWriter.h"
-#include "vtkTIFFWriter.h"
 
 #include <unistd.h>
 using namespace std;
 
 // #define USE_SMART_MAPPER
+#define CpuOption 5  // First sampleDistanceBox entry drawn by PRayCastMapper
+#define DefaultFrameTime 100.0  // Target interactive frame time in ms
 
 
 PDicomSegmenter::PDicomSegmenter()
@@ -64,13 +63,12 @@ PDicomSegmenter::~PDicomSegmenter()
 
     anisoDiffuser->Delete();
     
-    colorFn->Delete();
-    opacityFn->Delete();
     property->Delete();
 #ifdef USE_SMART_MAPPER
     smartMapper->Delete();
 #endif
     rayCastMapper->Delete();
+    cpuMapper->Delete();
     volumeActor->Delete();
     volumeRenderer->RemoveAllViewProps();
     volumeWidget->GetRenderWindow()->RemoveRenderer(volumeRenderer);
@@ -78,9 +76,10 @@ PDicomSegmenter::~PDicomSegmenter()
     volumeStyle->Delete();
     
     mcubes->Delete();
-    decimate->Delete();
-    smooth->Delete();
+    delete decimator;
+    delete smoother;
     normals->Delete();
+    delete lod;
     meshMapper->Delete();
     meshActor->Delete();
     meshRenderer->RemoveAllViewProps();
@@ -299,19 +298,22 @@ void PDicomSegmenter::createVolumeRenderer()
     volumeWidget = new QVTKWidget;
         
     // Create transfer functions
-    opacityFn = vtkPiecewiseFunction::New();
-    colorFn = vtkColorTransferFunction::New();
+    createPresets();
   
     // Create volume property and attach transfer functions
     property = vtkVolumeProperty::New();
     property->SetIndependentComponents(true);
-    property->SetScalarOpacity(opacityFn);
-    property->SetColor(colorFn);
+    presets.apply(0, property);
     property->SetInterpolationTypeToLinear();
     
     // Create mapper and actor
     rayCastMapper = vtkFixedPointVolumeRayCastMapper::New();
     volumeMapper = rayCastMapper;
+    cpuMapper = PRayCastMapper::New();
+    cpuMapper->setAutoAdjust(true);
+    cpuMapper->setProgressive(true);
+    connect(cpuMapper->getNotifier(), SIGNAL(refined()),
+        this, SLOT(refineView()));
     
 #ifdef USE_SMART_MAPPER
     smartMapper = vtkSmartVolumeMapper::New();
@@ -334,6 +336,9 @@ void PDicomSegmenter::createVolumeRenderer()
     vtkRenderWindowInteractor *interactor = renderWindow->GetInteractor();
     volumeStyle = vtkInteractorStyleTrackballCamera::New();
     interactor->SetInteractorStyle(volumeStyle);
+
+    // Coarser sampling while the camera moves, as in PVolumeRenderer
+    interactor->SetDesiredUpdateRate(1000.0 / DefaultFrameTime);
 }
 
 
@@ -342,7 +347,7 @@ void PDicomSegmenter::createVolumeDialog()
     // Volume render dialog
     volumeRenderDialog = new QWidget;
     volumeRenderDialog->setWindowTitle("Volume Renderer");
-    volumeRenderDialog->setFixedSize(250, 250);
+    volumeRenderDialog->setFixedSize(250, 280);
     QVBoxLayout *mainLayout = new QVBoxLayout;
     volumeRenderDialog->setLayout(mainLayout);
     
@@ -350,12 +355,14 @@ void PDicomSegmenter::createVolumeDialog()
     QGroupBox *gbox = new QGroupBox("Viewing Mode");
     viewTypeBox = new QComboBox;
     QStringList choices;
-    choices << "CT Skin" << "CT Muscle" << "CT Bone" << "CTA Vessels";
+    choices << "CT Skin" << "CT Muscle" << "CT Bone" << "CTA Vessels"
+        << "MIP" << "MinIP";
     viewTypeBox->insertItems(0, choices);
     
     sampleDistanceBox = new QComboBox;
     choices.clear();
-    choices << "1" << "1/2" << "1/4" << "1/8" << "1/16";
+    choices << "1" << "1/2" << "1/4" << "1/8" << "1/16" << "CPU 1"
+        << "CPU 1/2" << "CPU 1/4" << "CPU 1/8";
     sampleDistanceBox->insertItems(0, choices);
     connect(sampleDistanceBox, SIGNAL(activated(int)),
         this, SLOT(setSampleDistance(int)));
@@ -371,6 +378,14 @@ void PDicomSegmenter::createVolumeDialog()
     specularBox->setRange(0.0, 1.0);
     specularBox->setSingleStep(0.1);
     specularBox->setValue(0.2);
+    
+    slabBox = new QDoubleSpinBox;
+    slabBox->setDecimals(0);
+    slabBox->setRange(0.0, 500.0);
+    slabBox->setSingleStep(5.0);
+    slabBox->setSuffix(" mm");
+    slabBox->setSpecialValueText("All");
+    slabBox->setValue(0.0);
         
     QGridLayout *grid = new QGridLayout;
     grid->addWidget(new QLabel("mode"), 0, 0);
@@ -381,6 +396,8 @@ void PDicomSegmenter::createVolumeDialog()
     grid->addWidget(ambientBox, 2, 1);
     grid->addWidget(new QLabel("specular"), 3, 0);
     grid->addWidget(specularBox, 3, 1);
+    grid->addWidget(new QLabel("slab"), 4, 0);
+    grid->addWidget(slabBox, 4, 1);
     gbox->setLayout(grid);
     mainLayout->addWidget(gbox);
     
@@ -411,21 +428,15 @@ void PDicomSegmenter::createMeshObjects()
     // input to mcubes is not yet set.
 
     double featureAngle = 60.0;
-    decimate = vtkDecimatePro::New();
-    decimate->SetFeatureAngle(featureAngle);
-    decimate->PreserveTopologyOn();
-    // mcubes to decimate is not yet connected.
-    
-    smooth = vtkSmoothPolyDataFilter::New();
-    smooth->SetFeatureAngle(featureAngle);
-    smooth->FeatureEdgeSmoothingOff();
-    smooth->BoundarySmoothingOff();
-    smooth->SetConvergence(0);
-    smooth->SetInputConnection(decimate->GetOutputPort());
+    decimator = new PMeshDecimator;
+    // mcubes to decimator is not yet connected.
+    
+    smoother = new PMeshSmoother;
+    smoother->setInput(decimator->getOutput());
 
     normals = vtkPolyDataNormals::New();
     normals->SetFeatureAngle(featureAngle);
-    // mcubes or smooth to normals is not yet connected.
+    // mcubes or smoother to normals is not yet connected.
 }
 
 
@@ -451,6 +462,10 @@ void PDicomSegmenter::createMeshViewer()
     vtkRenderWindowInteractor *interactor = renderWindow->GetInteractor();
     meshStyle = vtkInteractorStyleTrackballCamera::New();
     interactor->SetInteractorStyle(meshStyle);
+
+    // Draw a decimated mesh while the camera moves.
+    lod = new PLodManager(this);
+    lod->setInteractorStyle(meshStyle);
 }
 
 
@@ -811,8 +826,9 @@ void PDicomSegmenter::resetPipeline()
     genMeshDialog->hide();
     genMeshAction->setChecked(false);
     mcubes->SetInputConnection(NULL);
-    decimate->SetInputConnection(NULL);
+    decimator->setInput(NULL);
     normals->SetInputConnection(NULL);
+    lod->clear();
     if (outputMesh)
         outputMesh->Delete();
     outputMesh = NULL;
@@ -1206,8 +1222,13 @@ void PDicomSegmenter::volumeRender()
     QApplication::setOverrideCursor(Qt::WaitCursor);
     computeOutputVolume();
     setBlendType();
+    if (sampleDistanceBox->currentIndex() >= CpuOption)
+    {
+        cpuMapper->SetInput(outputVolume);
+        volumeMapper = cpuMapper;
+    }
 #ifdef USE_SMART_MAPPER
-    if (sampleDistanceBox->currentIndex() == 0)
+    else if (sampleDistanceBox->currentIndex() == 0)
     {
         smartMapper->SetInput(outputVolume);
         volumeMapper = smartMapper;
@@ -1218,8 +1239,11 @@ void PDicomSegmenter::volumeRender()
         volumeMapper = rayCastMapper;
     }
 #else
-    rayCastMapper->SetInput(outputVolume);
-    volumeMapper = rayCastMapper;
+    else
+    {
+        rayCastMapper->SetInput(outputVolume);
+        volumeMapper = rayCastMapper;
+    }
 #endif
     volumeActor->SetMapper(volumeMapper);
     volumeRenderer->ResetCamera();
@@ -1228,13 +1252,27 @@ void PDicomSegmenter::volumeRender()
 }
 
 
+// Draw the latest refinement pass of the CPU ray caster.
+
+void PDicomSegmenter::refineView()
+{
+    if (hasVolumeActor)
+        volumeWidget->GetRenderWindow()->Render();
+}
+
+
 void PDicomSegmenter::setSampleDistance(int option)
 {
     if (!loaded)
         return;
        
-    float distance = 1.0 / (1 << option);
-    rayCastMapper->SetSampleDistance(distance);
+    if (option >= CpuOption)
+        cpuMapper->setSampleDistance(1.0 / (1 << (option - CpuOption)));
+    else
+    {
+        float distance = 1.0 / (1 << option);
+        rayCastMapper->SetSampleDistance(distance);
+    }
 }
 
 
@@ -1307,13 +1345,11 @@ void PDicomSegmenter::generateMesh()
         
     QApplication::setOverrideCursor(Qt::WaitCursor);
     normals->Update();
-    if (outputMesh)
-        outputMesh->Delete();
-    outputMesh = vtkPolyData::New();
-    outputMesh->DeepCopy(normals->GetOutput());
+    takeOutputMesh();
     
-    meshMapper->SetInput(outputMesh);  // Cut connection from normals.
+    meshMapper->SetInput(outputMesh);  // No connection to normals.
     meshActor->SetMapper(meshMapper);
+    lod->add(meshActor, outputMesh);
     meshRenderer->ResetCamera();
     meshWidget->GetRenderWindow()->Render();
     QApplication::restoreOverrideCursor();
@@ -1331,21 +1367,22 @@ void PDicomSegmenter::smoothing()
         return;
     }
     
-    decimate->SetInputConnection(mcubes->GetOutputPort());
-    decimate->SetTargetReduction(1.0 - ratioBox->value());
-    smooth->SetRelaxationFactor(factorBox->value());
-    smooth->SetNumberOfIterations(smoothIterBox->value());
-    // decimate to smooth is already connected.
-    normals->SetInputConnection(smooth->GetOutputPort());
+    decimator->setInput(mcubes->GetOutput());
+    decimator->setTargetRatio(ratioBox->value());
+    smoother->setRelaxationFactor(factorBox->value());
+    smoother->setNumberOfIterations(smoothIterBox->value());
+    // decimator to smoother is already connected.
+    normals->SetInput(smoother->getOutput());
     
     QApplication::setOverrideCursor(Qt::WaitCursor);
+    mcubes->Update();
+    decimator->update();  // Skipped if only the smoothing has changed.
+    smoother->update();   // Reuses its adjacency in that case.
     normals->Update();
-    if (outputMesh)
-        outputMesh->Delete();
-    outputMesh = vtkPolyData::New();
-    outputMesh->DeepCopy(normals->GetOutput());
+    takeOutputMesh();
     
-    meshMapper->SetInput(outputMesh);  // Cut connection from normals.
+    meshMapper->SetInput(outputMesh);  // No connection to normals.
+    lod->add(meshActor, outputMesh);
     meshWidget->GetRenderWindow()->Render();
     QApplication::restoreOverrideCursor();
 }
@@ -1384,55 +1421,42 @@ void PDicomSegmenter::saveView(int type)
 
 bool PDicomSegmenter::saveView(const QString &fileName, int type)
 {
-    vtkWindowToImageFilter *filter = vtkWindowToImageFilter::New();
+    vtkRenderWindow *window;
     switch (type)
     {            
         case 0:
-            filter->SetInput(transWidget->GetRenderWindow());
+            window = transWidget->GetRenderWindow();
             break;
             
         case 1:
-            filter->SetInput(coronalWidget->GetRenderWindow());
+            window = coronalWidget->GetRenderWindow();
             break;
             
         case 2:
-            filter->SetInput(sagittalWidget->GetRenderWindow());
+            window = sagittalWidget->GetRenderWindow();
             break;
             
         case 3:
-            filter->SetInput(volumeWidget->GetRenderWindow());
+            window = volumeWidget->GetRenderWindow();
             break;
             
         case 4:
-            filter->SetInput(meshWidget->GetRenderWindow());
+            window = meshWidget->GetRenderWindow();
             break;
             
         default:
             return false;
     }
 
-    QString suffix = QFileInfo(fileName).suffix();
-    vtkImageWriter *writer;
-
-    if (suffix == "jpg")
-        writer = vtkJPEGWriter::New();
-    else if (suffix == "png")
-        writer = vtkPNGWriter::New();
-    else if (suffix == "tif")
-        writer = vtkTIFFWriter::New();
-    else
+    if (!PImageSaver::isSupported(fileName))
     {
         QMessageBox::critical(this, appName,
-            QString("File type %1 is unsupported.").arg(suffix));
+            QString("File type %1 is unsupported.").
+            arg(QFileInfo(fileName).suffix()));
         return false;
     }
 
-    writer->SetInput(filter->GetOutput());
-    writer->SetFileName(fileName.toAscii().data());
-    writer->Write();
-    writer->Delete();
-    filter->Delete();
-    return true;
+    return imageSaver->save(window, fileName);
 }
 
 
@@ -1504,122 +1528,128 @@ void PDicomSegmenter::computeOutputVolume()
 }
 
 
+// Take the output of normals as outputMesh without copying it.  normals
+// gets a fresh empty output, so its next update leaves outputMesh alone.
+
+void PDicomSegmenter::takeOutputMesh()
+{
+    if (outputMesh)
+        outputMesh->Delete();
+    outputMesh = normals->GetOutput();
+    outputMesh->Register(NULL);
+
+    vtkPolyData *empty = vtkPolyData::New();
+    normals->GetExecutive()->SetOutputData(0, empty);
+    empty->Delete();
+}
+
+
+// Transfer functions for the view types, in viewTypeBox order.  They are
+// built once here; setBlendType() only switches between them.
+
+void PDicomSegmenter::createPresets()
+{
+    int i;
+
+    // CT Skin
+    // Use compositing and functions set to highlight skin in CT data.
+    i = presets.add("CT Skin", vtkVolumeMapper::COMPOSITE_BLEND);
+    presets.getOpacity(i)->AddPoint(-2000, 0.0, 0.5, 0.0);
+    presets.getOpacity(i)->AddPoint( -300, 0.0, 0.5, 0.5);
+    presets.getOpacity(i)->AddPoint( -100, 1.0, 0.5, 0.0);
+    presets.getOpacity(i)->AddPoint( 2000, 1.0, 0.5, 0.0);
+
+    presets.getColor(i)->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
+    presets.getColor(i)->AddRGBPoint( -300, 0.6, 0.4, 0.2, 0.5, 0.5);
+    presets.getColor(i)->AddRGBPoint( -100, 0.9, 0.8, 0.5, 0.5, 0.0);
+    presets.getColor(i)->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
+
+    // CT Muscle
+    // Use compositing and functions set to highlight muscle in CT data.
+    i = presets.add("CT Muscle", vtkVolumeMapper::COMPOSITE_BLEND);
+    presets.getOpacity(i)->AddPoint(-2000, 0.0, 0.5, 0.0);
+    presets.getOpacity(i)->AddPoint(  -70, 0.0, 0.5, 0.5);
+    presets.getOpacity(i)->AddPoint(  200, 1.0, 0.5, 0.0);
+    presets.getOpacity(i)->AddPoint( 2000, 1.0, 0.5, 0.0);
+
+    presets.getColor(i)->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
+    presets.getColor(i)->AddRGBPoint(  -70, 1.0, 0.6, 0.6, 0.5, 0.5);
+    presets.getColor(i)->AddRGBPoint(  200, 1.0, 1.0, 1.0, 0.5, 0.0);
+    presets.getColor(i)->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
+
+    // CT Bone
+    // Use compositing and functions set to highlight bone in CT data.
+    i = presets.add("CT Bone", vtkVolumeMapper::COMPOSITE_BLEND);
+    presets.getOpacity(i)->AddPoint(-2000, 0.0, 0.5, 0.0);
+    presets.getOpacity(i)->AddPoint(  -20, 0.0, 0.5, 0.5);
+    presets.getOpacity(i)->AddPoint(  600, 1.0, 0.5, 0.0);
+    presets.getOpacity(i)->AddPoint( 2000, 1.0, 0.5, 0.0);
+
+    presets.getColor(i)->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
+    presets.getColor(i)->AddRGBPoint(  -20, 1.0, 0.3, 0.3, 0.5, 0.5);
+    presets.getColor(i)->AddRGBPoint(  600, 1.0, 1.0, 1.0, 0.5, 0.0);
+    presets.getColor(i)->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
+
+    // CTA Vessels
+    // Use compositing and functions set to highlight vessels in CTA data.
+    i = presets.add("CTA Vessels", vtkVolumeMapper::COMPOSITE_BLEND);
+    presets.getOpacity(i)->AddPoint(-2000, 0.0, 0.5, 0.0);
+    presets.getOpacity(i)->AddPoint(  -20, 0.0, 0.5, 0.5);
+    presets.getOpacity(i)->AddPoint(   50, 0.0, 0.5, 0.5);
+    presets.getOpacity(i)->AddPoint(  100, 1.0, 0.5, 0.0);
+    presets.getOpacity(i)->AddPoint( 2000, 1.0, 0.5, 0.0);
+
+    presets.getColor(i)->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
+    presets.getColor(i)->AddRGBPoint(  -20, 0.3, 0.3, 0.3, 0.5, 0.5);
+    presets.getColor(i)->AddRGBPoint(   50, 0.3, 0.1, 0.1, 0.5, 0.5);
+    presets.getColor(i)->AddRGBPoint(  100, 1.0, 0.6, 0.6, 0.5, 0.0);
+    presets.getColor(i)->AddRGBPoint( 2000, 1.0, 0.6, 0.6, 0.5, 0.0);
+
+    // Maximum Intensity Projection
+    // Grey ramp over the contrast range of CTA; thick slabs show vessels.
+    i = presets.add("MIP", vtkVolumeMapper::MAXIMUM_INTENSITY_BLEND);
+    presets.getOpacity(i)->AddSegment(-200, 0.0, 600, 1.0);
+    presets.getColor(i)->AddRGBSegment(-200, 1.0, 1.0, 1.0,
+                                       600, 1.0, 1.0, 1.0);
+
+    // Minimum Intensity Projection
+    // Grey ramp over air and fat; shows airways and hypodense regions.
+    i = presets.add("MinIP", vtkVolumeMapper::MINIMUM_INTENSITY_BLEND);
+    presets.getOpacity(i)->AddSegment(-1000, 0.0, 100, 1.0);
+    presets.getColor(i)->AddRGBSegment(-1000, 1.0, 1.0, 1.0,
+                                       100, 1.0, 1.0, 1.0);
+}
+
+
 void PDicomSegmenter::setBlendType()
 {       
-    // Init
-    opacityFn->RemoveAllPoints();
-    colorFn->RemoveAllPoints();
-    
     int blendType = viewTypeBox->currentIndex();
+    if (blendType < 0 || blendType >= presets.count())
+        blendType = 0;  // CT Skin
     double ambient = ambientBox->value();
     double specular = specularBox->value();
     
-    // Add function points
-    switch (blendType)
+    // Switch to the cached transfer functions
+    presets.apply(blendType, property);
+
+    int mode = presets.getBlendMode(blendType);
+    rayCastMapper->SetBlendMode(mode);
+    cpuMapper->SetBlendMode(mode);
+#ifdef USE_SMART_MAPPER
+    smartMapper->SetBlendMode(mode);
+#endif
+
+    // Only the CPU ray caster projects a slab
+    cpuMapper->setSlabThickness(slabBox->value());
+
+    if (mode == vtkVolumeMapper::COMPOSITE_BLEND)
     {
-        // CT Skin
-        // Use compositing and functions set to highlight skin in CT data.
-        case 0:     
-            opacityFn->AddPoint(-2000, 0.0, 0.5, 0.0);
-            opacityFn->AddPoint( -300, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint( -100, 1.0, 0.5, 0.0);
-            opacityFn->AddPoint( 2000, 1.0, 0.5, 0.0);
-                  
-            colorFn->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
-            colorFn->AddRGBPoint( -300, 0.6, 0.4, 0.2, 0.5, 0.5);
-            colorFn->AddRGBPoint( -100, 0.9, 0.8, 0.5, 0.5, 0.0);
-            colorFn->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
-  
-            volumeMapper->SetBlendModeToComposite();
-            property->ShadeOn();
-            property->SetAmbient(ambient);
-            property->SetDiffuse(0.9);
-            property->SetSpecular(specular);
-            property->SetSpecularPower(10.0);
-            break;
-  
-        // CT Muscle
-        // Use compositing and functions set to highlight muscle in CT data.
-        case 1:     
-            opacityFn->AddPoint(-2000, 0.0, 0.5, 0.0);
-            opacityFn->AddPoint(  -70, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint(  200, 1.0, 0.5, 0.0);
-            opacityFn->AddPoint( 2000, 1.0, 0.5, 0.0);
-                  
-            colorFn->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
-            colorFn->AddRGBPoint(  -70, 1.0, 0.6, 0.6, 0.5, 0.5);
-            colorFn->AddRGBPoint(  200, 1.0, 1.0, 1.0, 0.5, 0.0);
-            colorFn->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
-
-            volumeMapper->SetBlendModeToComposite();
-            property->ShadeOn();
-            property->SetAmbient(ambient);
-            property->SetDiffuse(0.9);
-            property->SetSpecular(specular);
-            property->SetSpecularPower(10.0);
-            break;
-            
-        // CT Bone
-        // Use compositing and functions set to highlight bone in CT data.
-        case 2:
-            opacityFn->AddPoint(-2000, 0.0, 0.5, 0.0);
-            opacityFn->AddPoint(  -20, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint(  600, 1.0, 0.5, 0.0);
-            opacityFn->AddPoint( 2000, 1.0, 0.5, 0.0);
-
-            colorFn->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
-            colorFn->AddRGBPoint(  -20, 1.0, 0.3, 0.3, 0.5, 0.5);
-            colorFn->AddRGBPoint(  600, 1.0, 1.0, 1.0, 0.5, 0.0);
-            colorFn->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
-  
-            volumeMapper->SetBlendModeToComposite();
-            property->ShadeOn();
-            property->SetAmbient(ambient);
-            property->SetDiffuse(0.9);
-            property->SetSpecular(specular);
-            property->SetSpecularPower(10.0);
-            break;
-            
-        // CTA Vessels
-        // Use compositing and functions set to highlight bone in CT data.
-        case 3:
-            opacityFn->AddPoint(-2000, 0.0, 0.5, 0.0);
-            opacityFn->AddPoint(  -20, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint(   50, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint(  100, 1.0, 0.5, 0.0);
-            opacityFn->AddPoint( 2000, 1.0, 0.5, 0.0);
-
-            colorFn->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
-            colorFn->AddRGBPoint(  -20, 0.3, 0.3, 0.3, 0.5, 0.5);
-            colorFn->AddRGBPoint(   50, 0.3, 0.1, 0.1, 0.5, 0.5);
-            colorFn->AddRGBPoint(  100, 1.0, 0.6, 0.6, 0.5, 0.0);
-            colorFn->AddRGBPoint( 2000, 1.0, 0.6, 0.6, 0.5, 0.0);
-  
-            volumeMapper->SetBlendModeToComposite();
-            property->ShadeOn();
-            property->SetAmbient(ambient);
-            property->SetDiffuse(0.9);
-            property->SetSpecular(specular);
-            property->SetSpecularPower(10.0);
-            break;
-  
-        default: // Case 0
-            opacityFn->AddPoint(-2000, 0.0, 0.5, 0.0);
-            opacityFn->AddPoint( -300, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint( -100, 1.0, 0.5, 0.0);
-            opacityFn->AddPoint( 2000, 1.0, 0.5, 0.0);
-                  
-            colorFn->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
-            colorFn->AddRGBPoint( -300, 0.6, 0.4, 0.2, 0.5, 0.5);
-            colorFn->AddRGBPoint( -100, 0.9, 0.7, 0.3, 0.5, 0.0);
-            colorFn->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
-  
-            volumeMapper->SetBlendModeToComposite();
-            property->ShadeOn();
-            property->SetAmbient(ambient);
-            property->SetDiffuse(0.9);
-            property->SetSpecular(specular);
-            property->SetSpecularPower(10.0);
-            break;
+        property->ShadeOn();
+        property->SetAmbient(ambient);
+        property->SetDiffuse(0.9);
+        property->SetSpecular(specular);
+        property->SetSpecularPower(10.0);
     }
+    else
+        property->ShadeOff();
 }
@@ -16,12 +16,15 @@ class QHBoxLayout;
 #include "PVoiWidget.h"
 #include "PThresholdDialog.h"
 #include "PSkullRemover.h"
+#include "PMeshDecimator.h"
+#include "PMeshSmoother.h"
+#include "PLodManager.h"
+#include "PVolumePresets.h"
+#include "PRayCastMapper.h"
 #include "vtkImageAnisotropicDiffusion3D.h"
     
 #include "vtkExtractVOI.h"
 #include "vtkMarchingCubes.h"
-#include "vtkDecimatePro.h"
-#include "vtkSmoothPolyDataFilter.h"
 #include "vtkPolyDataNormals.h"
 #include "vtkPolyDataMapper.h"
 
@@ -84,6 +87,7 @@ protected slots:
     void showVolumeRenderDialog();
     void volumeRender();
     void setSampleDistance(int dist);
+    void refineView();
     
     // Mesh generation
     void showGenMeshDialog();
@@ -143,6 +147,7 @@ protected:
     QComboBox *sampleDistanceBox;
     QDoubleSpinBox *ambientBox;
     QDoubleSpinBox *specularBox;
+    QDoubleSpinBox *slabBox;
     QPushButton *closeVolumeButton;
     
     // Volume renderer: faster visualisation than mesh generation
@@ -150,8 +155,8 @@ protected:
     vtkVolumeMapper *volumeMapper;
     vtkSmartVolumeMapper *smartMapper;
     vtkFixedPointVolumeRayCastMapper *rayCastMapper;
-    vtkPiecewiseFunction *opacityFn;
-    vtkColorTransferFunction *colorFn;
+    PRayCastMapper *cpuMapper;
+    PVolumePresets presets;
     vtkVolumeProperty *property;
     vtkVolume *volumeActor;
     vtkRenderer* volumeRenderer;
@@ -160,10 +165,11 @@ protected:
 
     // Mesh objects
     vtkMarchingCubes *mcubes;
-    vtkDecimatePro *decimate;
-    vtkSmoothPolyDataFilter *smooth;
+    PMeshDecimator *decimator;
+    PMeshSmoother *smoother;
     vtkPolyDataNormals *normals;
     vtkPolyData *outputMesh;
+    PLodManager *lod;
     
     // Mesh generation dialog
     QWidget *genMeshDialog;
@@ -197,6 +203,7 @@ protected:
     void createAnisoDiffuser();
     void createVolumeRenderer();
     void createVolumeDialog();
+    void createPresets();
     void createMeshObjects();
     void createMeshViewer();
     void createMeshDialog();
@@ -207,6 +214,7 @@ protected:
     void wakeVoi();
     int *computeBound();
     void computeOutputVolume();
+    void takeOutputMesh();
     void setBlendType();
 };
 
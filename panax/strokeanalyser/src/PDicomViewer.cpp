@@ -14,10 +14,6 @@
 #include "vtkRenderWindow.h"
 #include "vtkRenderWindowInteractor.h"
 #include "vtkInteractorStyleTrackballCamera.h"
-#include "vtkWindowToImageFilter.h"
-#include "vtkJPEGWriter.h"
-#include "vtkPNGWriter.h"
-#include "vtkTIFFWriter.h"
 #include "vtkCamera.h"
 #include "vtkCommand.h"
 #include "vtkPlanes.h"
@@ -80,11 +76,17 @@ PDicomViewer::PDicomViewer()
     createMenus();
     createToolBars();
     createStatusBar();
+
+    // Screenshots are written in the background
+    imageSaver = new PImageSaver;
+    connect(imageSaver, SIGNAL(message(const QString &)),
+        statusBar(), SLOT(showMessage(const QString &)));
 }
 
 
 PDicomViewer::~PDicomViewer()
 {
+    delete imageSaver;
     uninstallPipeline();
     if (output)
         output->Delete();
@@ -869,47 +871,34 @@ void PDicomViewer::saveView(int type)
 
 bool PDicomViewer::saveView(const QString &fileName, int type)
 {
-    vtkWindowToImageFilter *filter = vtkWindowToImageFilter::New();
+    vtkRenderWindow *window;
     switch (type)
     {            
         case 0:
-            filter->SetInput(transWidget->GetRenderWindow());
+            window = transWidget->GetRenderWindow();
             break;
             
         case 1:
-            filter->SetInput(coronalWidget->GetRenderWindow());
+            window = coronalWidget->GetRenderWindow();
             break;
             
         case 2:
-            filter->SetInput(sagittalWidget->GetRenderWindow());
+            window = sagittalWidget->GetRenderWindow();
             break;
             
         default:
             return false;
     }
 
-    QString suffix = QFileInfo(fileName).suffix();
-    vtkImageWriter *writer;
-
-    if (suffix == "jpg")
-        writer = vtkJPEGWriter::New();
-    else if (suffix == "png")
-        writer = vtkPNGWriter::New();
-    else if (suffix == "tif")
-        writer = vtkTIFFWriter::New();
-    else
+    if (!PImageSaver::isSupported(fileName))
     {
         QMessageBox::critical(this, appName,
-            QString("File type %1 is unsupported.").arg(suffix));
+            QString("File type %1 is unsupported.").
+            arg(QFileInfo(fileName).suffix()));
         return false;
     }
 
-    writer->SetInput(filter->GetOutput());
-    writer->SetFileName(fileName.toAscii().data());
-    writer->Write();
-    writer->Delete();
-    filter->Delete();
-    return true;
+    return imageSaver->save(window, fileName);
 }
 
 
@@ -20,6 +20,7 @@ class QSlider;
 #include "vtkDICOMImageReader.h"
 #include "vtkImageViewer2.h"
 #include "vtkPropPicker.h"
+#include "PImageSaver.h"
 
 
 class PDicomViewer: public QMainWindow
@@ -118,6 +119,9 @@ protected:
     // Picker
     vtkPropPicker *picker;
     
+    // Background writer of saved views
+    PImageSaver *imageSaver;
+    
     // Internal variables.
     QString appName;
     QString fullDirName;
@@ -0,0 +1,215 @@
+/* PGradientCache.cpp
+
+   Quantized gradient directions and shading table for volume rendering.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PGradientCache.h"
+#include "PParallel.h"
+#include "vtkPointData.h"
+#include "vtkDataArray.h"
+
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+
+// Parallel kernels
+
+// Normal index of each voxel in a range of slices.  Differences are
+// central inside the volume and one-sided at its border.
+
+template <class T>
+struct PGradientKernel
+{
+    int dim[3];
+    double spacing[3];
+    const T *data;
+    unsigned short *normals;
+
+    void operator()(int begin, int end)
+    {
+        int stride[3] = { 1, dim[0], dim[0] * dim[1] };
+        double scale[3];
+        for (int i = 0; i < 3; ++i)
+            scale[i] = 1.0 / spacing[i];
+
+        for (int z = begin; z < end; ++z)
+            for (int y = 0; y < dim[1]; ++y)
+            {
+                int offset = z * stride[2] + y * stride[1];
+                const T *v = data + offset;
+                unsigned short *normal = normals + offset;
+                int p[3] = { 0, y, z };
+                for (int x = 0; x < dim[0]; ++x, ++v)
+                {
+                    p[0] = x;
+                    double g[3];
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        int lo = p[i] > 0 ? stride[i] : 0;
+                        int hi = p[i] < dim[i] - 1 ? stride[i] : 0;
+                        g[i] = ((double) v[hi] - (double) v[-lo]) * scale[i];
+                    }
+                    normal[x] = PGradientCache::encode(g[0], g[1], g[2]);
+                }
+            }
+    }
+
+    static void run(vtkImageData *image, const T *data,
+        unsigned short *normals)
+    {
+        PGradientKernel<T> kernel;
+        image->GetDimensions(kernel.dim);
+        image->GetSpacing(kernel.spacing);
+        kernel.data = data;
+        kernel.normals = normals;
+        parallelFor(kernel.dim[2], kernel, 1);
+    }
+};
+
+
+// PGradientCache class
+
+QMutex PGradientCache::sharedLock;
+QHash<PGradientCache::NormalKey, QWeakPointer<PGradientCache::NormalArray> >
+    PGradientCache::sharedNormals;
+
+
+PGradientCache::PGradientCache()
+{
+    for (int i = 0; i < 7; ++i)
+        shadingKey[i] = -1.0f;
+}
+
+
+// The input must be up to date and have single-component scalars.  A new
+// image never has the modification time of an old one, so the key stays
+// unique even when the image is allocated where a deleted one was.
+
+bool PGradientCache::update(vtkImageData *image)
+{
+    NormalKey key(image, image->GetMTime());
+
+    QMutexLocker locker(&sharedLock);
+    QSharedPointer<NormalArray> found = sharedNormals.value(key).
+        toStrongRef();
+    if (found && found == normals)
+        return false;
+
+    // Forget the images no cache holds any more
+    QMutableHashIterator<NormalKey, QWeakPointer<NormalArray> >
+        i(sharedNormals);
+    while (i.hasNext())
+        if (i.next().value().isNull())
+            i.remove();
+
+    if (!found)
+    {
+        found = computeNormals(image);
+        sharedNormals.insert(key, found);
+    }
+    normals = found;
+    return true;
+}
+
+
+const unsigned short *PGradientCache::getNormals()
+{
+    return normals && !normals->empty() ? &(*normals)[0] : NULL;
+}
+
+
+QSharedPointer<PGradientCache::NormalArray> PGradientCache::computeNormals(
+    vtkImageData *image)
+{
+    int dim[3];
+    image->GetDimensions(dim);
+    QSharedPointer<NormalArray> result(
+        new NormalArray((size_t) dim[0] * dim[1] * dim[2]));
+
+    vtkDataArray *scalars = image->GetPointData()->GetScalars();
+    void *data = scalars->GetVoidPointer(0);
+    switch (scalars->GetDataType())
+    {
+        vtkTemplateMacro(PGradientKernel<VTK_TT>::run(image,
+            (const VTK_TT *) data, &(*result)[0]));
+    }
+    return result;
+}
+
+
+// Lighting is two-sided, as the gradient points either way across a
+// boundary.
+
+void PGradientCache::updateShading(const double *light, const float *shade)
+{
+    float key[7] = { (float) light[0], (float) light[1], (float) light[2],
+        shade[0], shade[1], shade[2], shade[3] };
+    if (!shading.empty() && equal(key, key + 7, shadingKey))
+        return;
+    copy(key, key + 7, shadingKey);
+
+    shading.resize(2 * NumNormals);
+    shading[0] = shade[0];
+    shading[1] = 0.0f;
+    for (int i = 1; i < NumNormals; ++i)
+    {
+        double n[3];
+        decode(i, n);
+        double d = fabs(n[0] * light[0] + n[1] * light[1] + n[2] * light[2]);
+        shading[2*i] = shade[0] + shade[1] * d;
+        shading[2*i + 1] = shade[2] * pow(d, (double) shade[3]);
+    }
+}
+
+
+const float *PGradientCache::getShading()
+{
+    return &shading[0];
+}
+
+
+// Octahedral encoding: the direction is projected onto the octahedron
+// |x| + |y| + |z| = 1, whose lower half is folded over the upper, and the
+// (x, y) square is quantized.
+
+int PGradientCache::encode(double x, double y, double z)
+{
+    double sum = fabs(x) + fabs(y) + fabs(z);
+    if (sum == 0.0)
+        return 0;
+
+    double u = x / sum, v = y / sum;
+    if (z < 0.0)
+    {
+        double fu = (1.0 - fabs(v)) * (u < 0.0 ? -1.0 : 1.0);
+        v = (1.0 - fabs(u)) * (v < 0.0 ? -1.0 : 1.0);
+        u = fu;
+    }
+    int i = min(max((int) ((u + 1.0) * 0.5 * NormalRes), 0), NormalRes - 1);
+    int j = min(max((int) ((v + 1.0) * 0.5 * NormalRes), 0), NormalRes - 1);
+    return 1 + j * NormalRes + i;
+}
+
+
+// Unit direction at the centre of the cell of a normal index other than 0.
+
+void PGradientCache::decode(int normal, double *n)
+{
+    normal -= 1;
+    double u = ((normal % NormalRes) + 0.5) * 2.0 / NormalRes - 1.0;
+    double v = ((normal / NormalRes) + 0.5) * 2.0 / NormalRes - 1.0;
+    double z = 1.0 - fabs(u) - fabs(v);
+    if (z < 0.0)
+    {
+        double fu = (1.0 - fabs(v)) * (u < 0.0 ? -1.0 : 1.0);
+        v = (1.0 - fabs(u)) * (v < 0.0 ? -1.0 : 1.0);
+        u = fu;
+    }
+    double length = sqrt(u * u + v * v + z * z);
+    n[0] = u / length;
+    n[1] = v / length;
+    n[2] = z / length;
+}
@@ -0,0 +1,64 @@
+/* PGradientCache.h
+
+   Quantized gradient directions and shading table for volume rendering.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PGRADIENTCACHE_H
+#define PGRADIENTCACHE_H
+
+#include <QHash>
+#include <QPair>
+#include <QMutex>
+#include <QSharedPointer>
+#include "vtkImageData.h"
+#include <vector>
+
+
+// The gradient of each voxel, from central differences and scaled by the
+// spacing, is stored as a normal index of two bytes: 0 for no gradient,
+// else an octahedral encoding of its direction on a NormalRes by NormalRes
+// grid.  The normals are computed once per input and modification time and
+// shared: every cache given the same image at the same time holds the same
+// array, kept in a table common to all caches for as long as one of them
+// holds it.  So the volume renderer and the segmenter compute the normals
+// of a volume they both show only once.  Shading a sample is then a lookup
+// into a table of each cache with one entry per normal, rebuilt for each
+// frame's light and lighting coefficients in time independent of the
+// volume size.
+
+class PGradientCache
+{
+public:
+    PGradientCache();
+
+    enum { NormalRes = 128, NumNormals = NormalRes * NormalRes + 1 };
+
+    bool update(vtkImageData *input);  // True if the normals changed
+    const unsigned short *getNormals();
+
+    // Headlight direction in data space; shade holds the ambient, diffuse
+    // and specular coefficients and the specular power.
+    void updateShading(const double *light, const float *shade);
+    const float *getShading();  // Colour scale and specular per normal
+
+    static int encode(double x, double y, double z);
+    static void decode(int normal, double *n);
+
+protected:
+    typedef std::vector<unsigned short> NormalArray;
+    typedef QPair<vtkImageData *, unsigned long> NormalKey;
+
+    QSharedPointer<NormalArray> normals;
+    std::vector<float> shading;
+    float shadingKey[7];
+
+    // Normals of every image held by some cache
+    static QMutex sharedLock;
+    static QHash<NormalKey, QWeakPointer<NormalArray> > sharedNormals;
+
+    static QSharedPointer<NormalArray> computeNormals(vtkImageData *input);
+};
+
+#endif
@@ -0,0 +1,163 @@
+/* PHighlighter.cpp
+
+   Timed highlighting of mesh actors.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PHighlighter.h"
+#include "vtkProperty.h"
+
+#include <cmath>
+using namespace std;
+
+#define DefaultDuration 1000  // msec
+#define DefaultPulses 2
+#define StepTime 40           // msec, 25 steps a second
+#define TwoPi 6.28318530717959
+
+
+// PHighlighter class
+
+PHighlighter::PHighlighter(QObject *parent): QObject(parent)
+{
+    window = NULL;
+    color[0] = color[1] = color[2] = 0.5;
+    duration = DefaultDuration;
+    pulses = DefaultPulses;
+    timer = new QTimer(this);
+    timer->setInterval(StepTime);
+    connect(timer, SIGNAL(timeout()), this, SLOT(step()));
+}
+
+
+PHighlighter::~PHighlighter()
+{
+    clear();
+}
+
+
+void PHighlighter::setRenderWindow(vtkRenderWindow *w)
+{
+    window = w;
+}
+
+
+void PHighlighter::setColor(double red, double green, double blue)
+{
+    color[0] = red;
+    color[1] = green;
+    color[2] = blue;
+}
+
+
+void PHighlighter::setDuration(int msec)
+{
+    duration = msec;
+}
+
+
+void PHighlighter::setPulses(int count)
+{
+    pulses = count;
+}
+
+
+// The actor is held until its highlight ends, so it stays valid if the
+// viewer releases it first.
+
+void PHighlighter::start(vtkActor *actor)
+{
+    if (!actor)
+        return;
+    int i = find(actor);
+    if (i >= 0)
+    {
+        highlights[i].clock.start();
+        return;
+    }
+
+    PHighlight highlight;
+    highlight.actor = actor;
+    actor->Register(NULL);
+    actor->GetProperty()->GetColor(highlight.color);
+    highlight.clock.start();
+    highlights.append(highlight);
+    if (!timer->isActive())
+        timer->start();
+}
+
+
+void PHighlighter::stop(vtkActor *actor)
+{
+    int i = find(actor);
+    if (i < 0)
+        return;
+
+    setActorColor(actor, highlights[i].color);
+    actor->UnRegister(NULL);
+    highlights.removeAt(i);
+    if (highlights.isEmpty())
+        timer->stop();
+}
+
+
+void PHighlighter::clear()
+{
+    while (!highlights.isEmpty())
+        stop(highlights.last().actor);
+}
+
+
+bool PHighlighter::isActive()
+{
+    return !highlights.isEmpty();
+}
+
+
+// Slot methods
+
+// Each pulse blends from the actor's colour to the highlight colour and
+// back along a raised cosine, so it starts and ends on the actor's own.
+
+void PHighlighter::step()
+{
+    for (int i = highlights.size() - 1; i >= 0; --i)
+    {
+        PHighlight &highlight = highlights[i];
+        int elapsed = highlight.clock.elapsed();
+        if (elapsed >= duration)
+        {
+            stop(highlight.actor);
+            continue;
+        }
+
+        double w = 0.5 - 0.5 * cos(TwoPi * pulses * elapsed /
+            duration);
+        double rgb[3];
+        for (int k = 0; k < 3; ++k)
+            rgb[k] = (1.0 - w) * highlight.color[k] + w * color[k];
+        setActorColor(highlight.actor, rgb);
+    }
+
+    if (window)
+        window->Render();
+}
+
+
+// Protected methods
+
+void PHighlighter::setActorColor(vtkActor *actor, const double *rgb)
+{
+    actor->GetProperty()->SetColor(rgb[0], rgb[1], rgb[2]);
+    emit colorChanged(actor, rgb[0], rgb[1], rgb[2]);
+}
+
+
+int PHighlighter::find(vtkActor *actor)
+{
+    for (int i = 0; i < highlights.size(); ++i)
+        if (highlights[i].actor == actor)
+            return i;
+    return -1;
+}
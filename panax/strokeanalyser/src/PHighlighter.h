@@ -0,0 +1,72 @@
+/* PHighlighter.h
+
+   Timed highlighting of mesh actors.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PHIGHLIGHTER_H
+#define PHIGHLIGHTER_H
+
+#include <QObject>
+#include <QList>
+#include <QTime>
+#include <QTimer>
+#include "vtkActor.h"
+#include "vtkRenderWindow.h"
+
+
+// A highlighted actor pulses between its colour and the highlight colour
+// for the duration of the highlight, driven by a timer in the event loop,
+// so the viewer stays responsive and any number of actors may pulse at
+// once.  Each step blends the colours of all highlighted actors and
+// renders the window once.  The actor's own colour is put back when its
+// highlight ends or is stopped.
+
+class PHighlight
+{
+    friend class PHighlighter;
+    vtkActor *actor;
+    double color[3];  // Of the actor, to restore
+    QTime clock;      // Since the highlight started
+};
+
+
+class PHighlighter: public QObject
+{
+    Q_OBJECT
+
+public:
+    PHighlighter(QObject *parent = 0);
+    ~PHighlighter();
+
+    void setRenderWindow(vtkRenderWindow *window);
+    void setColor(double red, double green, double blue);
+    void setDuration(int msec);
+    void setPulses(int count);  // Within the duration
+
+    void start(vtkActor *actor);  // Restarts a running highlight
+    void stop(vtkActor *actor);   // Without rendering
+    void clear();
+    bool isActive();
+
+signals:
+    // Emitted at each step, and when an actor's colour is put back.
+    void colorChanged(vtkActor *actor, double red, double green,
+        double blue);
+
+protected slots:
+    void step();
+
+protected:
+    vtkRenderWindow *window;
+    double color[3];
+    int duration, pulses;
+    QTimer *timer;
+    QList<PHighlight> highlights;
+
+    void setActorColor(vtkActor *actor, const double *rgb);
+    int find(vtkActor *actor);
+};
+
+#endif
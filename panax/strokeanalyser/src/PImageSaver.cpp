@@ -0,0 +1,89 @@
+/* PImageSaver.cpp
+
+   Screenshots encoded and written in the background.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PImageSaver.h"
+#include <QFileInfo>
+#include "vtkWindowToImageFilter.h"
+#include "vtkImageData.h"
+
+#include <cstring>
+using namespace std;
+
+#define MaxWriters 2  // Encoding threads; each holds one image
+
+
+PImageSaver::PImageSaver()
+{
+    pool.setMaxThreadCount(MaxWriters);
+}
+
+
+PImageSaver::~PImageSaver()
+{
+    pool.waitForDone();
+}
+
+
+bool PImageSaver::isSupported(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix();
+    return suffix == "jpg" || suffix == "png" || suffix == "tif";
+}
+
+
+// VTK rows run bottom up and QImage rows top down, so the copy flips
+// them.  An offscreen window has only the back buffer.
+
+bool PImageSaver::save(vtkRenderWindow *window, const QString &fileName)
+{
+    if (!isSupported(fileName))
+        return false;
+
+    vtkWindowToImageFilter *filter = vtkWindowToImageFilter::New();
+    filter->SetInput(window);
+    if (window->GetOffScreenRendering())
+        filter->ReadFrontBufferOff();
+    filter->Update();
+
+    vtkImageData *data = filter->GetOutput();
+    int *size = data->GetDimensions();
+    QImage image(size[0], size[1], QImage::Format_RGB888);
+    const unsigned char *pixels =
+        (const unsigned char *) data->GetScalarPointer();
+    int rowSize = 3 * size[0];
+    for (int y = 0; y < size[1]; ++y)
+        memcpy(image.scanLine(size[1] - 1 - y), pixels + y * rowSize,
+            rowSize);
+    filter->Delete();
+
+    pool.start(new PImageTask(this, image, fileName));
+    return true;
+}
+
+
+bool PImageSaver::waitForDone()
+{
+    pool.waitForDone();
+    return failures.fetchAndStoreOrdered(0) == 0;
+}
+
+
+// Runs in the pool.
+
+void PImageSaver::write(const QImage &image, const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix();
+    const char *format = suffix == "jpg" ? "JPG" :
+        (suffix == "png" ? "PNG" : "TIFF");
+    if (image.save(fileName, format))
+        emit message(QString("Saved %1").arg(fileName));
+    else
+    {
+        failures.ref();
+        emit message(QString("Cannot save %1").arg(fileName));
+    }
+}
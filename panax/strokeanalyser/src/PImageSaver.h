@@ -0,0 +1,67 @@
+/* PImageSaver.h
+
+   Screenshots encoded and written in the background.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PIMAGESAVER_H
+#define PIMAGESAVER_H
+
+#include <QObject>
+#include <QString>
+#include <QImage>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include "vtkRenderWindow.h"
+
+
+// save() reads the pixels of a render window into a QImage on the
+// calling thread, which must own the window's OpenGL context, and
+// returns.  Encoding and writing the file run on a small pool of the
+// saver's own, so saves in quick succession overlap with each other and
+// with rendering.  The outcome of each save is reported by message(),
+// which may be connected to a status bar.  The destructor waits for the
+// writes still queued.
+
+class PImageSaver: public QObject
+{
+    Q_OBJECT
+
+public:
+    PImageSaver();
+    ~PImageSaver();
+
+    static bool isSupported(const QString &fileName);  // jpg, png or tif
+    bool save(vtkRenderWindow *window, const QString &fileName);
+    bool waitForDone();  // False if a write failed since the last wait
+
+signals:
+    void message(const QString &text);
+
+protected:
+    friend class PImageTask;
+
+    QThreadPool pool;
+    QAtomicInt failures;
+
+    void write(const QImage &image, const QString &fileName);
+};
+
+
+class PImageTask: public QRunnable
+{
+public:
+    PImageTask(PImageSaver *s, const QImage &i, const QString &f)
+    { saver = s;    image = i;    fileName = f; }
+
+    void run() { saver->write(image, fileName); }
+
+protected:
+    PImageSaver *saver;
+    QImage image;
+    QString fileName;
+};
+
+#endif
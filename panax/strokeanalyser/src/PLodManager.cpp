@@ -0,0 +1,262 @@
+/* PLodManager.cpp
+
+   Level of detail for mesh actors during camera interaction.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PLodManager.h"
+#include "PMeshDecimator.h"
+#include <QtConcurrentRun>
+#include "vtkCommand.h"
+#include "vtkCellArray.h"
+#include "vtkPolyDataNormals.h"
+
+using namespace std;
+
+
+// Callback class
+
+class PLodManagerCallback: public vtkCommand
+{
+public:
+    static PLodManagerCallback *New() { return new PLodManagerCallback; }
+    void Execute(vtkObject *caller, unsigned long eventId, void *callData);
+    PLodManager *manager;
+};
+
+
+void PLodManagerCallback::Execute(vtkObject *caller, unsigned long eventId,
+    void *callData)
+{
+    if (eventId == vtkCommand::StartInteractionEvent)
+        manager->startInteraction();
+    else
+        manager->endInteraction();
+}
+
+
+// Runs in the global thread pool.  The source mesh is only read.
+
+static vtkPolyData *buildProxy(vtkPolyData *data, double ratio)
+{
+    PMeshDecimator decimator;
+    decimator.setInput(data);
+    decimator.setTargetRatio(ratio);
+    decimator.update();
+
+    vtkPolyDataNormals *normals = vtkPolyDataNormals::New();
+    normals->SetInput(decimator.getOutput());
+    normals->Update();
+
+    vtkPolyData *proxy = vtkPolyData::New();
+    proxy->ShallowCopy(normals->GetOutput());  // Free of the pipeline.
+    normals->Delete();
+    return proxy;
+}
+
+
+// PLodManager class
+
+#define DefaultRatio 0.1
+#define DefaultMinTriangles 200000
+
+
+PLodManager::PLodManager(QObject *parent): QObject(parent)
+{
+    style = NULL;
+    startTag = endTag = 0;
+    ratio = DefaultRatio;
+    minTriangles = DefaultMinTriangles;
+    interacting = false;
+}
+
+
+PLodManager::~PLodManager()
+{
+    setInteractorStyle(NULL);
+    clear();
+
+    // Wait for proxies still being built.
+    QMap<QObject *, vtkPolyData *>::iterator it;
+    for (it = jobs.begin(); it != jobs.end(); ++it)
+    {
+        QFutureWatcher<vtkPolyData *> *watcher =
+            static_cast<QFutureWatcher<vtkPolyData *> *>(it.key());
+        watcher->waitForFinished();
+        watcher->result()->Delete();
+        it.value()->UnRegister(NULL);
+    }
+}
+
+
+void PLodManager::setInteractorStyle(vtkInteractorObserver *s)
+{
+    if (style)
+    {
+        style->RemoveObserver(startTag);
+        style->RemoveObserver(endTag);
+    }
+
+    style = s;
+    if (!style)
+        return;
+
+    PLodManagerCallback *callback = PLodManagerCallback::New();
+    callback->manager = this;
+    startTag = style->AddObserver(vtkCommand::StartInteractionEvent,
+        callback);
+    endTag = style->AddObserver(vtkCommand::EndInteractionEvent, callback);
+    callback->Delete();
+}
+
+
+void PLodManager::setRatio(double r)
+{
+    ratio = r;
+}
+
+
+void PLodManager::setMinTriangles(int count)
+{
+    minTriangles = count;
+}
+
+
+// Start building a proxy of data for actor, replacing any earlier one.
+
+void PLodManager::add(vtkActor *actor, vtkPolyData *data)
+{
+    remove(actor);
+
+    if (!data || data->GetPolys()->GetNumberOfCells() < minTriangles)
+        return;
+
+    data->GetBounds();  // Cache the bounds before the worker reads them.
+    data->Register(NULL);
+
+    PLodEntry entry;
+    entry.actor = actor;
+    entry.fullMapper = NULL;
+    entry.proxyMapper = NULL;
+    entry.proxy = NULL;
+    entry.watcher = new QFutureWatcher<vtkPolyData *>(this);
+    connect(entry.watcher, SIGNAL(finished()), this, SLOT(proxyReady()));
+    jobs.insert(entry.watcher, data);
+    entry.watcher->setFuture(QtConcurrent::run(buildProxy, data, ratio));
+    entries.append(entry);
+}
+
+
+void PLodManager::remove(vtkActor *actor)
+{
+    int i = find(actor);
+    if (i < 0)
+        return;
+
+    release(entries[i]);
+    entries.removeAt(i);
+}
+
+
+void PLodManager::clear()
+{
+    for (int i = 0; i < entries.size(); ++i)
+        release(entries[i]);
+    entries.clear();
+}
+
+
+// Slot methods
+
+void PLodManager::proxyReady()
+{
+    QFutureWatcher<vtkPolyData *> *watcher =
+        static_cast<QFutureWatcher<vtkPolyData *> *>(sender());
+    vtkPolyData *proxy = watcher->result();
+    jobs.take(watcher)->UnRegister(NULL);
+    watcher->deleteLater();
+
+    for (int i = 0; i < entries.size(); ++i)
+        if (entries[i].watcher == watcher)
+        {
+            PLodEntry &entry = entries[i];
+            entry.watcher = NULL;
+            entry.proxy = proxy;
+            entry.proxyMapper = vtkPolyDataMapper::New();
+            entry.proxyMapper->SetInput(proxy);
+            return;
+        }
+
+    proxy->Delete();  // Its actor has been removed or re-added.
+}
+
+
+// Supporting methods
+
+void PLodManager::startInteraction()
+{
+    interacting = true;
+    for (int i = 0; i < entries.size(); ++i)
+        useProxy(entries[i]);
+}
+
+
+void PLodManager::endInteraction()
+{
+    interacting = false;
+    for (int i = 0; i < entries.size(); ++i)
+        useFull(entries[i]);
+}
+
+
+void PLodManager::useProxy(PLodEntry &entry)
+{
+    if (!entry.proxyMapper || entry.fullMapper)
+        return;
+
+    entry.fullMapper = entry.actor->GetMapper();
+    if (!entry.fullMapper || entry.fullMapper == entry.proxyMapper)
+    {
+        entry.fullMapper = NULL;
+        return;
+    }
+
+    // Keep the scalar and lookup table settings of the full mapper.
+    entry.fullMapper->Register(NULL);
+    entry.proxyMapper->ShallowCopy(entry.fullMapper);
+    entry.proxyMapper->SetInput(entry.proxy);
+    entry.actor->SetMapper(entry.proxyMapper);
+}
+
+
+void PLodManager::useFull(PLodEntry &entry)
+{
+    if (!entry.fullMapper)
+        return;
+
+    entry.actor->SetMapper(entry.fullMapper);
+    entry.fullMapper->UnRegister(NULL);
+    entry.fullMapper = NULL;
+}
+
+
+// A proxy still being built is deleted by proxyReady().
+
+void PLodManager::release(PLodEntry &entry)
+{
+    useFull(entry);
+    if (entry.proxyMapper)
+        entry.proxyMapper->Delete();
+    if (entry.proxy)
+        entry.proxy->Delete();
+}
+
+
+int PLodManager::find(vtkActor *actor)
+{
+    for (int i = 0; i < entries.size(); ++i)
+        if (entries[i].actor == actor)
+            return i;
+    return -1;
+}
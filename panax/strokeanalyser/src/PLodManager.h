@@ -0,0 +1,75 @@
+/* PLodManager.h
+
+   Level of detail for mesh actors during camera interaction.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PLODMANAGER_H
+#define PLODMANAGER_H
+
+#include <QObject>
+#include <QList>
+#include <QMap>
+#include <QFutureWatcher>
+#include "vtkActor.h"
+#include "vtkPolyData.h"
+#include "vtkPolyDataMapper.h"
+#include "vtkInteractorObserver.h"
+
+
+// Large meshes get a decimated proxy, built in the background.  While the
+// observed interactor style is interacting, each actor whose proxy is
+// ready draws the proxy instead; the full mesh is put back when the
+// interaction ends, before the style renders the still frame.
+
+class PLodEntry
+{
+    friend class PLodManager;
+    vtkActor *actor;
+    vtkMapper *fullMapper;          // Mapper to restore after interaction
+    vtkPolyDataMapper *proxyMapper;
+    vtkPolyData *proxy;
+    QFutureWatcher<vtkPolyData *> *watcher;  // Proxy being built
+};
+
+
+class PLodManager: public QObject
+{
+    Q_OBJECT
+
+    friend class PLodManagerCallback;
+
+public:
+    PLodManager(QObject *parent = 0);
+    ~PLodManager();
+
+    void setInteractorStyle(vtkInteractorObserver *style);
+    void setRatio(double ratio);       // Fraction of triangles in proxies
+    void setMinTriangles(int count);   // Smaller meshes get no proxy
+
+    void add(vtkActor *actor, vtkPolyData *data);
+    void remove(vtkActor *actor);
+    void clear();
+
+protected slots:
+    void proxyReady();
+
+protected:
+    vtkInteractorObserver *style;
+    unsigned long startTag, endTag;
+    double ratio;
+    int minTriangles;
+    bool interacting;
+    QList<PLodEntry> entries;
+    QMap<QObject *, vtkPolyData *> jobs;  // Watcher to source mesh
+
+    void startInteraction();
+    void endInteraction();
+    void useProxy(PLodEntry &entry);
+    void useFull(PLodEntry &entry);
+    void release(PLodEntry &entry);
+    int find(vtkActor *actor);
+};
+
+#endif
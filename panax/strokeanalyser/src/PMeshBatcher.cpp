@@ -0,0 +1,281 @@
+/* PMeshBatcher.cpp
+
+   Merged rendering of many mesh parts in a few batches.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PMeshBatcher.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkFloatArray.h"
+#include "vtkPointData.h"
+#include "vtkProperty.h"
+
+#include <cstring>
+using namespace std;
+
+#define BatchPoints (1 << 20)
+
+
+// PMeshBatcher class
+
+PMeshBatcher::PMeshBatcher()
+{
+    renderer = NULL;
+    property = vtkProperty::New();
+    maxPoints = BatchPoints;
+}
+
+
+PMeshBatcher::~PMeshBatcher()
+{
+    clear();
+    property->Delete();
+}
+
+
+void PMeshBatcher::setMaxPoints(int count)
+{
+    maxPoints = count;
+}
+
+
+// Consecutive parts are merged while their points fit in maxPoints; a
+// larger part has a batch of its own.
+
+void PMeshBatcher::build(vtkRenderer *ren, const QList<vtkActor *> &parts)
+{
+    clear();
+    renderer = ren;
+    partBatch.resize(parts.size());
+    shown.resize(parts.size());
+
+    int first = 0;
+    vtkIdType numPoints = 0;
+    for (int i = 0; i < parts.size(); ++i)
+    {
+        vtkIdType n = vtkPolyData::SafeDownCast(
+            parts[i]->GetMapper()->GetInput())->GetNumberOfPoints();
+        if (i > first && numPoints + n > maxPoints)
+        {
+            addBatch(parts, first, i - first);
+            first = i;
+            numPoints = 0;
+        }
+        numPoints += n;
+    }
+    if (first < parts.size())
+        addBatch(parts, first, parts.size() - first);
+    update();
+}
+
+
+void PMeshBatcher::clear()
+{
+    for (int b = 0; b < batches.size(); ++b)
+    {
+        PMeshBatch &batch = batches[b];
+        if (renderer)
+            renderer->RemoveActor(batch.actor);
+        batch.actor->Delete();
+        batch.mapper->Delete();
+        batch.colors->Delete();
+        batch.data->Delete();
+    }
+    batches.clear();
+    partBatch.clear();
+    shown.clear();
+    renderer = NULL;
+}
+
+
+bool PMeshBatcher::isEmpty()
+{
+    return batches.isEmpty();
+}
+
+
+void PMeshBatcher::setColor(int part, double red, double green,
+    double blue)
+{
+    if (part < 0 || part >= partBatch.size())
+        return;
+    PMeshBatch &batch = batches[partBatch[part]];
+    batch.colors->SetTableValue(part - batch.firstPart, red, green, blue,
+        1.0);
+    batch.colors->Modified();
+}
+
+
+void PMeshBatcher::setVisibility(int part, bool visible)
+{
+    if (part < 0 || part >= partBatch.size() ||
+        shown[part] == visible)
+        return;
+    shown[part] = visible;
+    batches[partBatch[part]].dirty = true;
+}
+
+
+void PMeshBatcher::update()
+{
+    for (int b = 0; b < batches.size(); ++b)
+        if (batches[b].dirty)
+            gather(batches[b]);
+}
+
+
+vtkProperty *PMeshBatcher::getProperty()
+{
+    return property;
+}
+
+
+// Protected methods
+
+void PMeshBatcher::addBatch(const QList<vtkActor *> &parts, int first,
+    int count)
+{
+    PMeshBatch batch;
+    batch.firstPart = first;
+    batch.numParts = count;
+    batch.idStart.resize(count + 1);
+    batch.cellStart.resize(count + 1);
+    batch.colors = vtkLookupTable::New();
+    batch.colors->SetNumberOfTableValues(count);
+    batch.colors->SetTableRange(-0.5, count - 0.5);
+
+    vtkIdType numPoints = 0, numIds = 0, numCells = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        vtkPolyData *mesh = vtkPolyData::SafeDownCast(
+            parts[first + i]->GetMapper()->GetInput());
+        numPoints += mesh->GetNumberOfPoints();
+        numIds += mesh->GetPolys()->GetData()->GetNumberOfTuples();
+    }
+
+    vtkPoints *points = vtkPoints::New();
+    points->SetDataTypeToFloat();
+    points->SetNumberOfPoints(numPoints);
+    vtkFloatArray *normals = vtkFloatArray::New();
+    normals->SetName("Normals");
+    normals->SetNumberOfComponents(3);
+    normals->SetNumberOfTuples(numPoints);
+    vtkFloatArray *index = vtkFloatArray::New();
+    index->SetName("Part");
+    index->SetNumberOfTuples(numPoints);
+    batch.ids.resize(numIds);
+
+    float *x = static_cast<vtkFloatArray *>(points->GetData())->
+        GetPointer(0);
+    float *n = normals->GetPointer(0);
+    float *s = index->GetPointer(0);
+    vtkIdType *id = batch.ids.data();
+    vtkIdType offset = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        vtkActor *actor = parts[first + i];
+        vtkPolyData *mesh = vtkPolyData::SafeDownCast(
+            actor->GetMapper()->GetInput());
+        vtkIdType m = mesh->GetNumberOfPoints();
+        vtkPoints *partPoints = mesh->GetPoints();
+        vtkDataArray *partNormals = mesh->GetPointData()->GetNormals();
+        for (vtkIdType j = 0; j < m; ++j)
+        {
+            double p[3];
+            partPoints->GetPoint(j, p);
+            x[3 * j] = p[0];
+            x[3 * j + 1] = p[1];
+            x[3 * j + 2] = p[2];
+            if (partNormals)
+                partNormals->GetTuple(j, p);
+            else
+                p[0] = p[1] = p[2] = 0.0;
+            n[3 * j] = p[0];
+            n[3 * j + 1] = p[1];
+            n[3 * j + 2] = p[2];
+            s[j] = i;
+        }
+        x += 3 * m;
+        n += 3 * m;
+        s += m;
+
+        // Cells, with ids moved past the points of earlier parts
+        vtkCellArray *polys = mesh->GetPolys();
+        const vtkIdType *c = polys->GetPointer();
+        const vtkIdType *end = c + polys->GetData()->GetNumberOfTuples();
+        batch.idStart[i] = id - batch.ids.data();
+        batch.cellStart[i] = numCells;
+        while (c < end)
+        {
+            vtkIdType k = *c++;
+            *id++ = k;
+            for (; k > 0; --k)
+                *id++ = *c++ + offset;
+            ++numCells;
+        }
+        offset += m;
+
+        double rgb[3];
+        actor->GetProperty()->GetColor(rgb);
+        batch.colors->SetTableValue(i, rgb[0], rgb[1], rgb[2], 1.0);
+        shown[first + i] = actor->GetVisibility();
+        partBatch[first + i] = batches.size();
+    }
+    batch.idStart[count] = numIds;
+    batch.cellStart[count] = numCells;
+
+    batch.data = vtkPolyData::New();
+    batch.data->SetPoints(points);
+    batch.data->GetPointData()->SetNormals(normals);
+    batch.data->GetPointData()->SetScalars(index);
+    points->Delete();
+    normals->Delete();
+    index->Delete();
+
+    batch.mapper = vtkPolyDataMapper::New();
+    batch.mapper->SetInput(batch.data);
+    batch.mapper->SetLookupTable(batch.colors);
+    batch.mapper->SetScalarModeToUsePointData();
+    batch.mapper->SetColorModeToMapScalars();
+    batch.mapper->SetScalarRange(-0.5, count - 0.5);
+    batch.mapper->ScalarVisibilityOn();
+    batch.actor = vtkActor::New();
+    batch.actor->SetMapper(batch.mapper);
+    batch.actor->SetProperty(property);
+    renderer->AddActor(batch.actor);
+
+    batch.dirty = true;
+    batches.append(batch);
+}
+
+
+// The cells of each visible part are one run of ids, copied as a block.
+
+void PMeshBatcher::gather(PMeshBatch &batch)
+{
+    vtkIdType numIds = 0, numCells = 0;
+    for (int i = 0; i < batch.numParts; ++i)
+        if (shown[batch.firstPart + i])
+        {
+            numIds += batch.idStart[i + 1] - batch.idStart[i];
+            numCells += batch.cellStart[i + 1] - batch.cellStart[i];
+        }
+
+    vtkCellArray *polys = vtkCellArray::New();
+    vtkIdType *id = polys->WritePointer(numCells, numIds);
+    for (int i = 0; i < batch.numParts; ++i)
+        if (shown[batch.firstPart + i])
+        {
+            vtkIdType size = batch.idStart[i + 1] - batch.idStart[i];
+            memcpy(id, batch.ids.data() + batch.idStart[i],
+                size * sizeof(vtkIdType));
+            id += size;
+        }
+    batch.data->SetPolys(polys);
+    polys->Delete();
+
+    batch.actor->SetVisibility(numCells > 0);
+    batch.dirty = false;
+}
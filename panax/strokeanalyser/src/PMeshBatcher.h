@@ -0,0 +1,79 @@
+/* PMeshBatcher.h
+
+   Merged rendering of many mesh parts in a few batches.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PMESHBATCHER_H
+#define PMESHBATCHER_H
+
+#include <QList>
+#include <QVector>
+#include "vtkActor.h"
+#include "vtkPolyData.h"
+#include "vtkPolyDataMapper.h"
+#include "vtkLookupTable.h"
+#include "vtkRenderer.h"
+
+
+// Parts are merged in order into batches of up to maxPoints points, so a
+// scene of many small parts is drawn by a few actors.  Each point of a
+// batch carries the index of its part in the batch as a scalar, which
+// the mapper colours through a lookup table of one entry per part, so a
+// part's colour is changed by changing its table entry.
+//
+// The points, normals and part indices of a batch are built once.  Its
+// cells are kept apart, by part, and the cells of the visible parts are
+// copied in bulk into the batch's polygons by update(), so hiding a part
+// does not rebuild the geometry.  VTK 5 cannot discard cells by an
+// attribute without drawing the whole batch as translucent.
+//
+// All batches share one property, for the representation and culling.
+
+class PMeshBatch
+{
+    friend class PMeshBatcher;
+    vtkPolyData *data;
+    vtkPolyDataMapper *mapper;
+    vtkActor *actor;
+    vtkLookupTable *colors;
+    int firstPart, numParts;
+    QVector<vtkIdType> ids;        // Cells of all parts, as in vtkCellArray
+    QVector<vtkIdType> idStart;    // Of each part in ids, and the end
+    QVector<vtkIdType> cellStart;  // Number of cells before each part
+    bool dirty;                    // Visibility changed since update()
+};
+
+
+class PMeshBatcher
+{
+public:
+    PMeshBatcher();
+    ~PMeshBatcher();
+
+    void setMaxPoints(int count);  // Of each batch
+
+    // Parts are taken from the input, colour and visibility of actors.
+    void build(vtkRenderer *ren, const QList<vtkActor *> &parts);
+    void clear();
+    bool isEmpty();
+
+    void setColor(int part, double red, double green, double blue);
+    void setVisibility(int part, bool visible);
+    void update();  // Before rendering, after setVisibility()
+    vtkProperty *getProperty();
+
+protected:
+    vtkRenderer *renderer;
+    vtkProperty *property;
+    int maxPoints;
+    QList<PMeshBatch> batches;
+    QVector<int> partBatch;  // Batch of each part
+    QVector<bool> shown;     // Visibility of each part
+
+    void addBatch(const QList<vtkActor *> &parts, int first, int count);
+    void gather(PMeshBatch &batch);
+};
+
+#endif
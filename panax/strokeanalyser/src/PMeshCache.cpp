@@ -0,0 +1,277 @@
+/* PMeshCache.cpp
+
+   Disk cache of meshes with their normals.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PMeshCache.h"
+#include "PMeshReader.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QThread>
+#include <QCryptographicHash>
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkFloatArray.h"
+#include "vtkUnsignedCharArray.h"
+#include "vtkPointData.h"
+
+#include <cstring>
+using namespace std;
+
+#define CacheMagic "PMC3"  // Changes with the layout or the normals
+
+
+// A cache file is a PMeshCacheHeader and a block.  A block is a
+// PMeshBlockHeader, then the cell array, the points, the normals and the
+// colours, if any, each padded to 8 bytes.
+
+struct PMeshCacheHeader
+{
+    char magic[4];
+    qint32 spare;
+    qint64 sourceTime, sourceSize;
+};
+
+
+struct PMeshBlockHeader
+{
+    qint32 idSize;  // sizeof(vtkIdType) of the writer
+    qint32 hasColors;
+    qint64 numPoints, numCells, numIds;
+};
+
+
+static inline qint64 padded(qint64 size)
+{
+    return (size + 7) & ~(qint64) 7;
+}
+
+
+static void sourceStamp(const QString &source, qint64 &time, qint64 &size)
+{
+    QFileInfo info(source);
+    time = info.lastModified().toMSecsSinceEpoch();
+    size = info.size();
+}
+
+
+static void readArray(void *to, const char *&p, qint64 size)
+{
+    if (size > 0)
+        memcpy(to, p, size);
+    p += padded(size);
+}
+
+
+static void writeArray(char *&p, const void *from, qint64 size)
+{
+    if (size > 0)
+        memcpy(p, from, size);
+    p += padded(size);  // The block is zero-filled.
+}
+
+
+// PMeshCache class
+
+PMeshCache::PMeshCache()
+{
+    directory = QDir::homePath() + "/.panax/meshes";
+}
+
+
+void PMeshCache::setDirectory(const QString &dirName)
+{
+    directory = dirName;
+}
+
+
+QString PMeshCache::getDirectory()
+{
+    return directory;
+}
+
+
+vtkPolyData *PMeshCache::read(const QString &source)
+{
+    QFile file(cacheFile(source));
+    qint64 fileSize = file.size();
+    if (fileSize < (qint64) sizeof(PMeshCacheHeader) ||
+        !file.open(QIODevice::ReadOnly))
+        return NULL;
+    const char *data = (const char *) file.map(0, fileSize);
+    if (!data)
+        return NULL;
+
+    PMeshCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    qint64 time, size;
+    sourceStamp(source, time, size);
+    vtkPolyData *mesh = NULL;
+    if (!memcmp(header.magic, CacheMagic, 4) && header.sourceTime == time &&
+        header.sourceSize == size)
+        mesh = unpack(data + sizeof(header), fileSize - sizeof(header));
+
+    file.unmap((uchar *) data);
+    return mesh;
+}
+
+
+bool PMeshCache::write(const QString &source, vtkPolyData *mesh)
+{
+    QByteArray block = pack(mesh);
+    if (block.isEmpty())
+        return false;
+
+    PMeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CacheMagic, 4);
+    sourceStamp(source, header.sourceTime, header.sourceSize);
+
+    QDir().mkpath(directory);
+    QString fileName = cacheFile(source);
+    QString tempName = fileName +
+        QString(".%1").arg((quintptr) QThread::currentThreadId());
+    QFile file(tempName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    bool ok = file.write((const char *) &header, sizeof(header)) ==
+        sizeof(header) && file.write(block) == block.size();
+    file.close();
+
+    if (ok)
+    {
+        QFile::remove(fileName);
+        ok = QFile::rename(tempName, fileName);
+    }
+    if (!ok)
+        QFile::remove(tempName);
+    return ok;
+}
+
+
+void PMeshCache::clear()
+{
+    QDir dir(directory);
+    QStringList list = dir.entryList(QStringList("*.pmc"), QDir::Files);
+    for (int i = 0; i < list.size(); ++i)
+        dir.remove(list[i]);
+}
+
+
+// The mesh must have float points and normals.  Colours are kept if they
+// are 3-component unsigned char scalars.
+
+QByteArray PMeshCache::pack(vtkPolyData *mesh)
+{
+    vtkPoints *points = mesh->GetPoints();
+    vtkDataArray *normals = mesh->GetPointData()->GetNormals();
+    if (!points || points->GetDataType() != VTK_FLOAT || !normals ||
+        normals->GetDataType() != VTK_FLOAT ||
+        normals->GetNumberOfComponents() != 3)
+        return QByteArray();
+    vtkDataArray *scalars = mesh->GetPointData()->GetScalars();
+    bool hasColors = scalars &&
+        scalars->GetDataType() == VTK_UNSIGNED_CHAR &&
+        scalars->GetNumberOfComponents() == 3;
+    vtkCellArray *polys = mesh->GetPolys();
+
+    PMeshBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.idSize = sizeof(vtkIdType);
+    header.hasColors = hasColors;
+    header.numPoints = points->GetNumberOfPoints();
+    header.numCells = polys->GetNumberOfCells();
+    header.numIds = polys->GetData()->GetNumberOfTuples();
+
+    qint64 idBytes = header.numIds * sizeof(vtkIdType);
+    qint64 pointBytes = 12 * header.numPoints;
+    qint64 colorBytes = hasColors ? 3 * header.numPoints : 0;
+    QByteArray block(sizeof(header) + padded(idBytes) +
+        2 * padded(pointBytes) + padded(colorBytes), 0);
+
+    char *p = block.data();
+    writeArray(p, &header, sizeof(header));
+    writeArray(p, polys->GetData()->GetVoidPointer(0), idBytes);
+    writeArray(p, points->GetVoidPointer(0), pointBytes);
+    writeArray(p, normals->GetVoidPointer(0), pointBytes);
+    if (hasColors)
+        writeArray(p, scalars->GetVoidPointer(0), colorBytes);
+    return block;
+}
+
+
+vtkPolyData *PMeshCache::unpack(const char *block, qint64 size)
+{
+    if (size < (qint64) sizeof(PMeshBlockHeader))
+        return NULL;
+    PMeshBlockHeader header;
+    memcpy(&header, block, sizeof(header));
+    if (header.idSize != (qint32) sizeof(vtkIdType) ||
+        header.numPoints < 0 || header.numPoints > size ||
+        header.numIds < 0 || header.numIds > size ||
+        header.numCells < 0 || header.numCells > header.numIds)
+        return NULL;
+    qint64 idBytes = header.numIds * sizeof(vtkIdType);
+    qint64 pointBytes = 12 * header.numPoints;
+    qint64 colorBytes = header.hasColors ? 3 * header.numPoints : 0;
+    if ((qint64) sizeof(header) + padded(idBytes) + 2 * padded(pointBytes) +
+        padded(colorBytes) != size)
+        return NULL;
+
+    const char *p = block + sizeof(header);
+    vtkCellArray *polys = vtkCellArray::New();
+    readArray(polys->WritePointer(header.numCells, header.numIds), p,
+        idBytes);
+
+    vtkPoints *points = vtkPoints::New();
+    points->SetDataTypeToFloat();
+    points->SetNumberOfPoints(header.numPoints);
+    readArray(static_cast<vtkFloatArray *>(points->GetData())->
+        GetPointer(0), p, pointBytes);
+
+    vtkFloatArray *normals = vtkFloatArray::New();
+    normals->SetName("Normals");
+    normals->SetNumberOfComponents(3);
+    normals->SetNumberOfTuples(header.numPoints);
+    readArray(normals->GetPointer(0), p, pointBytes);
+
+    vtkPolyData *mesh = vtkPolyData::New();
+    mesh->SetPoints(points);
+    mesh->SetPolys(polys);
+    mesh->GetPointData()->SetNormals(normals);
+    points->Delete();
+    polys->Delete();
+    normals->Delete();
+
+    if (header.hasColors)
+    {
+        vtkUnsignedCharArray *colors = vtkUnsignedCharArray::New();
+        colors->SetName("RGB");
+        colors->SetNumberOfComponents(3);
+        colors->SetNumberOfTuples(header.numPoints);
+        readArray(colors->GetPointer(0), p, colorBytes);
+        mesh->GetPointData()->SetScalars(colors);
+        colors->Delete();
+    }
+
+    if (!PMeshReader::checkCells(mesh))
+    {
+        mesh->Delete();
+        return NULL;
+    }
+    return mesh;
+}
+
+
+// Supporting methods
+
+QString PMeshCache::cacheFile(const QString &source)
+{
+    QByteArray path = QFileInfo(source).absoluteFilePath().toUtf8();
+    QByteArray key = QCryptographicHash::hash(path, QCryptographicHash::Md5);
+    return directory + "/" + key.toHex() + ".pmc";
+}
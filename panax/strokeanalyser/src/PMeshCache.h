@@ -0,0 +1,51 @@
+/* PMeshCache.h
+
+   Disk cache of meshes with their normals.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PMESHCACHE_H
+#define PMESHCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include "vtkPolyData.h"
+
+
+// A source mesh file is cached as the mesh that the viewers render: the
+// points, normals and polygons that vtkPolyDataNormals makes of it without
+// splitting sharp edges, with any point colours.  Each cache file is a
+// fixed header followed by the mesh packed as a block of arrays in the
+// layout of the VTK arrays, so reading one maps the file and copies each
+// array in bulk, with no parsing.  pack() and unpack() let other
+// containers store such blocks.  A cache file belongs to the absolute path
+// of its source and is stale once the source's modification time or size
+// differs from the one recorded.
+//
+// Each source has its own cache file, written under a temporary name and
+// renamed, so different sources may be read and written from different
+// threads at once.
+
+class PMeshCache
+{
+public:
+    PMeshCache();
+
+    void setDirectory(const QString &dirName);  // Default: ~/.panax/meshes
+    QString getDirectory();
+
+    vtkPolyData *read(const QString &source);  // New mesh, or NULL if stale
+    bool write(const QString &source, vtkPolyData *mesh);
+    void clear();
+
+    static QByteArray pack(vtkPolyData *mesh);  // Empty unless float normals
+    static vtkPolyData *unpack(const char *block, qint64 size);  // Or NULL
+
+protected:
+    QString directory;
+
+    QString cacheFile(const QString &source);
+};
+
+#endif
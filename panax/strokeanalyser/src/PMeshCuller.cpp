@@ -0,0 +1,433 @@
+/* PMeshCuller.cpp
+
+   Frustum and occlusion culling of mesh actors.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PMeshCuller.h"
+#include "PParallel.h"
+#include <QMutex>
+#include "vtkCamera.h"
+#include "vtkMatrix4x4.h"
+#include "vtkRenderWindow.h"
+#include "vtkMapper.h"
+#include "vtkProperty.h"
+#include "vtkPolyData.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkFloatArray.h"
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#define DepthWidth 128         // Pixels across the depth buffer
+#define DefaultOccluderSize 0.5
+#define InteractiveRate 1.0    // Frames a second, above a still frame
+#define MinW 1e-6              // Points nearer the eye are not drawn
+
+
+// Supporting functions
+
+// c = m x, for the row-major 4x4 matrix m and x = (x, y, z, 1).
+
+static inline void transform(const double *m, double x, double y,
+    double z, double *c)
+{
+    for (int r = 0; r < 4; ++r)
+        c[r] = m[4 * r] * x + m[4 * r + 1] * y + m[4 * r + 2] * z +
+            m[4 * r + 3];
+}
+
+
+// Sampled at pixel centres into depth, keeping the nearest depth.  a, b
+// and c are the pixel coordinates and depths of the corners.
+
+static inline void drawTriangle(const float *a, const float *b,
+    const float *c, int width, int height, float *depth)
+{
+    // Pixels whose centres are in the triangle's box, by truncation, as
+    // most triangles cover none and are best rejected quickly
+    float left = min(a[0], min(b[0], c[0])) - 0.5f;
+    float right = max(a[0], max(b[0], c[0])) - 0.5f;
+    float bottom = min(a[1], min(b[1], c[1])) - 0.5f;
+    float top = max(a[1], max(b[1], c[1])) - 0.5f;
+    if (right < 0.0f || top < 0.0f || left >= width || bottom >= height)
+        return;
+    int x0 = max(0, (int) left + ((int) left < left));
+    int x1 = min(width - 1, (int) right);
+    int y0 = max(0, (int) bottom + ((int) bottom < bottom));
+    int y1 = min(height - 1, (int) top);
+    if (x0 > x1 || y0 > y1)
+        return;  // Between pixel centres
+    double area = (b[0] - a[0]) * (c[1] - a[1]) -
+        (b[1] - a[1]) * (c[0] - a[0]);
+    if (area == 0.0)
+        return;
+
+    for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x)
+        {
+            double px = x + 0.5, py = y + 0.5;
+            double u = ((c[0] - b[0]) * (py - b[1]) -
+                (c[1] - b[1]) * (px - b[0])) / area;
+            double v = ((a[0] - c[0]) * (py - c[1]) -
+                (a[1] - c[1]) * (px - c[0])) / area;
+            double w = 1.0 - u - v;
+            if (u < 0.0 || v < 0.0 || w < 0.0)
+                continue;
+            float d = u * a[2] + v * b[2] + w * c[2];
+            float &z = depth[y * width + x];
+            if (d < z)
+                z = d;
+        }
+}
+
+
+struct PCullerProjectKernel
+{
+    const double *m;
+    vtkPoints *points;
+    const float *xyz;  // Of points if they are floats, else NULL
+    int width, height;
+    float *screen;     // Pixel coordinates and depth of each point
+    char *drawn;       // In front of the eye
+
+    void operator()(int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            double x[3], c[4];
+            if (xyz)
+            {
+                x[0] = xyz[3 * i];
+                x[1] = xyz[3 * i + 1];
+                x[2] = xyz[3 * i + 2];
+            }
+            else
+                points->GetPoint(i, x);
+            transform(m, x[0], x[1], x[2], c);
+            drawn[i] = c[3] >= MinW;
+            if (!drawn[i])
+                continue;
+            screen[3 * i] = (0.5 * c[0] / c[3] + 0.5) * width;
+            screen[3 * i + 1] = (0.5 * c[1] / c[3] + 0.5) * height;
+            screen[3 * i + 2] = 0.5 * c[2] / c[3] + 0.5;
+        }
+    }
+};
+
+
+// Each chunk of cells is drawn into a buffer of its own, then merged.
+
+struct PCullerDrawKernel
+{
+    const vtkIdType *ids;
+    const vtkIdType *cellStart;  // Of each cell in ids
+    const float *screen;
+    const char *drawn;
+    int width, height;
+    float *depth;
+    QMutex *lock;
+
+    void operator()(int begin, int end)
+    {
+        std::vector<float> local(width * height, 1.0f);
+        for (int i = begin; i < end; ++i)
+        {
+            const vtkIdType *p = ids + cellStart[i];
+            for (vtkIdType k = 2; k < *p; ++k)  // Fan around p[1]
+                if (drawn[p[1]] && drawn[p[k]] && drawn[p[k + 1]])
+                    drawTriangle(&screen[3 * p[1]], &screen[3 * p[k]],
+                        &screen[3 * p[k + 1]], width, height, &local[0]);
+        }
+
+        QMutexLocker locker(lock);
+        for (int i = 0; i < width * height; ++i)
+            depth[i] = min(depth[i], local[i]);
+    }
+};
+
+
+// PMeshCuller class
+
+PMeshCuller::PMeshCuller()
+{
+    occlusion = false;
+    occluderSize = DefaultOccluderSize;
+    numCulled = 0;
+    width = height = 0;
+    depthWidth = depthHeight = 0;
+}
+
+
+void PMeshCuller::add(vtkActor *actor)
+{
+    actors.insert(actor);
+}
+
+
+void PMeshCuller::remove(vtkActor *actor)
+{
+    actors.remove(actor);
+    depthOccluders.clear();
+}
+
+
+void PMeshCuller::clear()
+{
+    actors.clear();
+    depthOccluders.clear();
+}
+
+
+void PMeshCuller::setOcclusion(bool on)
+{
+    occlusion = on;
+}
+
+
+void PMeshCuller::setOccluderSize(double fraction)
+{
+    occluderSize = fraction;
+}
+
+
+int PMeshCuller::getNumCulled()
+{
+    return numCulled;
+}
+
+
+// Called by the renderer before each frame with its visible props.  The
+// props kept are moved to the front of propList.
+
+double PMeshCuller::Cull(vtkRenderer *ren, vtkProp **propList,
+    int &listLength, int &initialized)
+{
+    double aspect = ren->GetTiledAspectRatio();
+    vtkMatrix4x4 *matrix = ren->GetActiveCamera()->
+        GetCompositeProjectionTransformMatrix(aspect, -1.0, 1.0);
+    double m[16];
+    for (int r = 0; r < 4; ++r)
+        for (int c = 0; c < 4; ++c)
+            m[4 * r + c] = matrix->GetElement(r, c);
+    width = DepthWidth;
+    height = max(1, (int) (DepthWidth / aspect + 0.5));
+
+    // Boxes of the added actors in the buffer, and their nearest depths
+    std::vector<double> rects(4 * listLength), nearest(listLength);
+    std::vector<char> tested(listLength, 0), shown(listLength, 1);
+    double largest = 0.0;
+    for (int i = 0; i < listLength; ++i)
+    {
+        double *bounds;
+        if (!actors.contains(propList[i]) ||
+            !(bounds = propList[i]->GetBounds()))
+            continue;
+        tested[i] = 1;
+        shown[i] = project(m, bounds, &rects[4 * i], nearest[i]);
+        double dx = bounds[1] - bounds[0], dy = bounds[3] - bounds[2],
+            dz = bounds[5] - bounds[4];
+        if (shown[i])
+            largest = max(largest, dx * dx + dy * dy + dz * dz);
+    }
+
+    bool still = ren->GetRenderWindow()->GetDesiredUpdateRate() <
+        InteractiveRate;
+    if (occlusion && still && largest > 0.0)
+    {
+        QList<vtkPolyData *> occluders;
+        for (int i = 0; i < listLength; ++i)
+        {
+            vtkActor *actor = vtkActor::SafeDownCast(propList[i]);
+            if (!tested[i] || !shown[i] || !actor)
+                continue;
+            vtkProperty *property = actor->GetProperty();
+            vtkPolyData *mesh = vtkPolyData::SafeDownCast(
+                actor->GetMapper()->GetInput());
+            double *bounds = actor->GetBounds();
+            double dx = bounds[1] - bounds[0], dy = bounds[3] - bounds[2],
+                dz = bounds[5] - bounds[4];
+            if (mesh && mesh->GetPoints() &&
+                property->GetOpacity() >= 1.0 &&
+                property->GetRepresentation() == VTK_SURFACE &&
+                !property->GetFrontfaceCulling() &&
+                dx * dx + dy * dy + dz * dz >=
+                    occluderSize * occluderSize * largest)
+                occluders.append(mesh);
+        }
+
+        // Still frames of an unchanged view reuse the buffer.
+        if (occluders != depthOccluders || width != depthWidth ||
+            height != depthHeight || !equal(m, m + 16, depthMatrix))
+        {
+            depth.assign(width * height, 1.0f);
+            for (int i = 0; i < occluders.size(); ++i)
+                drawOccluder(m, occluders[i]);
+            widenDepth();
+            depthOccluders = occluders;
+            depthWidth = width;
+            depthHeight = height;
+            copy(m, m + 16, depthMatrix);
+        }
+
+        for (int i = 0; i < listLength; ++i)
+            if (tested[i] && shown[i] &&
+                isOccluded(&rects[4 * i], nearest[i]))
+                shown[i] = 0;
+    }
+
+    double totalTime = 0.0;
+    int count = 0;
+    for (int i = 0; i < listLength; ++i)
+        if (shown[i])
+        {
+            propList[count++] = propList[i];
+            totalTime += propList[i]->GetRenderTimeMultiplier();
+        }
+    numCulled = listLength - count;
+    listLength = count;
+    return initialized ? totalTime : count;
+}
+
+
+// Protected methods
+
+// False if the box is wholly outside a plane of the frustum.  Else rect
+// is its extent in the depth buffer, as x and y ranges, and nearest its
+// nearest depth, or -1 if it reaches behind the eye.
+
+bool PMeshCuller::project(const double *m, const double *bounds,
+    double *rect, double &nearest)
+{
+    int outside[6] = { 0, 0, 0, 0, 0, 0 };
+    nearest = 1.0;
+    rect[0] = rect[2] = HUGE_VAL;
+    rect[1] = rect[3] = -HUGE_VAL;
+    for (int k = 0; k < 8; ++k)
+    {
+        double c[4];
+        transform(m, bounds[k & 1], bounds[2 + ((k >> 1) & 1)],
+            bounds[4 + (k >> 2)], c);
+        for (int a = 0; a < 3; ++a)
+        {
+            outside[2 * a] += c[a] < -c[3];
+            outside[2 * a + 1] += c[a] > c[3];
+        }
+        if (c[3] < MinW)
+        {
+            nearest = -1.0;
+            continue;
+        }
+
+        double x = (0.5 * c[0] / c[3] + 0.5) * width;
+        double y = (0.5 * c[1] / c[3] + 0.5) * height;
+        rect[0] = min(rect[0], x);
+        rect[1] = max(rect[1], x);
+        rect[2] = min(rect[2], y);
+        rect[3] = max(rect[3], y);
+        if (nearest >= 0.0)
+            nearest = min(nearest, 0.5 * c[2] / c[3] + 0.5);
+    }
+
+    for (int p = 0; p < 6; ++p)
+        if (outside[p] == 8)
+            return false;
+    return true;
+}
+
+
+// Triangles reaching behind the eye are left out.
+
+void PMeshCuller::drawOccluder(const double *m, vtkPolyData *mesh)
+{
+    vtkPoints *points = mesh->GetPoints();
+    int numPoints = points->GetNumberOfPoints();
+    std::vector<float> screen(3 * numPoints);
+    std::vector<char> drawn(numPoints);
+    PCullerProjectKernel projectKernel;
+    projectKernel.m = m;
+    projectKernel.points = points;
+    projectKernel.xyz = points->GetDataType() == VTK_FLOAT ?
+        static_cast<vtkFloatArray *>(points->GetData())->GetPointer(0) :
+        NULL;
+    projectKernel.width = width;
+    projectKernel.height = height;
+    projectKernel.screen = &screen[0];
+    projectKernel.drawn = &drawn[0];
+    parallelFor(numPoints, projectKernel);
+
+    vtkCellArray *polys = mesh->GetPolys();
+    int numCells = polys->GetNumberOfCells();
+    const vtkIdType *ids = polys->GetPointer();
+    std::vector<vtkIdType> cellStart(numCells);
+    vtkIdType start = 0;
+    for (int i = 0; i < numCells; ++i)
+    {
+        cellStart[i] = start;
+        start += ids[start] + 1;
+    }
+
+    QMutex lock;
+    PCullerDrawKernel drawKernel;
+    drawKernel.ids = ids;
+    drawKernel.cellStart = &cellStart[0];
+    drawKernel.screen = &screen[0];
+    drawKernel.drawn = &drawn[0];
+    drawKernel.width = width;
+    drawKernel.height = height;
+    drawKernel.depth = &depth[0];
+    drawKernel.lock = &lock;
+    parallelFor(numCells, drawKernel, 16384);
+}
+
+
+// Each pixel takes the farthest depth of its 3 x 3 neighbourhood, so a
+// pixel only partly covered, or whose occluders slope away within it,
+// hides nothing that a pixel centre would miss.
+
+void PMeshCuller::widenDepth()
+{
+    std::vector<float> rows(depth.size());
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            float d = depth[y * width + x];
+            if (x > 0)
+                d = max(d, depth[y * width + x - 1]);
+            if (x < width - 1)
+                d = max(d, depth[y * width + x + 1]);
+            rows[y * width + x] = d;
+        }
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            float d = rows[y * width + x];
+            if (y > 0)
+                d = max(d, rows[(y - 1) * width + x]);
+            if (y < height - 1)
+                d = max(d, rows[(y + 1) * width + x]);
+            depth[y * width + x] = d;
+        }
+}
+
+
+bool PMeshCuller::isOccluded(const double *rect, double nearest)
+{
+    if (nearest < 0.0)
+        return false;
+    int x0 = max(0, (int) floor(rect[0]));
+    int x1 = min(width - 1, (int) floor(rect[1]));
+    int y0 = max(0, (int) floor(rect[2]));
+    int y1 = min(height - 1, (int) floor(rect[3]));
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x)
+            if (depth[y * width + x] >= nearest)
+                return false;
+    return true;
+}
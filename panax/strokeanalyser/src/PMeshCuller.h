@@ -0,0 +1,70 @@
+/* PMeshCuller.h
+
+   Frustum and occlusion culling of mesh actors.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PMESHCULLER_H
+#define PMESHCULLER_H
+
+#include <QSet>
+#include <QList>
+#include <vector>
+#include "vtkCuller.h"
+#include "vtkActor.h"
+#include "vtkRenderer.h"
+#include "vtkPolyData.h"
+
+
+// Each added actor is drawn only if its bounding box meets the view
+// frustum and, when occlusion is on, is not wholly behind the occluders.
+// Other props are left to the renderer's other cullers.
+//
+// Occluders are the visible, opaque surface actors whose boxes are at
+// least occluderSize of the largest box.  Their triangles are drawn in
+// parallel into a small depth buffer, widened by a pixel so that it is
+// conservative, and a box is hidden if every pixel it covers is nearer
+// than the box.  The buffer is drawn on still frames only, and kept while
+// the view and occluders are unchanged; while the camera moves the level
+// of detail manager keeps frames cheap, and occlusion is skipped.
+
+class PMeshCuller: public vtkCuller
+{
+public:
+    static PMeshCuller *New() { return new PMeshCuller; }
+
+    void add(vtkActor *actor);
+    void remove(vtkActor *actor);
+    void clear();
+
+    void setOcclusion(bool on);
+    void setOccluderSize(double fraction);  // Of the largest box
+    int getNumCulled();  // Of the last frame
+
+    double Cull(vtkRenderer *ren, vtkProp **propList, int &listLength,
+        int &initialized);
+
+protected:
+    PMeshCuller();
+
+    QSet<vtkProp *> actors;
+    bool occlusion;
+    double occluderSize;
+    int numCulled;
+    int width, height;         // Of the depth buffer
+    std::vector<float> depth;  // Normalised depth, 1 if uncovered
+
+    // View and occluders of the depth buffer
+    QList<vtkPolyData *> depthOccluders;
+    int depthWidth, depthHeight;
+    double depthMatrix[16];
+
+    bool project(const double *m, const double *bounds, double *rect,
+        double &nearest);
+    void drawOccluder(const double *m, vtkPolyData *mesh);
+    void widenDepth();
+    bool isOccluded(const double *rect, double nearest);
+};
+
+#endif
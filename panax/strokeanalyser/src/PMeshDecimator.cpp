@@ -0,0 +1,946 @@
+/* PMeshDecimator.cpp
+
+   Quadric error mesh decimation.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PMeshDecimator.h"
+#include "PParallel.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkFloatArray.h"
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#define MaxRing 64        // Vertices of higher valence are not collapsed
+#define MinCosFlip 0.1    // Reject collapses that turn a face this much
+#define MaxRegions 64
+#define MinRegionTriangles 50000
+#define ParallelShare 0.8  // Share of the collapses made inside slabs
+
+
+// Corner table navigation
+
+static inline int nextCorner(int c)
+{
+    return (c % 3 == 2) ? c - 2 : c + 1;
+}
+
+
+static inline int prevCorner(int c)
+{
+    return (c % 3 == 0) ? c + 2 : c - 1;
+}
+
+
+// Quadric arithmetic
+
+typedef PMeshDecimator::Quadric Quadric;
+
+static inline void clearQuadric(Quadric &q)
+{
+    q.a2 = q.ab = q.ac = q.ad = q.b2 = q.bc = q.bd = q.c2 = q.cd = q.d2 = 0.0;
+}
+
+
+static inline void addQuadric(Quadric &q, const Quadric &r)
+{
+    q.a2 += r.a2;  q.ab += r.ab;  q.ac += r.ac;  q.ad += r.ad;
+    q.b2 += r.b2;  q.bc += r.bc;  q.bd += r.bd;
+    q.c2 += r.c2;  q.cd += r.cd;
+    q.d2 += r.d2;
+}
+
+
+static inline double evalQuadric(const Quadric &q, double x, double y,
+    double z)
+{
+    return q.a2*x*x + 2*q.ab*x*y + 2*q.ac*x*z + 2*q.ad*x +
+        q.b2*y*y + 2*q.bc*y*z + 2*q.bd*y +
+        q.c2*z*z + 2*q.cd*z + q.d2;
+}
+
+
+// Add the area-weighted plane quadric of triangle (p0, p1, p2).
+
+static inline void addPlane(Quadric &q, const float *p0, const float *p1,
+    const float *p2)
+{
+    double u[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    double v[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    double n[3] = {u[1]*v[2] - u[2]*v[1], u[2]*v[0] - u[0]*v[2],
+        u[0]*v[1] - u[1]*v[0]};
+    double len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    if (len == 0.0)
+        return;
+
+    double w = 0.5 * len;  // Triangle area
+    n[0] /= len;
+    n[1] /= len;
+    n[2] /= len;
+    double d = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+
+    q.a2 += w*n[0]*n[0];  q.ab += w*n[0]*n[1];  q.ac += w*n[0]*n[2];
+    q.ad += w*n[0]*d;     q.b2 += w*n[1]*n[1];  q.bc += w*n[1]*n[2];
+    q.bd += w*n[1]*d;     q.c2 += w*n[2]*n[2];  q.cd += w*n[2]*d;
+    q.d2 += w*d*d;
+}
+
+
+// Parallel kernels
+
+// Find the opposite corner of every corner through the vertex-to-corner
+// incidence lists.  Edges without exactly one oppositely oriented partner
+// are left at -1 and their end points are locked later.
+
+struct PDecimatorTopologyKernel
+{
+    PMeshDecimator *d;
+
+    void operator()(int begin, int end)
+    {
+        const int *V = &d->V[0];
+        const int *first = &d->firstCorner[0];
+        const int *incident = &d->incident[0];
+
+        for (int c = begin; c < end; ++c)
+        {
+            int a = V[nextCorner(c)];
+            int b = V[prevCorner(c)];
+            int match = -1;
+            int count = 0;
+
+            // Partner edge b -> a
+            for (int i = first[b]; i < first[b + 1]; ++i)
+            {
+                int k = incident[i];
+                if (V[nextCorner(k)] == a)
+                {
+                    match = prevCorner(k);
+                    ++count;
+                }
+            }
+
+            // Another edge a -> b makes the edge non-manifold.
+            for (int i = first[a]; i < first[a + 1]; ++i)
+            {
+                int k = incident[i];
+                if (k != nextCorner(c) && V[nextCorner(k)] == b)
+                    count = 2;
+            }
+
+            d->O[c] = (count == 1) ? match : -1;
+        }
+    }
+};
+
+
+// Per-vertex set-up: entry corner, fan check and quadric.
+
+struct PDecimatorVertexKernel
+{
+    PMeshDecimator *d;
+
+    void operator()(int begin, int end)
+    {
+        const int *V = &d->V[0];
+        const int *O = &d->O[0];
+        const float *pos = &d->pos[0];
+
+        for (int v = begin; v < end; ++v)
+        {
+            int first = d->firstCorner[v];
+            int degree = d->firstCorner[v + 1] - first;
+            Quadric &q = d->quadric[v];
+            clearQuadric(q);
+
+            if (degree == 0)
+            {
+                d->vertexCorner[v] = -1;  // Unused vertex
+                continue;
+            }
+            d->vertexCorner[v] = d->incident[first];
+
+            // A vertex whose corners do not form a single closed fan
+            // cannot be collapsed safely.
+            if (!d->locked[v])
+            {
+                int c = d->incident[first];
+                int count = 0;
+                do
+                {
+                    ++count;
+                    int o = O[nextCorner(c)];
+                    if (o < 0 || count > degree)
+                    {
+                        count = -1;
+                        break;
+                    }
+                    c = nextCorner(o);
+                } while (c != d->incident[first]);
+
+                if (count != degree || degree > MaxRing)
+                    d->locked[v] = 1;
+            }
+
+            for (int i = first; i < first + degree; ++i)
+            {
+                int c = d->incident[i];
+                int t = 3 * (c / 3);
+                addPlane(q, pos + 3*V[t], pos + 3*V[t + 1], pos + 3*V[t + 2]);
+            }
+        }
+    }
+};
+
+
+// Cost of every live edge, one heap slot per corner.
+
+struct PDecimatorCostKernel
+{
+    PMeshDecimator *d;
+
+    void operator()(int begin, int end)
+    {
+        for (int c = begin; c < end; ++c)
+        {
+            PMeshDecimator::HeapEntry &e = d->heap[c];
+            e.corner = -1;
+
+            if (d->V[c] < 0)  // Collapsed triangle
+                continue;
+            int o = d->O[c];
+            if (o < c)  // Each edge once; boundary edges never
+                continue;
+
+            float cost;
+            if (d->edgeCost(c, cost, NULL))
+            {
+                e.cost = cost;
+                e.corner = c;
+                e.stamp = d->version[d->V[nextCorner(c)]] +
+                    d->version[d->V[prevCorner(c)]];
+            }
+        }
+    }
+};
+
+
+static bool isEmptyEntry(const PMeshDecimator::HeapEntry &e)
+{
+    return e.corner < 0;
+}
+
+
+// Decimate each slab within its quota.  Slabs share no vertex that may
+// move and no triangle that may change, so they run without locks.
+
+struct PDecimatorRegionKernel
+{
+    PMeshDecimator *d;
+
+    void operator()(int begin, int end)
+    {
+        for (int r = begin; r < end; ++r)
+        {
+            vector<PMeshDecimator::HeapEntry> entries(
+                d->heap.begin() + d->regionStart[r],
+                d->heap.begin() + d->regionStart[r + 1]);
+            d->regionDone[r] = d->collapseRange(entries, d->regionQuota[r],
+                0);
+        }
+    }
+};
+
+
+// PMeshDecimator class
+
+PMeshDecimator::PMeshDecimator()
+{
+    input = NULL;
+    output = vtkPolyData::New();
+    ratio = 1.0;
+    doneInput = NULL;
+    doneTime = 0;
+    doneRatio = -1.0;
+    numVertices = numTriangles = 0;
+    numRegions = 1;
+    freezeBorders = false;
+}
+
+
+PMeshDecimator::~PMeshDecimator()
+{
+    output->Delete();
+}
+
+
+void PMeshDecimator::setInput(vtkPolyData *in)
+{
+    input = in;
+}
+
+
+void PMeshDecimator::setTargetRatio(double r)
+{
+    ratio = qBound(0.0, r, 1.0);
+}
+
+
+double PMeshDecimator::getTargetRatio()
+{
+    return ratio;
+}
+
+
+vtkPolyData *PMeshDecimator::getOutput()
+{
+    return output;
+}
+
+
+// Decimate the input unless neither the input nor the ratio has changed
+// since the last call.
+
+void PMeshDecimator::update()
+{
+    if (!input)
+        return;
+
+    if (input == doneInput && input->GetMTime() == doneTime &&
+        ratio == doneRatio)
+        return;
+
+    if (ratio >= 1.0)
+        output->ShallowCopy(input);
+    else
+    {
+        readInput();
+        if (numVertices == 0 || numTriangles == 0)
+            output->Initialize();  // Nothing to decimate
+        else
+        {
+            buildTopology();
+            collapseEdges((int) (ratio * numTriangles));
+            writeOutput();
+        }
+        releaseWorkspace();
+    }
+
+    doneInput = input;
+    doneTime = input->GetMTime();
+    doneRatio = ratio;
+}
+
+
+// Copy the input into the corner table, fan-triangulating polygons and
+// dropping degenerate triangles.
+
+void PMeshDecimator::readInput()
+{
+    vtkPoints *points = input->GetPoints();
+    numVertices = points ? points->GetNumberOfPoints() : 0;
+
+    double bounds[6];
+    input->GetBounds(bounds);
+    scale = 0.0;
+    for (int i = 0; i < 3; ++i)
+    {
+        center[i] = 0.5 * (bounds[2*i] + bounds[2*i + 1]);
+        scale = qMax(scale, bounds[2*i + 1] - bounds[2*i]);
+    }
+    if (scale <= 0.0)
+        scale = 1.0;
+
+    pos.resize(3 * numVertices);
+    for (int i = 0; i < numVertices; ++i)
+    {
+        double p[3];
+        points->GetPoint(i, p);
+        pos[3*i] = (p[0] - center[0]) / scale;
+        pos[3*i + 1] = (p[1] - center[1]) / scale;
+        pos[3*i + 2] = (p[2] - center[2]) / scale;
+    }
+
+    vtkCellArray *polys = input->GetPolys();
+    V.clear();
+    V.reserve(3 * polys->GetNumberOfCells());
+
+    // Walk the connectivity directly rather than with InitTraversal(),
+    // which would disturb a renderer reading the same input.
+    vtkIdType *cell = polys->GetPointer();
+    vtkIdType numCells = polys->GetNumberOfCells();
+    for (vtkIdType i = 0; i < numCells; ++i, cell += cell[0] + 1)
+    {
+        vtkIdType npts = cell[0], *pts = cell + 1;
+        for (int j = 2; j < npts; ++j)
+        {
+            int i0 = pts[0], i1 = pts[j - 1], i2 = pts[j];
+            if (i0 == i1 || i1 == i2 || i2 == i0)
+                continue;
+            V.push_back(i0);
+            V.push_back(i1);
+            V.push_back(i2);
+        }
+    }
+
+    numTriangles = V.size() / 3;
+}
+
+
+void PMeshDecimator::buildTopology()
+{
+    int numCorners = 3 * numTriangles;
+
+    // Vertex to corner incidence
+    firstCorner.assign(numVertices + 1, 0);
+    for (int c = 0; c < numCorners; ++c)
+        ++firstCorner[V[c] + 1];
+    for (int v = 0; v < numVertices; ++v)
+        firstCorner[v + 1] += firstCorner[v];
+
+    incident.resize(numCorners);
+    vector<int> fill(firstCorner.begin(), firstCorner.end() - 1);
+    for (int c = 0; c < numCorners; ++c)
+        incident[fill[V[c]]++] = c;
+
+    // Opposite corners
+    O.resize(numCorners);
+    PDecimatorTopologyKernel topologyKernel;
+    topologyKernel.d = this;
+    parallelFor(numCorners, topologyKernel);
+
+    // Boundary and non-manifold edges lock their end points.
+    locked.assign(numVertices, 0);
+    for (int c = 0; c < numCorners; ++c)
+        if (O[c] < 0)
+        {
+            locked[V[nextCorner(c)]] = 1;
+            locked[V[prevCorner(c)]] = 1;
+        }
+
+    // Fans and quadrics
+    vertexCorner.resize(numVertices);
+    quadric.resize(numVertices);
+    PDecimatorVertexKernel vertexKernel;
+    vertexKernel.d = this;
+    parallelFor(numVertices, vertexKernel);
+
+    vector<int>().swap(incident);
+    vector<int>().swap(firstCorner);
+
+    version.assign(numVertices, 0);
+}
+
+
+// Cut the mesh into slabs of equal vertex count along its longest axis,
+// one per thread, and mark the vertices on slab borders.
+
+void PMeshDecimator::splitRegions()
+{
+    numRegions = qMin(parallelThreadCount(), MaxRegions);
+    numRegions = qMin(numRegions, numTriangles / MinRegionTriangles);
+    if (numRegions < 2)
+    {
+        numRegions = 1;
+        return;
+    }
+
+    float extent[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        float lo = 1e30f, hi = -1e30f;
+        for (int v = 0; v < numVertices; v += 97)
+        {
+            lo = qMin(lo, pos[3*v + i]);
+            hi = qMax(hi, pos[3*v + i]);
+        }
+        extent[i] = hi - lo;
+    }
+    int axis = (extent[0] >= extent[1] && extent[0] >= extent[2]) ? 0 :
+        (extent[1] >= extent[2] ? 1 : 2);
+
+    // Slab bounds from a sample of the vertices
+    int step = qMax(1, numVertices / 65536);
+    vector<float> sample;
+    for (int v = 0; v < numVertices; v += step)
+        sample.push_back(pos[3*v + axis]);
+    sort(sample.begin(), sample.end());
+
+    vector<float> bound(numRegions - 1);
+    for (int r = 1; r < numRegions; ++r)
+        bound[r - 1] = sample[r * sample.size() / numRegions];
+
+    region.resize(numVertices);
+    for (int v = 0; v < numVertices; ++v)
+        region[v] = upper_bound(bound.begin(), bound.end(), pos[3*v + axis]) -
+            bound.begin();
+
+    border.assign(numVertices, 0);
+    for (int t = 0; t < 3 * numTriangles; t += 3)
+    {
+        int r = region[V[t]];
+        if (region[V[t + 1]] != r || region[V[t + 2]] != r)
+            border[V[t]] = border[V[t + 1]] = border[V[t + 2]] = 1;
+    }
+}
+
+
+// Cost every collapsible edge.  While borders are frozen the entries are
+// grouped by slab, each group a heap of its own.
+
+void PMeshDecimator::buildHeap()
+{
+    int numCorners = 3 * numTriangles;
+    heap.resize(numCorners);
+    PDecimatorCostKernel costKernel;
+    costKernel.d = this;
+    parallelFor(numCorners, costKernel);
+
+    heap.erase(remove_if(heap.begin(), heap.end(), isEmptyEntry),
+        heap.end());
+    queued.assign(numCorners, 0);
+    for (size_t i = 0; i < heap.size(); ++i)
+        queued[heap[i].corner] = 1;
+
+    if (!freezeBorders)
+    {
+        make_heap(heap.begin(), heap.end());
+        return;
+    }
+
+    regionStart.assign(numRegions + 1, 0);
+    for (size_t i = 0; i < heap.size(); ++i)
+        ++regionStart[region[V[nextCorner(heap[i].corner)]] + 1];
+    for (int r = 0; r < numRegions; ++r)
+        regionStart[r + 1] += regionStart[r];
+
+    vector<HeapEntry> grouped(heap.size());
+    vector<int> fill(regionStart.begin(), regionStart.end() - 1);
+    for (size_t i = 0; i < heap.size(); ++i)
+        grouped[fill[region[V[nextCorner(heap[i].corner)]]]++] = heap[i];
+    heap.swap(grouped);
+
+    for (int r = 0; r < numRegions; ++r)
+        make_heap(heap.begin() + regionStart[r],
+            heap.begin() + regionStart[r + 1]);
+}
+
+
+void PMeshDecimator::collapseEdges(int targetTriangles)
+{
+    int numCollapses = (numTriangles - targetTriangles + 1) / 2;
+
+    splitRegions();
+    if (numRegions > 1)
+    {
+        freezeBorders = true;
+        buildHeap();
+
+        // Quotas in proportion to the collapsible edges of each slab
+        double share = ParallelShare * numCollapses /
+            qMax(1, (int) heap.size());
+        regionQuota.resize(numRegions);
+        regionDone.assign(numRegions, 0);
+        for (int r = 0; r < numRegions; ++r)
+            regionQuota[r] = (int) (share *
+                (regionStart[r + 1] - regionStart[r]));
+
+        PDecimatorRegionKernel regionKernel;
+        regionKernel.d = this;
+        parallelFor(numRegions, regionKernel, 1);
+
+        for (int r = 0; r < numRegions; ++r)
+            numCollapses -= regionDone[r];
+        freezeBorders = false;
+    }
+
+    // The rest over the whole mesh, borders included
+    buildHeap();
+    int stamp = *max_element(version.begin(), version.end());
+    collapseRange(heap, numCollapses, stamp);
+}
+
+
+// Make up to maxCollapses collapses from the given heap.  Stale entries
+// are re-costed and pushed back.  Returns the number of collapses made.
+
+int PMeshDecimator::collapseRange(vector<HeapEntry> &entries,
+    int maxCollapses, int stamp)
+{
+    int done = 0;
+
+    while (done < maxCollapses && !entries.empty())
+    {
+        pop_heap(entries.begin(), entries.end());
+        HeapEntry e = entries.back();
+        entries.pop_back();
+
+        int c = e.corner;
+        queued[c] = 0;
+        if (V[c] < 0)  // Triangle already collapsed
+            continue;
+
+        int a = V[nextCorner(c)];
+        int b = V[prevCorner(c)];
+        int current = version[a] + version[b];
+        float cost, target[3];
+
+        if (e.stamp != current)
+        {
+            // An end point has moved since this entry was made.
+            if (edgeCost(c, e.cost, NULL))
+            {
+                e.stamp = current;
+                queued[c] = 1;
+                entries.push_back(e);
+                push_heap(entries.begin(), entries.end());
+            }
+            continue;
+        }
+
+        if (!edgeCost(c, cost, target) || !canCollapse(c, target))
+            continue;
+
+        // Versions only grow, so a vertex touched by this collapse makes
+        // every older entry on its edges stale.
+        ++stamp;
+        version[a] = stamp;
+        version[b] = stamp;
+        collapse(c, target);
+        ++done;
+
+        // Around each opposite vertex x, edges (a, x) and (b, x) have
+        // merged.  If both their entries sat on corners of the removed
+        // triangles, the merged edge gets a fresh one.  The removed
+        // corners keep their opposites.
+        int dying[2] = {c, O[c]};
+        for (int i = 0; i < 2; ++i)
+        {
+            int o = O[nextCorner(dying[i])];
+            if (o < 0 || O[o] < 0 || queued[o] || queued[O[o]])
+                continue;
+            e.corner = qMin(o, O[o]);
+            if (edgeCost(e.corner, e.cost, NULL))
+            {
+                e.stamp = version[V[nextCorner(e.corner)]] +
+                    version[V[prevCorner(e.corner)]];
+                queued[e.corner] = 1;
+                entries.push_back(e);
+                push_heap(entries.begin(), entries.end());
+            }
+        }
+    }
+
+    return done;
+}
+
+
+// Cost of collapsing the edge facing corner c, and the optimal position
+// of the merged vertex.
+
+bool PMeshDecimator::edgeCost(int c, float &cost, float *target)
+{
+    int a = V[nextCorner(c)];
+    int b = V[prevCorner(c)];
+    if (locked[a] || locked[b])
+        return false;
+    if (freezeBorders && (border[a] || border[b]))
+        return false;
+
+    Quadric q = quadric[a];
+    addQuadric(q, quadric[b]);
+
+    const float *pa = &pos[3*a];
+    const float *pb = &pos[3*b];
+    double mid[3] = {0.5 * (pa[0] + pb[0]), 0.5 * (pa[1] + pb[1]),
+        0.5 * (pa[2] + pb[2])};
+    double best[3];
+    double bestCost;
+
+    // Minimise the quadric: A p = -b by Cramer's rule, unless A is close
+    // to singular (flat or cylindrical neighbourhoods).
+    double det = q.a2 * (q.b2*q.c2 - q.bc*q.bc) -
+        q.ab * (q.ab*q.c2 - q.bc*q.ac) + q.ac * (q.ab*q.bc - q.b2*q.ac);
+    double trace = (q.a2 + q.b2 + q.c2) / 3.0;
+    bool solved = false;
+
+    if (fabs(det) > 1e-6 * trace * trace * trace)
+    {
+        double rx = -q.ad, ry = -q.bd, rz = -q.cd;
+        best[0] = (rx * (q.b2*q.c2 - q.bc*q.bc) -
+            q.ab * (ry*q.c2 - q.bc*rz) + q.ac * (ry*q.bc - q.b2*rz)) / det;
+        best[1] = (q.a2 * (ry*q.c2 - rz*q.bc) -
+            rx * (q.ab*q.c2 - q.bc*q.ac) + q.ac * (q.ab*rz - ry*q.ac)) / det;
+        best[2] = (q.a2 * (q.b2*rz - q.bc*ry) -
+            q.ab * (q.ab*rz - ry*q.ac) + rx * (q.ab*q.bc - q.b2*q.ac)) / det;
+
+        // Far-off optima come from near-singular systems.
+        double dx = pa[0] - pb[0], dy = pa[1] - pb[1], dz = pa[2] - pb[2];
+        double ex = best[0] - mid[0], ey = best[1] - mid[1],
+            ez = best[2] - mid[2];
+        solved = ex*ex + ey*ey + ez*ez <= 4.0 * (dx*dx + dy*dy + dz*dz);
+    }
+
+    if (solved)
+        bestCost = evalQuadric(q, best[0], best[1], best[2]);
+    else
+    {
+        best[0] = mid[0];
+        best[1] = mid[1];
+        best[2] = mid[2];
+        bestCost = evalQuadric(q, mid[0], mid[1], mid[2]);
+
+        double ca = evalQuadric(q, pa[0], pa[1], pa[2]);
+        if (ca < bestCost)
+        {
+            best[0] = pa[0];    best[1] = pa[1];    best[2] = pa[2];
+            bestCost = ca;
+        }
+        double cb = evalQuadric(q, pb[0], pb[1], pb[2]);
+        if (cb < bestCost)
+        {
+            best[0] = pb[0];    best[1] = pb[1];    best[2] = pb[2];
+            bestCost = cb;
+        }
+    }
+
+    cost = (float) qMax(0.0, bestCost);
+    if (target)
+    {
+        target[0] = (float) best[0];
+        target[1] = (float) best[1];
+        target[2] = (float) best[2];
+    }
+    return true;
+}
+
+
+// Collect the corners around unlocked vertex v.  Returns -1 if the fan is
+// open or larger than maxCorners.
+
+int PMeshDecimator::ring(int v, int *corners, int maxCorners)
+{
+    int start = vertexCorner[v];
+    int c = start;
+    int count = 0;
+
+    do
+    {
+        if (count == maxCorners)
+            return -1;
+        corners[count++] = c;
+        int o = O[nextCorner(c)];
+        if (o < 0)
+            return -1;
+        c = nextCorner(o);
+    } while (c != start);
+
+    return count;
+}
+
+
+// Topology (link condition) and fold-over tests for collapsing the edge
+// facing corner c into the given target.
+
+bool PMeshDecimator::canCollapse(int c, const float *target)
+{
+    int c2 = O[c];
+    int t1 = c / 3, t2 = c2 / 3;
+    int a = V[nextCorner(c)], b = V[prevCorner(c)];
+    int x = V[c], y = V[c2];
+    if (x == y)
+        return false;
+
+    int ringA[MaxRing], ringB[MaxRing], ringX[MaxRing];
+    int na = ring(a, ringA, MaxRing);
+    int nb = ring(b, ringB, MaxRing);
+    if (na < 0 || nb < 0 || na + nb - 4 > MaxRing)
+        return false;
+
+    // The only common neighbours of a and b may be x and y.
+    for (int i = 0; i < na; ++i)
+    {
+        int w = V[nextCorner(ringA[i])];
+        if (w == x || w == y)
+            continue;
+        for (int j = 0; j < nb; ++j)
+            if (V[nextCorner(ringB[j])] == w)
+                return false;
+    }
+
+    // x and y each lose an edge; keep them at valence three or more.
+    if (!locked[x] && ring(x, ringX, MaxRing) == 3)
+        return false;
+    if (!locked[y] && ring(y, ringX, MaxRing) == 3)
+        return false;
+
+    // No surviving face may fold over.
+    for (int r = 0; r < 2; ++r)
+    {
+        int *corners = r ? ringB : ringA;
+        int n = r ? nb : na;
+
+        for (int i = 0; i < n; ++i)
+        {
+            int k = corners[i];
+            if (k / 3 == t1 || k / 3 == t2)
+                continue;
+
+            const float *p = &pos[3*V[k]];
+            const float *u = &pos[3*V[nextCorner(k)]];
+            const float *w = &pos[3*V[prevCorner(k)]];
+
+            double e1[3] = {u[0] - p[0], u[1] - p[1], u[2] - p[2]};
+            double e2[3] = {w[0] - p[0], w[1] - p[1], w[2] - p[2]};
+            double f1[3] = {u[0] - target[0], u[1] - target[1],
+                u[2] - target[2]};
+            double f2[3] = {w[0] - target[0], w[1] - target[1],
+                w[2] - target[2]};
+
+            double n0[3] = {e1[1]*e2[2] - e1[2]*e2[1],
+                e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+            double n1[3] = {f1[1]*f2[2] - f1[2]*f2[1],
+                f1[2]*f2[0] - f1[0]*f2[2], f1[0]*f2[1] - f1[1]*f2[0]};
+
+            double dot = n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2];
+            double len0 = n0[0]*n0[0] + n0[1]*n0[1] + n0[2]*n0[2];
+            double len1 = n1[0]*n1[0] + n1[1]*n1[1] + n1[2]*n1[2];
+            if (len1 == 0.0 || dot <= MinCosFlip * sqrt(len0 * len1))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Merge vertex b into vertex a at the target position and remove the two
+// triangles on edge (a, b).
+
+void PMeshDecimator::collapse(int c, const float *target)
+{
+    int dying[2] = {c, O[c]};
+    int a = V[nextCorner(c)], b = V[prevCorner(c)];
+
+    int ringB[MaxRing];
+    int nb = ring(b, ringB, MaxRing);
+
+    // Make the outer neighbours of each dying triangle face each other.
+    for (int i = 0; i < 2; ++i)
+    {
+        int oi = O[nextCorner(dying[i])];
+        int oj = O[prevCorner(dying[i])];
+        if (oi >= 0)
+            O[oi] = oj;
+        if (oj >= 0)
+            O[oj] = oi;
+    }
+
+    for (int i = 0; i < nb; ++i)
+    {
+        int t = ringB[i] / 3;
+        if (t != dying[0] / 3 && t != dying[1] / 3)
+            V[ringB[i]] = a;
+    }
+
+    // Entry corners of a and of the two opposite vertices must lie in
+    // surviving triangles.
+    for (int i = 0; i < 2; ++i)
+    {
+        int d = dying[i];
+        int x = V[d];
+        int sides[2] = {O[nextCorner(d)], O[prevCorner(d)]};
+
+        for (int j = 0; j < 2; ++j)
+        {
+            int o = sides[j];
+            if (o < 0)
+                continue;
+            int q[2] = {nextCorner(o), prevCorner(o)};
+            for (int k = 0; k < 2; ++k)
+                if (V[q[k]] == x)
+                    vertexCorner[x] = q[k];
+                else if (V[q[k]] == a)
+                    vertexCorner[a] = q[k];
+        }
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        int t = 3 * (dying[i] / 3);
+        V[t] = V[t + 1] = V[t + 2] = -1;
+    }
+
+    vertexCorner[b] = -1;
+    pos[3*a] = target[0];
+    pos[3*a + 1] = target[1];
+    pos[3*a + 2] = target[2];
+    addQuadric(quadric[a], quadric[b]);
+}
+
+
+void PMeshDecimator::writeOutput()
+{
+    // Renumber the surviving vertices
+    vector<int> map(numVertices, -1);
+    int numPoints = 0;
+    for (int v = 0; v < numVertices; ++v)
+        if (vertexCorner[v] >= 0)
+            map[v] = numPoints++;
+
+    vtkPoints *points = vtkPoints::New();
+    points->SetDataTypeToFloat();
+    points->SetNumberOfPoints(numPoints);
+    float *p = static_cast<vtkFloatArray *>(points->GetData())->
+        GetPointer(0);
+    for (int v = 0; v < numVertices; ++v)
+        if (map[v] >= 0)
+        {
+            float *q = p + 3*map[v];
+            q[0] = pos[3*v] * scale + center[0];
+            q[1] = pos[3*v + 1] * scale + center[1];
+            q[2] = pos[3*v + 2] * scale + center[2];
+        }
+
+    int numCells = 0;
+    for (int t = 0; t < numTriangles; ++t)
+        if (V[3*t] >= 0)
+            ++numCells;
+
+    vtkCellArray *polys = vtkCellArray::New();
+    vtkIdType *cell = polys->WritePointer(numCells, 4 * numCells);
+    for (int t = 0; t < numTriangles; ++t)
+        if (V[3*t] >= 0)
+        {
+            *cell++ = 3;
+            *cell++ = map[V[3*t]];
+            *cell++ = map[V[3*t + 1]];
+            *cell++ = map[V[3*t + 2]];
+        }
+
+    output->Initialize();
+    output->SetPoints(points);
+    output->SetPolys(polys);
+    points->Delete();
+    polys->Delete();
+}
+
+
+void PMeshDecimator::releaseWorkspace()
+{
+    vector<float>().swap(pos);
+    vector<int>().swap(V);
+    vector<int>().swap(O);
+    vector<int>().swap(vertexCorner);
+    vector<unsigned char>().swap(locked);
+    vector<int>().swap(version);
+    vector<Quadric>().swap(quadric);
+    vector<HeapEntry>().swap(heap);
+    vector<unsigned char>().swap(queued);
+    vector<unsigned char>().swap(region);
+    vector<unsigned char>().swap(border);
+}
@@ -0,0 +1,106 @@
+/* PMeshDecimator.h
+
+   Quadric error mesh decimation.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PMESHDECIMATOR_H
+#define PMESHDECIMATOR_H
+
+#include "vtkPolyData.h"
+#include <vector>
+
+
+// Edge-collapse decimation driven by quadric error metrics (Garland and
+// Heckbert).  The mesh is held in a corner table, a compact half-edge
+// structure for triangle meshes: corner c sits in triangle c / 3, V[c] is
+// its vertex and O[c] is the opposite corner across the edge facing c.
+// Quadrics and edge costs are computed in parallel.  Most collapses are
+// then made in parallel inside slabs of the mesh, leaving the slab borders
+// alone, and a final serial pass over the whole mesh takes the rest.  Each
+// pass pops a lazily updated priority queue: stale entries are re-costed
+// when popped rather than when their vertices move.  Boundary and
+// non-manifold vertices are locked, so the topology of the input is
+// preserved.
+
+class PMeshDecimator
+{
+public:
+    PMeshDecimator();
+    ~PMeshDecimator();
+
+    void setInput(vtkPolyData *input);
+    void setTargetRatio(double ratio);  // Fraction of triangles kept
+    double getTargetRatio();
+    void update();
+    vtkPolyData *getOutput();
+
+    struct Quadric
+    {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    };
+
+    struct HeapEntry
+    {
+        float cost;
+        int corner;
+        int stamp;
+        bool operator<(const HeapEntry &e) const { return cost > e.cost; }
+    };
+
+protected:
+    friend struct PDecimatorTopologyKernel;
+    friend struct PDecimatorVertexKernel;
+    friend struct PDecimatorCostKernel;
+    friend struct PDecimatorRegionKernel;
+
+    vtkPolyData *input;
+    vtkPolyData *output;
+    double ratio;
+
+    // Input state at the last update
+    vtkPolyData *doneInput;
+    unsigned long doneTime;
+    double doneRatio;
+
+    // Working mesh in normalised coordinates
+    int numVertices, numTriangles;
+    double center[3], scale;
+    std::vector<float> pos;
+    std::vector<int> V, O;
+    std::vector<int> vertexCorner;
+    std::vector<unsigned char> locked;
+    std::vector<int> version;
+    std::vector<Quadric> quadric;
+    std::vector<HeapEntry> heap;
+    std::vector<unsigned char> queued;  // Corners with a heap entry
+
+    // Slabs decimated in parallel.  Vertices with a neighbour in another
+    // slab are frozen until the serial pass.
+    int numRegions;
+    bool freezeBorders;
+    std::vector<unsigned char> region, border;
+    std::vector<int> regionStart, regionQuota, regionDone;
+
+    // Vertex to corner incidence of the input, in CSR form
+    std::vector<int> firstCorner, incident;
+
+    // Supporting functions
+    void readInput();
+    void buildTopology();
+    void splitRegions();
+    void buildHeap();
+    void collapseEdges(int targetTriangles);
+    int collapseRange(std::vector<HeapEntry> &entries, int maxCollapses,
+        int stamp);
+    void writeOutput();
+    void releaseWorkspace();
+
+    bool edgeCost(int corner, float &cost, float *target);
+    bool canCollapse(int corner, const float *target);
+    void collapse(int corner, const float *target);
+    int ring(int v, int *corners, int maxCorners);
+};
+
+#endif
@@ -0,0 +1,459 @@
+/* PMeshPicker.cpp
+
+   Ray picking of mesh actors through bounding volume hierarchies.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PMeshPicker.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkFloatArray.h"
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#define LeafSize 4    // Triangles of a mesh tree leaf
+#define MaxDepth 64   // Of the traversal stack; median splits stay below
+
+
+// Supporting functions
+
+struct PCentreLess
+{
+    const float *centres;
+    int axis;
+
+    bool operator()(int a, int b) const
+    {
+        return centres[3 * a + axis] < centres[3 * b + axis];
+    }
+};
+
+
+struct PBvhVisit
+{
+    int node;
+    double enter;  // Distance at which the ray enters the node's box
+};
+
+
+// Moller-Trumbore: the ray origin + t dir against triangle v, two-sided.
+
+static inline bool hitTriangle(const double *origin, const double *dir,
+    const float *v, double &t)
+{
+    double e1[3], e2[3], s[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        e1[a] = v[3 + a] - v[a];
+        e2[a] = v[6 + a] - v[a];
+        s[a] = origin[a] - v[a];
+    }
+    double p[3] = { dir[1] * e2[2] - dir[2] * e2[1],
+                    dir[2] * e2[0] - dir[0] * e2[2],
+                    dir[0] * e2[1] - dir[1] * e2[0] };
+    double det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (det == 0.0)
+        return false;
+    double inv = 1.0 / det;
+    double u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+    if (u < 0.0 || u > 1.0)
+        return false;
+    double q[3] = { s[1] * e1[2] - s[2] * e1[1],
+                    s[2] * e1[0] - s[0] * e1[2],
+                    s[0] * e1[1] - s[1] * e1[0] };
+    double w = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * inv;
+    if (w < 0.0 || u + w > 1.0)
+        return false;
+    t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+    return t >= 0.0;
+}
+
+
+static void inverseDir(const double *dir, double *inverse)
+{
+    for (int a = 0; a < 3; ++a)
+        inverse[a] = 1.0 / dir[a];  // Infinite along axis-parallel rays
+}
+
+
+// PMeshBvh class
+
+PMeshBvh::PMeshBvh()
+{
+}
+
+
+void PMeshBvh::build(vtkPolyData *mesh)
+{
+    nodes.clear();
+    corners.clear();
+    cells.clear();
+    vtkPoints *points = mesh->GetPoints();
+    if (!points)
+        return;
+    const float *xyz = points->GetDataType() == VTK_FLOAT ?
+        static_cast<vtkFloatArray *>(points->GetData())->GetPointer(0) :
+        NULL;
+
+    vtkCellArray *polys = mesh->GetPolys();
+    const vtkIdType *p = polys->GetPointer();
+    const vtkIdType *end = p + polys->GetData()->GetNumberOfTuples();
+    int numTriangles = 0;
+    for (const vtkIdType *q = p; q < end; q += *q + 1)
+        numTriangles += max((int) *q - 2, 0);
+    std::vector<float> triangles;
+    std::vector<vtkIdType> triangleCells;
+    triangles.reserve(9 * numTriangles);
+    triangleCells.reserve(numTriangles);
+    for (vtkIdType c = 0; p < end; ++c, p += *p + 1)
+        for (vtkIdType k = 2; k < *p; ++k)  // Fan around the first corner
+        {
+            vtkIdType id[3] = { p[1], p[k], p[k + 1] };
+            for (int j = 0; j < 3; ++j)
+                if (xyz)
+                    triangles.insert(triangles.end(), xyz + 3 * id[j],
+                        xyz + 3 * id[j] + 3);
+                else
+                {
+                    double x[3];
+                    points->GetPoint(id[j], x);
+                    triangles.insert(triangles.end(), x, x + 3);
+                }
+            triangleCells.push_back(c);
+        }
+
+    std::vector<float> boxes(6 * numTriangles);
+    for (int i = 0; i < numTriangles; ++i)
+    {
+        const float *v = &triangles[9 * i];
+        float *box = &boxes[6 * i];
+        for (int a = 0; a < 3; ++a)
+        {
+            box[a] = min(v[a], min(v[3 + a], v[6 + a]));
+            box[3 + a] = max(v[a], max(v[3 + a], v[6 + a]));
+        }
+    }
+
+    std::vector<int> order;
+    buildTree(boxes, LeafSize, nodes, order);
+
+    corners.resize(9 * numTriangles);
+    cells.resize(numTriangles);
+    for (int i = 0; i < numTriangles; ++i)
+    {
+        copy(&triangles[9 * order[i]], &triangles[9 * order[i]] + 9,
+            &corners[9 * i]);
+        cells[i] = triangleCells[order[i]];
+    }
+}
+
+
+bool PMeshBvh::intersect(const double *origin, const double *dir,
+    double &t, vtkIdType &cellId)
+{
+    if (nodes.empty())
+        return false;
+
+    double inverse[3];
+    inverseDir(dir, inverse);
+    PBvhVisit stack[MaxDepth];
+    int top = 0;
+    stack[0].node = 0;
+    if (hitBox(nodes[0], origin, inverse, t, stack[0].enter))
+        top = 1;
+
+    bool hit = false;
+    while (top > 0)
+    {
+        PBvhVisit visit = stack[--top];
+        if (visit.enter > t)  // A nearer hit was found since
+            continue;
+        const PBvhNode &node = nodes[visit.node];
+        if (node.count == 0)
+        {
+            pushChildren(nodes, node, origin, inverse, t, stack, top);
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i)
+        {
+            double s;
+            if (hitTriangle(origin, dir, &corners[9 * i], s) && s < t)
+            {
+                t = s;
+                cellId = cells[i];
+                hit = true;
+            }
+        }
+    }
+    return hit;
+}
+
+
+// boxes holds the lower and upper corners of each primitive.  order is
+// the primitives in the order of the leaves.
+
+void PMeshBvh::buildTree(const std::vector<float> &boxes, int leafSize,
+    std::vector<PBvhNode> &nodes, std::vector<int> &order)
+{
+    int n = boxes.size() / 6;
+    nodes.clear();
+    order.resize(n);
+    if (n == 0)
+        return;
+
+    std::vector<float> centres(3 * n);
+    for (int i = 0; i < n; ++i)
+    {
+        order[i] = i;
+        for (int a = 0; a < 3; ++a)
+            centres[3 * i + a] = 0.5f * (boxes[6 * i + a] +
+                boxes[6 * i + 3 + a]);
+    }
+
+    // Ranges of order still to split, with their nodes
+    std::vector<int> pending;
+    nodes.reserve(2 * ((n + leafSize - 1) / leafSize));
+    nodes.push_back(PBvhNode());
+    pending.push_back(0);
+    pending.push_back(0);
+    pending.push_back(n);
+    while (!pending.empty())
+    {
+        int end = pending.back();
+        pending.pop_back();
+        int begin = pending.back();
+        pending.pop_back();
+        int index = pending.back();
+        pending.pop_back();
+
+        PBvhNode node;
+        float low[3], high[3];  // Of the centres
+        for (int a = 0; a < 3; ++a)
+        {
+            node.lower[a] = low[a] = HUGE_VAL;
+            node.upper[a] = high[a] = -HUGE_VAL;
+        }
+        for (int i = begin; i < end; ++i)
+        {
+            const float *box = &boxes[6 * order[i]];
+            const float *centre = &centres[3 * order[i]];
+            for (int a = 0; a < 3; ++a)
+            {
+                node.lower[a] = min(node.lower[a], box[a]);
+                node.upper[a] = max(node.upper[a], box[3 + a]);
+                low[a] = min(low[a], centre[a]);
+                high[a] = max(high[a], centre[a]);
+            }
+        }
+
+        int axis = 0;
+        for (int a = 1; a < 3; ++a)
+            if (high[a] - low[a] > high[axis] - low[axis])
+                axis = a;
+        if (end - begin <= leafSize || high[axis] <= low[axis])
+        {
+            node.first = begin;
+            node.count = end - begin;
+            nodes[index] = node;
+            continue;
+        }
+
+        int middle = (begin + end) / 2;
+        PCentreLess less;
+        less.centres = &centres[0];
+        less.axis = axis;
+        nth_element(order.begin() + begin, order.begin() + middle,
+            order.begin() + end, less);
+
+        node.first = nodes.size();
+        node.count = 0;
+        nodes[index] = node;
+        nodes.push_back(PBvhNode());
+        nodes.push_back(PBvhNode());
+        pending.push_back(node.first);
+        pending.push_back(begin);
+        pending.push_back(middle);
+        pending.push_back(node.first + 1);
+        pending.push_back(middle);
+        pending.push_back(end);
+    }
+}
+
+
+// Protected methods
+
+// Slab test of the ray against a node's box within [0, limit].  inverse
+// holds the reciprocals of the ray direction.
+
+bool PMeshBvh::hitBox(const PBvhNode &node, const double *origin,
+    const double *inverse, double limit, double &enter)
+{
+    double t0 = 0.0, t1 = limit;
+    for (int a = 0; a < 3; ++a)
+    {
+        double ta = (node.lower[a] - origin[a]) * inverse[a];
+        double tb = (node.upper[a] - origin[a]) * inverse[a];
+        if (ta > tb)
+            swap(ta, tb);
+        t0 = max(t0, ta);
+        t1 = min(t1, tb);
+        if (t0 > t1)
+            return false;
+    }
+    enter = t0;
+    return true;
+}
+
+
+// Pushes the children of node that the ray enters within limit, the
+// nearer last, so that it is visited first.
+
+void PMeshBvh::pushChildren(const std::vector<PBvhNode> &nodes,
+    const PBvhNode &node, const double *origin, const double *inverse,
+    double limit, PBvhVisit *stack, int &top)
+{
+    PBvhVisit l, r;
+    l.node = node.first;
+    r.node = node.first + 1;
+    bool hitLeft = hitBox(nodes[l.node], origin, inverse, limit, l.enter);
+    bool hitRight = hitBox(nodes[r.node], origin, inverse, limit, r.enter);
+    if (hitLeft && hitRight)
+    {
+        stack[top++] = l.enter < r.enter ? r : l;
+        stack[top++] = l.enter < r.enter ? l : r;
+    }
+    else if (hitLeft)
+        stack[top++] = l;
+    else if (hitRight)
+        stack[top++] = r;
+}
+
+
+// PMeshPicker class
+
+PMeshPicker::PMeshPicker()
+{
+    dirty = false;
+}
+
+
+void PMeshPicker::add(vtkActor *actor, PMeshBvh *bvh)
+{
+    actors.append(actor);
+    bvhs.append(bvh);
+    dirty = true;
+}
+
+
+void PMeshPicker::remove(vtkActor *actor)
+{
+    int i = actors.indexOf(actor);
+    if (i < 0)
+        return;
+    actors.removeAt(i);
+    bvhs.removeAt(i);
+    dirty = true;
+}
+
+
+void PMeshPicker::clear()
+{
+    actors.clear();
+    bvhs.clear();
+    nodes.clear();
+    order.clear();
+    dirty = false;
+}
+
+
+// The ray runs from the near to the far clipping plane through the
+// display point, so it also suits parallel projection.
+
+vtkActor *PMeshPicker::pick(vtkRenderer *renderer, int x, int y,
+    double *point)
+{
+    double ends[2][4];
+    for (int k = 0; k < 2; ++k)
+    {
+        renderer->SetDisplayPoint(x, y, k);
+        renderer->DisplayToWorld();
+        renderer->GetWorldPoint(ends[k]);
+        if (ends[k][3] == 0.0)
+            return NULL;
+        for (int a = 0; a < 3; ++a)
+            ends[k][a] /= ends[k][3];
+    }
+
+    double dir[3];
+    for (int a = 0; a < 3; ++a)
+        dir[a] = ends[1][a] - ends[0][a];
+    return intersect(ends[0], dir, point);
+}
+
+
+// Hits are searched between origin and origin + dir.
+
+vtkActor *PMeshPicker::intersect(const double *origin, const double *dir,
+    double *point)
+{
+    if (dirty)
+        build();
+    if (nodes.empty())
+        return NULL;
+
+    double t = 1.0, inverse[3];
+    inverseDir(dir, inverse);
+    PBvhVisit stack[MaxDepth];
+    int top = 0;
+    stack[0].node = 0;
+    if (PMeshBvh::hitBox(nodes[0], origin, inverse, t, stack[0].enter))
+        top = 1;
+
+    vtkActor *hit = NULL;
+    while (top > 0)
+    {
+        PBvhVisit visit = stack[--top];
+        if (visit.enter > t)
+            continue;
+        const PBvhNode &node = nodes[visit.node];
+        if (node.count == 0)
+        {
+            PMeshBvh::pushChildren(nodes, node, origin, inverse, t, stack,
+                top);
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i)
+        {
+            int k = order[i];
+            vtkIdType cellId;
+            if (actors[k]->GetVisibility() &&
+                bvhs[k]->intersect(origin, dir, t, cellId))
+                hit = actors[k];
+        }
+    }
+
+    if (hit)
+        for (int a = 0; a < 3; ++a)
+            point[a] = origin[a] + t * dir[a];
+    return hit;
+}
+
+
+// Protected methods
+
+void PMeshPicker::build()
+{
+    std::vector<float> boxes(6 * actors.size(), 0.0f);
+    for (int i = 0; i < actors.size(); ++i)
+        if (!bvhs[i]->nodes.empty())  // Else an empty box at the origin
+        {
+            const PBvhNode &root = bvhs[i]->nodes[0];
+            copy(root.lower, root.lower + 3, &boxes[6 * i]);
+            copy(root.upper, root.upper + 3, &boxes[6 * i + 3]);
+        }
+    PMeshBvh::buildTree(boxes, 1, nodes, order);
+    dirty = false;
+}
@@ -0,0 +1,93 @@
+/* PMeshPicker.h
+
+   Ray picking of mesh actors through bounding volume hierarchies.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PMESHPICKER_H
+#define PMESHPICKER_H
+
+#include <QList>
+#include <vector>
+#include "vtkActor.h"
+#include "vtkPolyData.h"
+#include "vtkRenderer.h"
+
+
+// Picking is two-level.  Each mesh has a PMeshBvh over its triangles,
+// built once, off the GUI thread if need be, as it does not change.  The
+// picker keeps a small tree over the bounds of the meshes of its actors,
+// rebuilt when actors are added or removed, and follows a ray through
+// both trees to the nearest triangle of a visible actor, hit exactly by
+// the Moller-Trumbore test.  Actors are assumed to have no transform, as
+// the viewers place none.
+//
+// Trees split their boxes at the median of the longest axis of their
+// centres, down to LeafSize primitives, and are traversed nearer child
+// first, skipping boxes beyond the nearest hit so far.
+
+struct PBvhVisit;
+
+class PBvhNode
+{
+    friend class PMeshBvh;
+    friend class PMeshPicker;
+    float lower[3], upper[3];
+    int first;  // First primitive of a leaf, or first child
+    int count;  // Primitives of a leaf, or 0
+};
+
+
+class PMeshBvh
+{
+    friend class PMeshPicker;
+
+public:
+    PMeshBvh();
+
+    void build(vtkPolyData *mesh);  // Polygons are split into fans
+    bool intersect(const double *origin, const double *dir, double &t,
+        vtkIdType &cellId);  // Nearest hit with t below the given t
+
+    static void buildTree(const std::vector<float> &boxes, int leafSize,
+        std::vector<PBvhNode> &nodes, std::vector<int> &order);
+
+protected:
+    std::vector<PBvhNode> nodes;
+    std::vector<float> corners;    // 9 per triangle, in tree order
+    std::vector<vtkIdType> cells;  // Cell of each triangle
+
+    static bool hitBox(const PBvhNode &node, const double *origin,
+        const double *inverse, double limit, double &enter);
+    static void pushChildren(const std::vector<PBvhNode> &nodes,
+        const PBvhNode &node, const double *origin, const double *inverse,
+        double limit, PBvhVisit *stack, int &top);
+};
+
+
+class PMeshPicker
+{
+public:
+    PMeshPicker();
+
+    void add(vtkActor *actor, PMeshBvh *bvh);
+    void remove(vtkActor *actor);
+    void clear();
+
+    // Actor hit at display point (x, y), or NULL.  point is the hit.
+    vtkActor *pick(vtkRenderer *renderer, int x, int y, double *point);
+    vtkActor *intersect(const double *origin, const double *dir,
+        double *point);
+
+protected:
+    QList<vtkActor *> actors;
+    QList<PMeshBvh *> bvhs;
+    std::vector<PBvhNode> nodes;  // Over the meshes
+    std::vector<int> order;
+    bool dirty;  // Actors changed since the tree was built
+
+    void build();
+};
+
+#endif
@@ -0,0 +1,850 @@
+/* PMeshReader.cpp
+
+   Fast reader of OBJ, PLY and STL meshes.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PMeshReader.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QByteArray>
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkFloatArray.h"
+#include "vtkUnsignedCharArray.h"
+#include "vtkPointData.h"
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+using namespace std;
+
+#define MaxExponent 22  // Powers of 10 up to this are exact in double
+
+
+// Text scanning.  The mapped file is not terminated, so every scan stops
+// at end.
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+static inline bool isSpace(char c)
+{
+    return isBlank(c) || c == '\n';
+}
+
+
+static inline bool isDigit(char c)
+{
+    return (unsigned) (c - '0') < 10;
+}
+
+
+static inline const char *skipBlank(const char *p, const char *end)
+{
+    while (p < end && isBlank(*p))
+        ++p;
+    return p;
+}
+
+
+static inline const char *skipSpace(const char *p, const char *end)
+{
+    while (p < end && isSpace(*p))
+        ++p;
+    return p;
+}
+
+
+static inline const char *nextLine(const char *p, const char *end)
+{
+    const char *q = (const char *) memchr(p, '\n', end - p);
+    return q ? q + 1 : end;
+}
+
+
+static inline bool startsWith(const char *p, const char *end,
+    const char *word)
+{
+    size_t n = strlen(word);
+    return (size_t) (end - p) > n && !memcmp(p, word, n) && isBlank(p[n]);
+}
+
+
+// Scan a decimal number at p.  Up to 18 significant digits are gathered
+// in an integer and scaled by an exact power of 10 once, which is exact
+// for the short numbers mesh files hold.  Other forms, such as inf
+// and nan, are left to strtod.  Returns the end of the number, or NULL
+// if there is none.
+
+static const char *scanNumber(const char *p, const char *end, double &value)
+{
+    static const double power[MaxExponent + 1] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    unsigned long long mantissa = 0;
+    int digits = 0, scale = 0;
+    bool hasDigits = false;
+    for (; p < end && isDigit(*p); ++p, hasDigits = true)
+        if (digits < 18)
+        {
+            mantissa = 10 * mantissa + (*p - '0');
+            digits += mantissa != 0;  // Leading zeros are not significant
+        }
+        else
+            ++scale;
+    if (p < end && *p == '.')
+        for (++p; p < end && isDigit(*p); ++p, hasDigits = true)
+            if (digits < 18)
+            {
+                mantissa = 10 * mantissa + (*p - '0');
+                digits += mantissa != 0;
+                --scale;
+            }
+
+    if (hasDigits && p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool negativeExp = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExp = *q++ == '-';
+        if (q < end && isDigit(*q))
+        {
+            int exponent = 0;
+            for (; q < end && isDigit(*q); ++q)
+                if (exponent < 10000)
+                    exponent = 10 * exponent + (*q - '0');
+            scale += negativeExp ? -exponent : exponent;
+            p = q;
+        }
+    }
+
+    if (hasDigits && (p == end || isSpace(*p)) &&
+        scale >= -MaxExponent && scale <= MaxExponent)
+    {
+        double v = (double) mantissa;
+        v = scale < 0 ? v / power[-scale] : v * power[scale];
+        value = negative ? -v : v;
+        return p;
+    }
+
+    // Rare forms
+    char buffer[64];
+    int n = 0;
+    for (p = start; p < end && !isSpace(*p) && n < 63; ++p)
+        buffer[n++] = *p;
+    buffer[n] = '\0';
+    char *stop;
+    value = strtod(buffer, &stop);
+    return stop == buffer ? NULL : start + (stop - buffer);
+}
+
+
+static const char *scanInt(const char *p, const char *end, long &value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p == end || !isDigit(*p))
+        return NULL;
+
+    long v = 0;
+    for (; p < end && isDigit(*p); ++p)
+        v = 10 * v + (*p - '0');
+    value = negative ? -v : v;
+    return p;
+}
+
+
+// PLY elements
+
+enum { PlyChar, PlyUChar, PlyShort, PlyUShort, PlyInt, PlyUInt, PlyFloat,
+    PlyDouble };
+
+static const int PlySize[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+
+struct PPlyProperty
+{
+    QByteArray name;
+    int type;
+    int countType;  // Type of the count of a list, or -1
+};
+
+
+struct PPlyElement
+{
+    QByteArray name;
+    int count;
+    QList<PPlyProperty> properties;
+
+    int find(const char *name) const
+    {
+        for (int i = 0; i < properties.size(); ++i)
+            if (properties[i].name == name)
+                return i;
+        return -1;
+    }
+};
+
+
+static int plyType(const QByteArray &name)
+{
+    static const char *names[] = { "char", "uchar", "short", "ushort",
+        "int", "uint", "float", "double", "int8", "uint8", "int16",
+        "uint16", "int32", "uint32", "float32", "float64" };
+    for (int i = 0; i < 16; ++i)
+        if (name == names[i])
+            return i % 8;
+    return -1;
+}
+
+
+template <class T>
+static inline double loadValue(const char *p)
+{
+    T v;
+    memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+
+static inline double plyValue(const char *p, int type, bool swap)
+{
+    char b[8];
+    if (swap)
+    {
+        int size = PlySize[type];
+        for (int i = 0; i < size; ++i)
+            b[i] = p[size - 1 - i];
+        p = b;
+    }
+
+    switch (type)
+    {
+        case PlyChar:   return loadValue<signed char>(p);
+        case PlyUChar:  return loadValue<unsigned char>(p);
+        case PlyShort:  return loadValue<short>(p);
+        case PlyUShort: return loadValue<unsigned short>(p);
+        case PlyInt:    return loadValue<int>(p);
+        case PlyUInt:   return loadValue<unsigned int>(p);
+        case PlyFloat:  return loadValue<float>(p);
+        default:        return loadValue<double>(p);
+    }
+}
+
+
+// Walk one binary record.  values receives each scalar property and the
+// length of each list, and lists the start of each list.  Returns the end
+// of the record, or NULL if it runs past end.
+
+static const char *plyRecord(const char *p, const char *end,
+    const PPlyElement &element, bool swap, double *values,
+    const char **lists)
+{
+    for (int i = 0; i < element.properties.size(); ++i)
+    {
+        const PPlyProperty &property = element.properties[i];
+        if (property.countType < 0)
+        {
+            if (end - p < PlySize[property.type])
+                return NULL;
+            values[i] = plyValue(p, property.type, swap);
+            p += PlySize[property.type];
+        }
+        else
+        {
+            if (end - p < PlySize[property.countType])
+                return NULL;
+            double n = plyValue(p, property.countType, swap);
+            p += PlySize[property.countType];
+            if (n < 0.0 || n * PlySize[property.type] > end - p)
+                return NULL;
+            values[i] = n;
+            lists[i] = p;
+            p += (size_t) n * PlySize[property.type];
+        }
+    }
+    return p;
+}
+
+
+// Scan one ASCII record.  The items of list faceList are appended to ids
+// as a cell; other lists are read and dropped.
+
+static const char *plyAsciiRecord(const char *p, const char *end,
+    const PPlyElement &element, double *values, int faceList,
+    vector<vtkIdType> &ids)
+{
+    for (int i = 0; i < element.properties.size(); ++i)
+    {
+        p = scanNumber(skipSpace(p, end), end, values[i]);
+        if (!p)
+            return NULL;
+        if (element.properties[i].countType < 0)
+            continue;
+
+        int n = (int) values[i];
+        if (i == faceList)
+            ids.push_back(n);
+        for (int k = 0; k < n; ++k)
+        {
+            double v;
+            p = scanNumber(skipSpace(p, end), end, v);
+            if (!p)
+                return NULL;
+            if (i == faceList)
+                ids.push_back((vtkIdType) v);
+        }
+    }
+    return p;
+}
+
+
+// PMeshReader class
+
+PMeshReader::PMeshReader()
+{
+    output = vtkPolyData::New();
+    begin = end = NULL;
+}
+
+
+PMeshReader::~PMeshReader()
+{
+    output->Delete();
+}
+
+
+bool PMeshReader::isSupported(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    return suffix == "obj" || suffix == "ply" || suffix == "stl";
+}
+
+
+void PMeshReader::setFileName(const QString &name)
+{
+    fileName = name;
+}
+
+
+bool PMeshReader::update()
+{
+    output->Initialize();
+
+    QFile file(fileName);
+    uchar *map = NULL;
+    if (file.open(QIODevice::ReadOnly) && file.size() > 0)
+        map = file.map(0, file.size());
+    if (!map)
+    {
+        cerr << "Error in update: cannot read " <<
+            fileName.toAscii().data() << ".\n" << flush;
+        return false;
+    }
+    begin = (const char *) map;
+    end = begin + file.size();
+
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    bool ok = false;
+    if (suffix == "ply")
+        ok = readPly();
+    else if (suffix == "stl")
+        ok = readStl();
+    else if (suffix == "obj")
+        ok = readObj();
+    file.unmap(map);
+    begin = end = NULL;
+
+    if (!ok || !checkCells(output))
+    {
+        cerr << "Error in update: cannot parse " <<
+            fileName.toAscii().data() << ".\n" << flush;
+        output->Initialize();
+        return false;
+    }
+    return true;
+}
+
+
+vtkPolyData *PMeshReader::getOutput()
+{
+    return output;
+}
+
+
+// Supporting methods
+
+bool PMeshReader::readPly()
+{
+    if (end - begin < 4 || memcmp(begin, "ply", 3) || !isSpace(begin[3]))
+        return false;
+
+    // Header
+    const char *p = nextLine(begin, end);
+    int format = -1;  // 0: ascii, 1: little endian, 2: big endian
+    QList<PPlyElement> elements;
+    for (;;)
+    {
+        if (p == end)
+            return false;
+        const char *next = nextLine(p, end);
+        QList<QByteArray> words =
+            QByteArray(p, next - p).simplified().split(' ');
+        p = next;
+
+        if (words[0] == "end_header")
+            break;
+        if (words[0] == "format" && words.size() >= 2)
+        {
+            if (words[1] == "ascii")
+                format = 0;
+            else if (words[1] == "binary_little_endian")
+                format = 1;
+            else if (words[1] == "binary_big_endian")
+                format = 2;
+        }
+        else if (words[0] == "element" && words.size() >= 3)
+        {
+            PPlyElement element;
+            element.name = words[1];
+            bool ok;
+            element.count = words[2].toInt(&ok);
+            if (!ok || element.count < 0)
+                return false;
+            elements.append(element);
+        }
+        else if (words[0] == "property" && !elements.isEmpty())
+        {
+            PPlyProperty property;
+            if (words.size() >= 5 && words[1] == "list")
+            {
+                property.countType = plyType(words[2]);
+                property.type = plyType(words[3]);
+                property.name = words[4];
+                if (property.countType < 0)
+                    return false;
+            }
+            else if (words.size() >= 3)
+            {
+                property.countType = -1;
+                property.type = plyType(words[1]);
+                property.name = words[2];
+            }
+            else
+                return false;
+            if (property.type < 0)
+                return false;
+            elements.last().properties.append(property);
+        }
+    }
+    if (format < 0)
+        return false;
+    bool swap = format == (Q_BYTE_ORDER == Q_BIG_ENDIAN ? 1 : 2);
+
+    vtkPoints *points = vtkPoints::New();
+    points->SetDataTypeToFloat();
+    vtkCellArray *polys = vtkCellArray::New();
+    vtkUnsignedCharArray *colors = NULL;
+    bool ok = true;
+
+    for (int e = 0; ok && e < elements.size(); ++e)
+    {
+        const PPlyElement &element = elements[e];
+        int numProperties = element.properties.size();
+        vector<double> values(numProperties + 1);
+        vector<const char *> lists(numProperties + 1);
+        bool fixedSize = true;
+        int recordSize = 0;
+        for (int i = 0; i < numProperties; ++i)
+        {
+            fixedSize = fixedSize && element.properties[i].countType < 0;
+            recordSize += PlySize[element.properties[i].type];
+        }
+
+        int xyz[3] = { element.find("x"), element.find("y"),
+            element.find("z") };
+        int rgb[3] = { element.find("red"), element.find("green"),
+            element.find("blue") };
+        int faceList = element.find("vertex_indices");
+        if (faceList < 0)
+            faceList = element.find("vertex_index");
+        vector<vtkIdType> none;  // Lists of other elements
+
+        if (element.name == "vertex" && xyz[0] >= 0 && xyz[1] >= 0 &&
+            xyz[2] >= 0)
+        {
+            points->SetNumberOfPoints(element.count);
+            float *out = static_cast<vtkFloatArray *>(points->GetData())->
+                GetPointer(0);
+            bool hasColor = rgb[0] >= 0 && rgb[1] >= 0 && rgb[2] >= 0;
+            for (int k = 0; k < 3; ++k)
+                hasColor = hasColor &&
+                    element.properties[rgb[k]].type == PlyUChar;
+            unsigned char *color = NULL;
+            if (hasColor)
+            {
+                colors = vtkUnsignedCharArray::New();
+                colors->SetName("RGB");
+                colors->SetNumberOfComponents(3);
+                colors->SetNumberOfTuples(element.count);
+                color = colors->GetPointer(0);
+            }
+
+            // Offsets of the coordinates in a fixed-size binary record
+            int offset[3] = { 0, 0, 0 };
+            bool packed = fixedSize && format > 0 && !swap;
+            for (int k = 0; k < 3; ++k)
+            {
+                for (int i = 0; i < xyz[k]; ++i)
+                    offset[k] += PlySize[element.properties[i].type];
+                packed = packed &&
+                    element.properties[xyz[k]].type == PlyFloat &&
+                    offset[k] == offset[0] + 4 * k;
+            }
+
+            if (packed && !hasColor)
+            {
+                // Coordinates copied in bulk
+                if ((double) recordSize * element.count > end - p)
+                    ok = false;
+                else if (recordSize == 12)
+                    memcpy(out, p, 12 * (size_t) element.count);
+                else
+                    for (int v = 0; v < element.count; ++v)
+                        memcpy(out + 3*v, p + (size_t) v * recordSize +
+                            offset[0], 12);
+                p += (size_t) recordSize * element.count;
+            }
+            else
+                for (int v = 0; ok && v < element.count; ++v)
+                {
+                    p = format > 0 ?
+                        plyRecord(p, end, element, swap, &values[0],
+                            &lists[0]) :
+                        plyAsciiRecord(p, end, element, &values[0], -1,
+                            none);
+                    ok = p != NULL;
+                    for (int k = 0; ok && k < 3; ++k)
+                    {
+                        out[3*v + k] = (float) values[xyz[k]];
+                        if (hasColor)
+                            color[3*v + k] =
+                                (unsigned char) values[rgb[k]];
+                    }
+                }
+        }
+        else if (element.name == "face" && faceList >= 0 && format > 0)
+        {
+            // Size the cell array in a first pass over the records.
+            const char *q = p;
+            vtkIdType size = 0;
+            for (int f = 0; q && f < element.count; ++f)
+            {
+                q = plyRecord(q, end, element, swap, &values[0],
+                    &lists[0]);
+                size += (vtkIdType) values[faceList] + 1;
+            }
+            ok = q != NULL;
+
+            vtkIdType *cell = ok ?
+                polys->WritePointer(element.count, size) : NULL;
+            int type = element.properties[faceList].type;
+            int typeSize = PlySize[type];
+            for (int f = 0; ok && f < element.count; ++f)
+            {
+                p = plyRecord(p, end, element, swap, &values[0],
+                    &lists[0]);
+                int n = (int) values[faceList];
+                const char *list = lists[faceList];
+                *cell++ = n;
+                for (int k = 0; k < n; ++k)
+                    *cell++ = (vtkIdType) plyValue(list + k * typeSize,
+                        type, swap);
+            }
+        }
+        else if (element.name == "face" && faceList >= 0)
+        {
+            vector<vtkIdType> ids;
+            ids.reserve(4 * (size_t) element.count);
+            for (int f = 0; p && f < element.count; ++f)
+                p = plyAsciiRecord(p, end, element, &values[0], faceList,
+                    ids);
+            ok = p != NULL;
+            if (ok)
+                memcpy(polys->WritePointer(element.count, ids.size()),
+                    &ids[0], ids.size() * sizeof(vtkIdType));
+        }
+        else  // Skipped
+        {
+            if (format > 0 && fixedSize)
+            {
+                ok = (double) recordSize * element.count <= end - p;
+                p += ok ? (size_t) recordSize * element.count : 0;
+            }
+            else
+                for (int r = 0; p && r < element.count; ++r)
+                    p = format > 0 ?
+                        plyRecord(p, end, element, swap, &values[0],
+                            &lists[0]) :
+                        plyAsciiRecord(p, end, element, &values[0], -1,
+                            none);
+            ok = ok && p != NULL;
+        }
+    }
+
+    output->SetPoints(points);
+    output->SetPolys(polys);
+    if (colors)
+    {
+        output->GetPointData()->SetScalars(colors);
+        colors->Delete();
+    }
+    points->Delete();
+    polys->Delete();
+    return ok;
+}
+
+
+// Binary STL is told from ASCII by its size, as binary files may also
+// start with "solid".
+
+bool PMeshReader::readStl()
+{
+    qint64 size = end - begin;
+    unsigned int count = 0;
+    if (size >= 84)
+    {
+        memcpy(&count, begin + 80, 4);
+        if (Q_BYTE_ORDER == Q_BIG_ENDIAN)
+            count = (count >> 24) | ((count >> 8) & 0xff00) |
+                ((count << 8) & 0xff0000) | (count << 24);
+    }
+    bool binary = size >= 84 && 84 + 50 * (qint64) count == size;
+    if (!binary && (size < 5 || memcmp(begin, "solid", 5)))
+        binary = size >= 84 && 84 + 50 * (qint64) count <= size;
+
+    vector<float> corners;
+    if (binary)
+    {
+        // Triangles are 50 bytes: the normal, 3 corners and 2 spare bytes.
+        corners.resize(9 * (size_t) count);
+        for (unsigned int t = 0; t < count; ++t)
+            memcpy(&corners[9*t], begin + 84 + 50 * (size_t) t + 12, 36);
+        if (Q_BYTE_ORDER == Q_BIG_ENDIAN)
+            for (size_t i = 0; i < corners.size(); ++i)
+            {
+                char *b = (char *) &corners[i];
+                swap(b[0], b[3]);
+                swap(b[1], b[2]);
+            }
+    }
+    else if (size >= 5 && !memcmp(begin, "solid", 5))
+    {
+        for (const char *p = begin; p < end; p = nextLine(p, end))
+        {
+            p = skipBlank(p, end);
+            if (!startsWith(p, end, "vertex"))
+                continue;
+            const char *q = p + 6;
+            for (int k = 0; k < 3; ++k)
+            {
+                double v;
+                q = scanNumber(skipBlank(q, end), end, v);
+                if (!q)
+                    return false;
+                corners.push_back((float) v);
+            }
+        }
+        if (corners.size() % 9)
+            return false;
+    }
+    else
+        return false;
+
+    mergeCorners(corners.empty() ? NULL : &corners[0], corners.size() / 9);
+    return true;
+}
+
+
+// Texture coordinates, normals, groups and materials are skipped.
+// Indices are 1-based, or relative to the last vertex if negative.
+
+bool PMeshReader::readObj()
+{
+    vector<float> coords;
+    vector<vtkIdType> ids;
+    int numCells = 0;
+
+    for (const char *p = begin; p < end; p = nextLine(p, end))
+    {
+        p = skipBlank(p, end);
+        if (startsWith(p, end, "v"))
+        {
+            const char *q = p + 1;
+            for (int k = 0; k < 3; ++k)
+            {
+                double v;
+                q = scanNumber(skipBlank(q, end), end, v);
+                if (!q)
+                    return false;
+                coords.push_back((float) v);
+            }
+        }
+        else if (startsWith(p, end, "f"))
+        {
+            long numPoints = coords.size() / 3;
+            size_t start = ids.size();
+            ids.push_back(0);
+            const char *q = p + 1;
+            for (;;)
+            {
+                q = skipBlank(q, end);
+                if (q == end || *q == '\n' || *q == '#')
+                    break;
+                long index;
+                q = scanInt(q, end, index);
+                if (!q)
+                    return false;
+                ids.push_back(index < 0 ? numPoints + index : index - 1);
+                while (q < end && !isSpace(*q))  // Skip /vt/vn.
+                    ++q;
+            }
+
+            int n = ids.size() - start - 1;
+            if (n < 3)
+                ids.resize(start);
+            else
+            {
+                ids[start] = n;
+                ++numCells;
+            }
+        }
+    }
+
+    vtkPoints *points = vtkPoints::New();
+    points->SetDataTypeToFloat();
+    points->SetNumberOfPoints(coords.size() / 3);
+    if (!coords.empty())
+        memcpy(static_cast<vtkFloatArray *>(points->GetData())->
+            GetPointer(0), &coords[0], coords.size() * sizeof(float));
+
+    vtkCellArray *polys = vtkCellArray::New();
+    if (!ids.empty())
+        memcpy(polys->WritePointer(numCells, ids.size()), &ids[0],
+            ids.size() * sizeof(vtkIdType));
+
+    output->SetPoints(points);
+    output->SetPolys(polys);
+    points->Delete();
+    polys->Delete();
+    return true;
+}
+
+
+static inline unsigned int hashPoint(const float *p)
+{
+    unsigned int h = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        float f = p[k] + 0.0f;  // -0 hashes as 0
+        unsigned int bits;
+        memcpy(&bits, &f, 4);
+        h = (h ^ bits) * 0x9e3779b1u;
+        h ^= h >> 15;
+    }
+    return h;
+}
+
+
+// Exactly coincident corners become one point, in a linear-probing hash
+// table of point ids.
+
+void PMeshReader::mergeCorners(const float *corners, int numTriangles)
+{
+    int numCorners = 3 * numTriangles;
+    vtkPoints *points = vtkPoints::New();
+    points->SetDataTypeToFloat();
+    points->SetNumberOfPoints(numCorners);
+    float *out = static_cast<vtkFloatArray *>(points->GetData())->
+        GetPointer(0);
+    vtkCellArray *polys = vtkCellArray::New();
+    vtkIdType *cell = polys->WritePointer(numTriangles, 4 * numTriangles);
+
+    unsigned int mask = 1;
+    while (mask < 2 * (unsigned int) numCorners)
+        mask *= 2;
+    vector<int> table(mask, -1);
+    mask -= 1;
+
+    int numPoints = 0;
+    for (int c = 0; c < numCorners; ++c)
+    {
+        const float *p = corners + 3*c;
+        if (c % 3 == 0)
+            *cell++ = 3;
+
+        unsigned int h = hashPoint(p) & mask;
+        int id;
+        for (;; h = (h + 1) & mask)
+        {
+            id = table[h];
+            if (id < 0)
+            {
+                id = table[h] = numPoints++;
+                memcpy(out + 3*id, p, 12);
+                break;
+            }
+            const float *q = out + 3*id;
+            if (q[0] == p[0] && q[1] == p[1] && q[2] == p[2])
+                break;
+        }
+        *cell++ = id;
+    }
+
+    points->SetNumberOfPoints(numPoints);
+    points->Squeeze();
+    output->SetPoints(points);
+    output->SetPolys(polys);
+    points->Delete();
+    polys->Delete();
+}
+
+
+// Also checks meshes unpacked from cache files and bundles, which may be
+// damaged.
+
+bool PMeshReader::checkCells(vtkPolyData *mesh)
+{
+    vtkIdType numPoints = mesh->GetNumberOfPoints();
+    vtkCellArray *polys = mesh->GetPolys();
+    vtkIdTypeArray *data = polys->GetData();
+    const vtkIdType *id = data->GetPointer(0);
+    const vtkIdType *last = id + data->GetNumberOfTuples();
+    vtkIdType numCells = 0;
+
+    while (id < last)
+    {
+        vtkIdType n = *id++;
+        if (n < 0 || n > last - id)
+            return false;
+        for (; n > 0; --n, ++id)
+            if (*id < 0 || *id >= numPoints)
+                return false;
+        ++numCells;
+    }
+    return numCells == polys->GetNumberOfCells();
+}
@@ -0,0 +1,50 @@
+/* PMeshReader.h
+
+   Fast reader of OBJ, PLY and STL meshes.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PMESHREADER_H
+#define PMESHREADER_H
+
+#include <QString>
+#include "vtkPolyData.h"
+
+
+// The file is memory-mapped and parsed in place.  Binary PLY and STL are
+// copied in bulk straight into preallocated VTK arrays.  ASCII numbers
+// are scanned by hand rather than by the C library, which is slow and
+// depends on the locale; ASCII files are collected in growing buffers and
+// copied into the VTK arrays once.  Coincident STL corners are merged, as
+// vtkSTLReader does, so that normals can be smoothed across triangles,
+// and PLY vertex colours become the point scalars, as vtkPLYReader makes
+// them.  Other attributes are skipped, as the viewers compute normals.
+
+class PMeshReader
+{
+public:
+    PMeshReader();
+    ~PMeshReader();
+
+    static bool isSupported(const QString &fileName);  // obj, ply or stl
+    void setFileName(const QString &name);
+    bool update();  // False if the file cannot be read or parsed
+    vtkPolyData *getOutput();
+
+    // True if every cell lies inside the polygons and indexes existing
+    // points, and the number of cells is right.
+    static bool checkCells(vtkPolyData *mesh);
+
+protected:
+    QString fileName;
+    vtkPolyData *output;
+    const char *begin, *end;  // Mapped file
+
+    bool readPly();
+    bool readStl();
+    bool readObj();
+    void mergeCorners(const float *corners, int numTriangles);
+};
+
+#endif
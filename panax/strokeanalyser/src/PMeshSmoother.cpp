@@ -0,0 +1,334 @@
+/* PMeshSmoother.cpp
+
+   Taubin mesh smoothing.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PMeshSmoother.h"
+#include "PParallel.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkFloatArray.h"
+
+#include <algorithm>
+using namespace std;
+
+#define PassBand 0.1  // Taubin's k_PB; mu follows from it and lambda
+
+
+// Parallel kernels
+
+// Sort and merge the neighbour list of each vertex.  Every edge of a
+// closed manifold is listed twice at each end, once per triangle, so a
+// neighbour seen any other number of times marks a boundary or
+// non-manifold vertex.
+
+struct PSmootherAdjacencyKernel
+{
+    PMeshSmoother *s;
+
+    void operator()(int begin, int end)
+    {
+        for (int v = begin; v < end; ++v)
+        {
+            int *first = &s->neighbour[0] + s->firstNeighbour[v];
+            int *last = &s->neighbour[0] + s->firstNeighbour[v + 1];
+            sort(first, last);
+
+            int count = 0;
+            bool fixed = false;
+            for (int *p = first; p < last; )
+            {
+                int *q = p;
+                while (q < last && *q == *p)
+                    ++q;
+                fixed = fixed || q - p != 2;
+                first[count++] = *p;
+                p = q;
+            }
+
+            s->degree[v] = count;
+            s->fixed[v] = fixed;
+        }
+    }
+};
+
+
+struct PSmootherReadKernel
+{
+    PMeshSmoother *s;
+    vtkPoints *points;
+
+    void operator()(int begin, int end)
+    {
+        for (int v = begin; v < end; ++v)
+        {
+            double p[3];
+            points->GetPoint(v, p);
+            s->x[0][v] = p[0];
+            s->y[0][v] = p[1];
+            s->z[0][v] = p[2];
+        }
+    }
+};
+
+
+// One pass: move each vertex by weight times its umbrella vector.
+
+struct PSmootherPassKernel
+{
+    PMeshSmoother *s;
+    int from;
+    float weight;
+
+    void operator()(int begin, int end)
+    {
+        const float *x = &s->x[from][0];
+        const float *y = &s->y[from][0];
+        const float *z = &s->z[from][0];
+        float *nx = &s->x[1 - from][0];
+        float *ny = &s->y[1 - from][0];
+        float *nz = &s->z[1 - from][0];
+        const int *neighbour = &s->neighbour[0];
+
+        for (int v = begin; v < end; ++v)
+        {
+            int n = s->degree[v];
+            if (n == 0 || s->fixed[v])
+            {
+                nx[v] = x[v];
+                ny[v] = y[v];
+                nz[v] = z[v];
+                continue;
+            }
+
+            const int *w = neighbour + s->firstNeighbour[v];
+            float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+            for (int i = 0; i < n; ++i)
+            {
+                sx += x[w[i]];
+                sy += y[w[i]];
+                sz += z[w[i]];
+            }
+
+            float k = weight / n;
+            nx[v] = x[v] + k * sx - weight * x[v];
+            ny[v] = y[v] + k * sy - weight * y[v];
+            nz[v] = z[v] + k * sz - weight * z[v];
+        }
+    }
+};
+
+
+struct PSmootherWriteKernel
+{
+    PMeshSmoother *s;
+    int from;
+    float *points;
+
+    void operator()(int begin, int end)
+    {
+        for (int v = begin; v < end; ++v)
+        {
+            points[3*v] = s->x[from][v];
+            points[3*v + 1] = s->y[from][v];
+            points[3*v + 2] = s->z[from][v];
+        }
+    }
+};
+
+
+// PMeshSmoother class
+
+PMeshSmoother::PMeshSmoother()
+{
+    input = NULL;
+    output = vtkPolyData::New();
+    factor = 0.1;
+    iterations = 1;
+    doneInput = NULL;
+    doneTime = 0;
+    doneFactor = -1.0;
+    doneIterations = -1;
+    adjacencyInput = NULL;
+    adjacencyTime = 0;
+    numVertices = 0;
+}
+
+
+PMeshSmoother::~PMeshSmoother()
+{
+    output->Delete();
+}
+
+
+void PMeshSmoother::setInput(vtkPolyData *in)
+{
+    input = in;
+}
+
+
+void PMeshSmoother::setRelaxationFactor(double f)
+{
+    factor = qBound(0.0, f, 1.0);
+}
+
+
+double PMeshSmoother::getRelaxationFactor()
+{
+    return factor;
+}
+
+
+void PMeshSmoother::setNumberOfIterations(int n)
+{
+    iterations = qMax(0, n);
+}
+
+
+int PMeshSmoother::getNumberOfIterations()
+{
+    return iterations;
+}
+
+
+vtkPolyData *PMeshSmoother::getOutput()
+{
+    return output;
+}
+
+
+// Smooth the input unless nothing has changed since the last call.  The
+// adjacency is rebuilt only when the input has.
+
+void PMeshSmoother::update()
+{
+    if (!input)
+        return;
+
+    unsigned long time = input->GetMTime();
+    if (input == doneInput && time == doneTime && factor == doneFactor &&
+        iterations == doneIterations)
+        return;
+
+    if (input != adjacencyInput || time != adjacencyTime)
+    {
+        buildAdjacency();
+        adjacencyInput = input;
+        adjacencyTime = time;
+    }
+
+    readPoints();
+
+    // Shrink by lambda, then inflate by mu < -lambda.
+    double lambda = factor;
+    double mu = lambda / (PassBand * lambda - 1.0);
+    int from = 0;
+    if (lambda > 0.0)
+        for (int i = 0; i < iterations; ++i)
+        {
+            smooth(from, lambda);
+            smooth(1 - from, mu);
+        }
+
+    writeOutput(from);
+
+    doneInput = input;
+    doneTime = time;
+    doneFactor = factor;
+    doneIterations = iterations;
+}
+
+
+void PMeshSmoother::buildAdjacency()
+{
+    vtkPoints *points = input->GetPoints();
+    numVertices = points ? points->GetNumberOfPoints() : 0;
+    vtkCellArray *polys = input->GetPolys();
+
+    // Count, then list, both ends of every polygon edge.
+    firstNeighbour.assign(numVertices + 1, 0);
+    vtkIdType npts, *pts;
+    for (polys->InitTraversal(); polys->GetNextCell(npts, pts); )
+        for (int j = 0; j < npts; ++j)
+        {
+            ++firstNeighbour[pts[j] + 1];
+            ++firstNeighbour[pts[(j + 1) % npts] + 1];
+        }
+    for (int v = 0; v < numVertices; ++v)
+        firstNeighbour[v + 1] += firstNeighbour[v];
+
+    neighbour.resize(firstNeighbour[numVertices]);
+    vector<int> fill(firstNeighbour.begin(), firstNeighbour.end() - 1);
+    for (polys->InitTraversal(); polys->GetNextCell(npts, pts); )
+        for (int j = 0; j < npts; ++j)
+        {
+            int a = pts[j], b = pts[(j + 1) % npts];
+            neighbour[fill[a]++] = b;
+            neighbour[fill[b]++] = a;
+        }
+
+    degree.resize(numVertices);
+    fixed.resize(numVertices);
+    PSmootherAdjacencyKernel adjacencyKernel;
+    adjacencyKernel.s = this;
+    parallelFor(numVertices, adjacencyKernel, 1024);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        x[i].resize(numVertices);
+        y[i].resize(numVertices);
+        z[i].resize(numVertices);
+    }
+}
+
+
+void PMeshSmoother::readPoints()
+{
+    if (numVertices == 0)
+        return;
+
+    PSmootherReadKernel readKernel;
+    readKernel.s = this;
+    readKernel.points = input->GetPoints();
+    parallelFor(numVertices, readKernel);
+}
+
+
+// Smooth from buffer "from" into the other buffer.
+
+void PMeshSmoother::smooth(int from, double weight)
+{
+    if (numVertices == 0)
+        return;
+
+    PSmootherPassKernel passKernel;
+    passKernel.s = this;
+    passKernel.from = from;
+    passKernel.weight = (float) weight;
+    parallelFor(numVertices, passKernel);
+}
+
+
+void PMeshSmoother::writeOutput(int from)
+{
+    vtkPoints *points = vtkPoints::New();
+    points->SetDataTypeToFloat();
+    points->SetNumberOfPoints(numVertices);
+
+    if (numVertices > 0)
+    {
+        PSmootherWriteKernel writeKernel;
+        writeKernel.s = this;
+        writeKernel.from = from;
+        writeKernel.points = static_cast<vtkFloatArray *>(points->GetData())->
+            GetPointer(0);
+        parallelFor(numVertices, writeKernel);
+    }
+
+    output->Initialize();
+    output->SetPoints(points);
+    output->SetPolys(input->GetPolys());
+    points->Delete();
+}
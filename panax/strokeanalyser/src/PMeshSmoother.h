@@ -0,0 +1,71 @@
+/* PMeshSmoother.h
+
+   Taubin mesh smoothing.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PMESHSMOOTHER_H
+#define PMESHSMOOTHER_H
+
+#include "vtkPolyData.h"
+#include <vector>
+
+
+// Laplacian smoothing in Taubin's lambda/mu form, which does not shrink the
+// mesh.  Vertex adjacency is built once per input in CSR form (the
+// neighbours of v are neighbour[firstNeighbour[v]] onwards) and kept, so
+// changing the relaxation factor or the number of iterations only reruns
+// the passes.  Positions are held as separate x, y and z arrays and each
+// pass runs in parallel over the vertices.  Boundary and non-manifold
+// vertices stay in place.  The output shares the polygons of the input.
+
+class PMeshSmoother
+{
+public:
+    PMeshSmoother();
+    ~PMeshSmoother();
+
+    void setInput(vtkPolyData *input);
+    void setRelaxationFactor(double factor);
+    double getRelaxationFactor();
+    void setNumberOfIterations(int iterations);
+    int getNumberOfIterations();
+    void update();
+    vtkPolyData *getOutput();
+
+protected:
+    friend struct PSmootherAdjacencyKernel;
+    friend struct PSmootherReadKernel;
+    friend struct PSmootherPassKernel;
+    friend struct PSmootherWriteKernel;
+
+    vtkPolyData *input;
+    vtkPolyData *output;
+    double factor;
+    int iterations;
+
+    // Input state at the last update
+    vtkPolyData *doneInput;
+    unsigned long doneTime;
+    double doneFactor;
+    int doneIterations;
+
+    // Adjacency, valid for adjacencyInput at adjacencyTime
+    vtkPolyData *adjacencyInput;
+    unsigned long adjacencyTime;
+    int numVertices;
+    std::vector<int> firstNeighbour, degree, neighbour;
+    std::vector<unsigned char> fixed;
+
+    // Positions, double buffered
+    std::vector<float> x[2], y[2], z[2];
+
+    // Supporting functions
+    void buildAdjacency();
+    void readPoints();
+    void smooth(int from, double weight);
+    void writeOutput(int from);
+};
+
+#endif
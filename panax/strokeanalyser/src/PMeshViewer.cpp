@@ -8,21 +8,17 @@
 
 #include "PMeshViewer.h"
 #include <QtGui>
+#include <QtConcurrentMap>
+#include <QFutureWatcher>
 #include "vtkCommand.h"
 #include "vtkOBJReader.h"
 #include "vtkPLYReader.h"
 #include "vtkSTLReader.h"
-#include "vtkPLYWriter.h"
-#include "vtkSTLWriter.h"
-#include "vtkWindowToImageFilter.h"
-#include "vtkJPEGWriter.h"
-#include "vtkPNGWriter.h"
-#include "vtkTIFFWriter.h"
+#include "PMeshWriter.h"
 #include "vtkCamera.h"
 #include "vtkProperty.h"
 #include "vtkCellArray.h"
 
-#include <unistd.h>
 using namespace std;
 
 
@@ -54,6 +50,15 @@ PMeshViewer::PMeshViewer()
     loaded = false;
     hideFrontFace = 0;
     
+    // Movies are rendered by batchrender beside this program
+    movieRenderer = new PBatchRenderer;
+    movieRenderer->setProgram(QCoreApplication::applicationDirPath() +
+        "/batchrender");
+    connect(movieRenderer, SIGNAL(progress(int, int)),
+        this, SLOT(showMovieProgress(int, int)));
+    connect(movieRenderer, SIGNAL(finished(int)),
+        this, SLOT(movieFinished(int)));
+    
     // Create GUI
     createWidgets();
     createActions();
@@ -61,12 +66,20 @@ PMeshViewer::PMeshViewer()
     createToolBars();
     createStatusBar();
     initSize();
+
+    // Screenshots are written in the background
+    imageSaver = new PImageSaver;
+    connect(imageSaver, SIGNAL(message(const QString &)),
+        statusBar(), SLOT(showMessage(const QString &)));
 }
 
 
 PMeshViewer::~PMeshViewer()
 {
+    delete movieRenderer;
+    delete imageSaver;
     uninstallPipeline();
+    delete lod;
     style->Delete();
 }
 
@@ -125,6 +138,14 @@ void PMeshViewer::createWidgets()
     style = vtkInteractorStyleTrackballCamera::New();
     interactor->SetInteractorStyle(style);
 
+    // Draw decimated meshes while the camera moves.
+    lod = new PLodManager(this);
+    lod->setInteractorStyle(style);
+
+    // Blink meshes without blocking the event loop.
+    highlighter = new PHighlighter(this);
+    highlighter->setRenderWindow(renderWindow);
+
     PMeshViewerCallback *callback = PMeshViewerCallback::New();
     callback->viewer = this;
     interactor->AddObserver(vtkCommand::RightButtonPressEvent, callback);
@@ -268,6 +289,12 @@ void PMeshViewer::createActions()
     saveViewAction->setStatusTip(tr("Save current view to a file"));
     connect(saveViewAction, SIGNAL(triggered()), this, SLOT(saveView()));
     
+    exportMovieAction = new QAction(tr("Export &Movie"), this);
+    exportMovieAction->setStatusTip(
+        tr("Render a turntable movie of the visible meshes"));
+    connect(exportMovieAction, SIGNAL(triggered()),
+        this, SLOT(exportMovie()));
+    
     frontFaceAction = new QAction(tr("&Hide Front Faces"), this);
     frontFaceAction->setIcon(QIcon(":/images/hide.png"));
     frontFaceAction->setShortcut(tr("Shift+H"));
@@ -356,6 +383,7 @@ void PMeshViewer::createMenus()
 
     viewMenu = menuBar()->addMenu(tr("&View"));
     viewMenu->addAction(saveViewAction);
+    viewMenu->addAction(exportMovieAction);
     viewMenu->addAction(frontFaceAction);
     
     meshModeMenu = viewMenu->addMenu(tr("&Mesh Mode"));
@@ -496,6 +524,8 @@ void PMeshViewer::deleteMesh()
     {
         meshTable->removeRow(i);
         renderer->RemoveActor(meshList[i].actor);
+        lod->remove(meshList[i].actor);
+        highlighter->stop(meshList[i].actor);
         meshList[i].normals->Delete();
         meshList[i].mapper->Delete();
         meshList[i].actor->Delete();
@@ -508,45 +538,13 @@ void PMeshViewer::deleteMesh()
 
 void PMeshViewer::saveDirPly()
 {
-    QString dirName = QFileDialog::getExistingDirectory(this,
-        tr("Save visible meshes into a directory in PLY format"), ".");
-        
-    if (!dirName.isEmpty() && !meshList.isEmpty())
-    {
-        for (int i = 0; i < meshList.size(); ++i)
-            if (meshList[i].actor->GetVisibility())
-            {
-                QString fileName = dirName + QString("/%1.ply").
-                    arg(i, 8, 10, QChar('0'));
-                vtkPLYWriter *writer = vtkPLYWriter::New();
-                writer->SetFileName(fileName.toAscii().data());
-                writer->SetInput(meshList[i].data);
-                writer->Update();
-                writer->Delete();
-            }
-    }
+    saveDir(tr("Save visible meshes into a directory in PLY format"), "ply");
 }
 
 
 void PMeshViewer::saveDirStl()
 {
-    QString dirName = QFileDialog::getExistingDirectory(this,
-        tr("Save visible meshes into a directory in STL format"), ".");
-        
-    if (!dirName.isEmpty() && !meshList.isEmpty())
-    {
-        for (int i = 0; i < meshList.size(); ++i)
-            if (meshList[i].actor->GetVisibility())
-            {
-                QString fileName = dirName + QString("/%1.stl").
-                    arg(i, 8, 10, QChar('0'));
-                vtkSTLWriter *writer = vtkSTLWriter::New();
-                writer->SetFileName(fileName.toAscii().data());
-                writer->SetInput(meshList[i].data);
-                writer->Update();
-                writer->Delete();
-            }
-    }
+    saveDir(tr("Save visible meshes into a directory in STL format"), "stl");
 }
 
 
@@ -566,6 +564,81 @@ void PMeshViewer::saveView()
 }
 
 
+// The visible meshes that were loaded from files are rendered with their
+// colours by batchrender, from a job file beside the movie.  Frames are
+// rendered offscreen in parallel child processes.
+
+void PMeshViewer::exportMovie()
+{
+    if (!loaded)
+        return;
+        
+    if (movieRenderer->isRunning())
+    {
+        QMessageBox::information(this, appName,
+            "A movie is still being exported.");
+        return;
+    }
+    
+    highlighter->clear();  // Put back the colours of blinking meshes
+    QStringList meshes, colors;
+    for (int i = 0; i < meshList.size(); ++i)
+    {
+        if (!meshList[i].actor->GetVisibility() ||
+            meshList[i].source.isEmpty())
+            continue;
+        double red, green, blue;
+        meshList[i].actor->GetProperty()->GetColor(red, green, blue);
+        meshes << meshList[i].source;
+        colors << QColor::fromRgbF(red, green, blue).name();
+    }
+    if (meshes.isEmpty())
+        return;
+    
+    bool ok;
+    int frames = QInputDialog::getInt(this, appName, "Number of frames:",
+        36, 2, 720, 1, &ok);
+    if (!ok)
+        return;
+        
+    QString fileName = QFileDialog::getSaveFileName(this,
+        tr("Export movie"), ".",
+        tr("Movie files (*.mp4 *.avi);;Image sequences (*.png *.jpg *.tif)"));
+    if (fileName.isEmpty())
+        return;
+        
+    QFileInfo info(fileName);
+    QString jobFile = info.absolutePath() + "/" + info.completeBaseName() +
+        ".ini";
+    QSettings job(jobFile, QSettings::IniFormat);
+    job.clear();
+    job.setValue("input/meshes", meshes);
+    job.setValue("render/colors", colors);
+    job.setValue("render/width", vtkWidget->width());
+    job.setValue("render/height", vtkWidget->height());
+    PBatchRenderer::setCamera(job, renderer->GetActiveCamera());
+    job.setValue("camera/turntable", frames);
+    PBatchRenderer::setOutput(job, fileName);
+    job.sync();
+    
+    movieRenderer->start(QStringList(jobFile));
+}
+
+
+void PMeshViewer::showMovieProgress(int done, int total)
+{
+    statusBar()->showMessage(QString("Exporting movie: %1 of %2 parts done").
+        arg(done).arg(total));
+}
+
+
+void PMeshViewer::movieFinished(int failed)
+{
+    statusBar()->showMessage(failed ? "Movie export failed" :
+        "Movie exported", 5000);
+}
+
+
 void PMeshViewer::toggleFrontFace()
 {
     if (meshList.isEmpty())
@@ -782,6 +855,7 @@ void PMeshViewer::setColor(int row, int col)
     double red = color.red() / 255.0;
     double green = color.green() / 255.0;
     double blue = color.blue() / 255.0;
+    highlighter->stop(meshList[row].actor);
     meshList[row].actor->GetProperty()->SetColor(red, green, blue);
     renderWindow->Render();
 }
@@ -791,21 +865,7 @@ void PMeshViewer::blink(int row, int col)
 {
     if (col < 2)
         return;
-        
-    double red, green, blue, r, g, b;
-    vtkProperty *property = meshList[row].actor->GetProperty();
-    property->GetColor(red, green, blue);
-    r = g = b = 0.5;
-    
-    for (int i = 0; i < 2; ++i)
-    {
-        property->SetColor(r, g, b);
-        renderWindow->Render();
-        usleep(250000);
-        property->SetColor(red, green, blue);
-        renderWindow->Render();
-        usleep(250000);
-    }
+    highlighter->start(meshList[row].actor);
 }
 
 
@@ -854,6 +914,8 @@ void PMeshViewer::uninstallPipeline()
         renderer = NULL;
     }
     
+    lod->clear();
+    highlighter->clear();
     for (int i = 0; i < meshList.size(); ++i)
     {
         meshList[i].normals->Delete();
@@ -927,6 +989,7 @@ void PMeshViewer::addMesh(const QStringList &fileNames)
         part.mapper->Update();
         part.actor = vtkActor::New();
         part.actor->SetMapper(part.mapper);
+        lod->add(part.actor, part.data);
         meshList.append(part);
         reader->Delete();
 
@@ -970,33 +1033,72 @@ void PMeshViewer::addMesh(const QStringList &fileNames)
 }
 
 
+// The visible meshes are written in the global thread pool, one per
+// task, while a progress dialog runs the event loop.  Cancelling stops
+// meshes not yet started; the files already written are kept.
+
+void PMeshViewer::saveDir(const QString &title, const QString &suffix)
+{
+    QString dirName = QFileDialog::getExistingDirectory(this, title, ".");
+    if (dirName.isEmpty() || meshList.isEmpty())
+        return;
+
+    QList<PMeshExport> jobs;
+    for (int i = 0; i < meshList.size(); ++i)
+        if (meshList[i].actor->GetVisibility())
+        {
+            PMeshExport job;
+            job.fileName = dirName + QString("/%1.%2").
+                arg(i, 8, 10, QChar('0')).arg(suffix);
+            job.mesh = meshList[i].data;
+            jobs.append(job);
+        }
+    if (jobs.isEmpty())
+        return;
+
+    QProgressDialog progress(tr("Saving meshes..."), tr("Cancel"), 0,
+        jobs.size(), this);
+    progress.setWindowModality(Qt::WindowModal);
+    QFutureWatcher<bool> watcher;
+    connect(&watcher, SIGNAL(progressValueChanged(int)),
+        &progress, SLOT(setValue(int)));
+    connect(&watcher, SIGNAL(finished()), &progress, SLOT(reset()));
+    connect(&progress, SIGNAL(canceled()), &watcher, SLOT(cancel()));
+    watcher.setFuture(QtConcurrent::mapped(jobs, writeMesh));
+    progress.exec();
+    watcher.waitForFinished();
+
+    int numSaved = 0;
+    for (int i = 0; i < jobs.size(); ++i)
+        if (watcher.future().isResultReadyAt(i) && watcher.resultAt(i))
+            ++numSaved;
+    statusBar()->showMessage(QString("%1 of %2 meshes saved").
+        arg(numSaved).arg(jobs.size()), 2000);
+}
+
+
+// Runs in the global thread pool.  Errors are reported by the writer.
+
+bool PMeshViewer::writeMesh(const PMeshExport &job)
+{
+    PMeshWriter writer;
+    writer.setFileName(job.fileName);
+    writer.setInput(job.mesh);
+    return writer.update();
+}
+
+
 bool PMeshViewer::saveImage(const QString &fileName)
 {
-    vtkWindowToImageFilter *filter = vtkWindowToImageFilter::New();
-    filter->SetInput(vtkWidget->GetRenderWindow());
-
-    QString suffix = QFileInfo(fileName).suffix();
-    vtkImageWriter *writer;
-
-    if (suffix == "jpg")
-        writer = vtkJPEGWriter::New();
-    else if (suffix == "png")
-        writer = vtkPNGWriter::New();
-    else if (suffix == "tif")
-        writer = vtkTIFFWriter::New();
-    else
+    if (!PImageSaver::isSupported(fileName))
     {
         QMessageBox::critical(this, appName,
-            QString("File type %1 is unsupported.").arg(suffix));
+            QString("File type %1 is unsupported.").
+            arg(QFileInfo(fileName).suffix()));
         return false;
     }
 
-    writer->SetInput(filter->GetOutput());
-    writer->SetFileName(fileName.toAscii().data());
-    writer->Write();
-    writer->Delete();
-    filter->Delete();
-    return true;
+    return imageSaver->save(vtkWidget->GetRenderWindow(), fileName);
 }
 
 
@@ -25,6 +25,10 @@ class QComboBox;
 #include "vtkRenderWindowInteractor.h"
 #include "vtkInteractorStyleTrackballCamera.h"
 #include "vtkPropPicker.h"
+#include "PBatchRenderer.h"
+#include "PImageSaver.h"
+#include "PHighlighter.h"
+#include "PLodManager.h"
 
 
 class PMeshPart
@@ -40,6 +44,14 @@ class PMeshPart
 };
 
 
+class PMeshExport
+{
+    friend class PMeshViewer;
+    QString fileName;
+    vtkPolyData *mesh;
+};
+
+
 class PMeshViewer: public QMainWindow
 {
     Q_OBJECT
@@ -73,6 +85,9 @@ protected slots:
     void saveDirPly();
     void saveDirStl();
     void saveView();
+    void exportMovie();
+    void showMovieProgress(int done, int total);
+    void movieFinished(int failed);
     void toggleFrontFace();
     void setMeshMode(int);
     void setSmoothSurface();
@@ -106,6 +121,7 @@ protected:
     QAction *saveDirStlAction;
     QAction *exitAction;
     QAction *saveViewAction;
+    QAction *exportMovieAction;
     QAction *frontFaceAction;
     QAction *smoothSurfaceAction;
     QAction *flatSurfaceAction;
@@ -139,6 +155,10 @@ protected:
     vtkRenderWindow *renderWindow;
     vtkRenderWindowInteractor *interactor;
     vtkInteractorStyleTrackballCamera *style;
+    PLodManager *lod;
+    PBatchRenderer *movieRenderer;
+    PImageSaver *imageSaver;
+    PHighlighter *highlighter;
     
     // Internal variables.
     QString appName;
@@ -154,6 +174,8 @@ protected:
     void loadMesh(const QStringList &fileNames);
     void addMesh(const QStringList &fileNames);
     bool saveImage(const QString &fileName);
+    void saveDir(const QString &title, const QString &suffix);
+    static bool writeMesh(const PMeshExport &job);
 };
 
 #endif
\ No newline at end of file
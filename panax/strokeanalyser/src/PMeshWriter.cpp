@@ -0,0 +1,260 @@
+/* PMeshWriter.cpp
+
+   Fast writer of binary PLY and STL meshes.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PMeshWriter.h"
+#include <QFileInfo>
+#include <QByteArray>
+#include <QtEndian>
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkFloatArray.h"
+#include "vtkUnsignedCharArray.h"
+#include "vtkPointData.h"
+
+#include <iostream>
+#include <cstring>
+#include <cmath>
+using namespace std;
+
+#define BufferSize (1 << 20)
+#define MaxCorners 255  // Of a PLY face, whose count is a uchar
+
+
+// xyz is the point array if the points are floats, or NULL.
+
+static inline void getPoint(vtkPoints *points, const float *xyz,
+    vtkIdType i, float *x)
+{
+    if (xyz)
+    {
+        x[0] = xyz[3 * i];
+        x[1] = xyz[3 * i + 1];
+        x[2] = xyz[3 * i + 2];
+    }
+    else
+    {
+        double p[3];
+        points->GetPoint(i, p);
+        x[0] = (float) p[0];
+        x[1] = (float) p[1];
+        x[2] = (float) p[2];
+    }
+}
+
+
+static const float *floatPoints(vtkPoints *points)
+{
+    if (points->GetDataType() != VTK_FLOAT)
+        return NULL;
+    return static_cast<vtkFloatArray *>(points->GetData())->GetPointer(0);
+}
+
+
+// PMeshWriter class
+
+PMeshWriter::PMeshWriter()
+{
+    input = NULL;
+    used = 0;
+    ok = true;
+}
+
+
+bool PMeshWriter::isSupported(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    return suffix == "ply" || suffix == "stl";
+}
+
+
+void PMeshWriter::setFileName(const QString &name)
+{
+    fileName = name;
+}
+
+
+void PMeshWriter::setInput(vtkPolyData *mesh)
+{
+    input = mesh;
+}
+
+
+bool PMeshWriter::update()
+{
+    if (!input || !input->GetPoints() || !isSupported(fileName))
+    {
+        cerr << "Error in update: no mesh or unsupported format for " <<
+            fileName.toAscii().data() << "\n" << flush;
+        return false;
+    }
+
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        cerr << "Error in update: cannot write " <<
+            fileName.toAscii().data() << "\n" << flush;
+        return false;
+    }
+
+    buffer.resize(BufferSize);
+    used = 0;
+    ok = true;
+    if (QFileInfo(fileName).suffix().toLower() == "ply")
+        writePly();
+    else
+        writeStl();
+    flushBuffer();
+    file.close();
+
+    if (!ok)
+    {
+        cerr << "Error in update: cannot write " <<
+            fileName.toAscii().data() << "\n" << flush;
+        file.remove();
+    }
+    return ok;
+}
+
+
+// Protected methods
+
+void PMeshWriter::writePly()
+{
+    vtkPoints *points = input->GetPoints();
+    vtkIdType numPoints = points->GetNumberOfPoints();
+    const float *xyz = floatPoints(points);
+    vtkDataArray *scalars = input->GetPointData()->GetScalars();
+    const unsigned char *rgb = NULL;
+    if (scalars && scalars->GetDataType() == VTK_UNSIGNED_CHAR &&
+        scalars->GetNumberOfComponents() == 3)
+        rgb = static_cast<vtkUnsignedCharArray *>(scalars)->GetPointer(0);
+
+    vtkCellArray *polys = input->GetPolys();
+    vtkIdType numCells = polys->GetNumberOfCells();
+    const vtkIdType *ids = polys->GetPointer();
+    vtkIdType numFaces = 0;
+    const vtkIdType *p = ids;
+    for (vtkIdType c = 0; c < numCells; ++c, p += *p + 1)
+        if (*p >= 3 && *p <= MaxCorners)
+            ++numFaces;
+
+    QByteArray header("ply\nformat ");
+    header += Q_BYTE_ORDER == Q_BIG_ENDIAN ? "binary_big_endian" :
+        "binary_little_endian";
+    header += " 1.0\nelement vertex " + QByteArray::number(numPoints) +
+        "\nproperty float x\nproperty float y\nproperty float z\n";
+    if (rgb)
+        header += "property uchar red\nproperty uchar green\n"
+            "property uchar blue\n";
+    header += "element face " + QByteArray::number(numFaces) +
+        "\nproperty list uchar int vertex_indices\nend_header\n";
+    put(header.constData(), header.size());
+
+    char record[1 + 4 * MaxCorners];
+    float x[3];
+    for (vtkIdType i = 0; i < numPoints; ++i)
+    {
+        getPoint(points, xyz, i, x);
+        memcpy(record, x, 12);
+        if (rgb)
+            memcpy(record + 12, rgb + 3 * i, 3);
+        put(record, rgb ? 15 : 12);
+    }
+
+    p = ids;
+    for (vtkIdType c = 0; c < numCells; ++c, p += *p + 1)
+    {
+        int n = (int) *p;
+        if (n < 3 || n > MaxCorners)
+            continue;
+        record[0] = (char) n;
+        for (int k = 0; k < n; ++k)
+        {
+            qint32 id = (qint32) p[k + 1];
+            memcpy(record + 1 + 4 * k, &id, 4);
+        }
+        put(record, 1 + 4 * n);
+    }
+}
+
+
+void PMeshWriter::writeStl()
+{
+    vtkPoints *points = input->GetPoints();
+    const float *xyz = floatPoints(points);
+    vtkCellArray *polys = input->GetPolys();
+    vtkIdType numCells = polys->GetNumberOfCells();
+    const vtkIdType *ids = polys->GetPointer();
+
+    quint32 numTriangles = 0;
+    const vtkIdType *p = ids;
+    for (vtkIdType c = 0; c < numCells; ++c, p += *p + 1)
+        if (*p >= 3)
+            numTriangles += (quint32) (*p - 2);
+
+    char header[80];
+    memset(header, 0, sizeof(header));
+    strcpy(header, "Panax binary STL");
+    put(header, 80);
+    quint32 count = qToLittleEndian(numTriangles);
+    put(&count, 4);
+
+    // A record is the facet normal, 3 corners and a zero attribute.
+    char record[50];
+    float v[12];
+    memset(record, 0, sizeof(record));
+    p = ids;
+    for (vtkIdType c = 0; c < numCells; ++c, p += *p + 1)
+        for (vtkIdType k = 2; k < *p; ++k)  // Fan around the first corner
+        {
+            getPoint(points, xyz, p[1], v + 3);
+            getPoint(points, xyz, p[k], v + 6);
+            getPoint(points, xyz, p[k + 1], v + 9);
+
+            float a[3], b[3];
+            for (int j = 0; j < 3; ++j)
+            {
+                a[j] = v[6 + j] - v[3 + j];
+                b[j] = v[9 + j] - v[3 + j];
+            }
+            v[0] = a[1] * b[2] - a[2] * b[1];
+            v[1] = a[2] * b[0] - a[0] * b[2];
+            v[2] = a[0] * b[1] - a[1] * b[0];
+            float length = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            if (length > 0.0f)
+                for (int j = 0; j < 3; ++j)
+                    v[j] /= length;
+
+            memcpy(record, v, 48);
+            if (Q_BYTE_ORDER == Q_BIG_ENDIAN)
+                for (int j = 0; j < 12; ++j)
+                {
+                    quint32 w;
+                    memcpy(&w, record + 4 * j, 4);
+                    w = qToLittleEndian(w);
+                    memcpy(record + 4 * j, &w, 4);
+                }
+            put(record, 50);
+        }
+}
+
+
+void PMeshWriter::put(const void *data, int size)
+{
+    if (used + size > (int) buffer.size())
+        flushBuffer();
+    memcpy(&buffer[used], data, size);
+    used += size;
+}
+
+
+void PMeshWriter::flushBuffer()
+{
+    if (used > 0 && ok)
+        ok = file.write(&buffer[0], used) == used;
+    used = 0;
+}
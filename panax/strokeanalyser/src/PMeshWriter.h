@@ -0,0 +1,49 @@
+/* PMeshWriter.h
+
+   Fast writer of binary PLY and STL meshes.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PMESHWRITER_H
+#define PMESHWRITER_H
+
+#include <QString>
+#include <QFile>
+#include <vector>
+#include "vtkPolyData.h"
+
+
+// Records are packed into a buffer of BufferSize bytes that is written
+// to the file each time it fills, so a mesh is written in a few large
+// writes, without VTK's per-value output.  PLY files keep the point
+// colours, if any, and are written in the byte order of the machine; STL
+// files are little-endian, with polygons split into triangle fans and
+// facet normals computed.  The input is only read, so meshes can be
+// written from several threads at once, each by its own writer.
+
+class PMeshWriter
+{
+public:
+    PMeshWriter();
+
+    static bool isSupported(const QString &fileName);  // ply or stl
+    void setFileName(const QString &name);
+    void setInput(vtkPolyData *mesh);
+    bool update();  // False if the file cannot be written
+
+protected:
+    QString fileName;
+    vtkPolyData *input;
+    QFile file;
+    std::vector<char> buffer;
+    int used;  // Bytes of buffer
+    bool ok;
+
+    void writePly();
+    void writeStl();
+    void put(const void *data, int size);
+    void flushBuffer();
+};
+
+#endif
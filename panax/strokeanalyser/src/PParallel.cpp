@@ -0,0 +1,32 @@
+/* PParallel.cpp
+
+   Parallel loop over an index range for the mesh and volume engines.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PParallel.h"
+#include <QThread>
+
+
+static QThreadPool *createPool()
+{
+    QThreadPool *pool = new QThreadPool;
+
+    // The calling thread also works, so leave one core for it.
+    pool->setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+    return pool;
+}
+
+
+QThreadPool *parallelPool()
+{
+    static QThreadPool *pool = createPool();  // Guarded by the compiler.
+    return pool;
+}
+
+
+int parallelThreadCount()
+{
+    return parallelPool()->maxThreadCount() + 1;
+}
@@ -0,0 +1,76 @@
+/* PParallel.h
+
+   Parallel loop over an index range for the mesh and volume engines.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PPARALLEL_H
+#define PPARALLEL_H
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+
+
+// Kernels run on a pool of their own, separate from the global pool used
+// for background jobs, so a background job may call parallelFor() without
+// starving itself.  Kernels must not call parallelFor() recursively.
+
+QThreadPool *parallelPool();
+int parallelThreadCount();  // Pool threads plus the calling thread
+
+
+template <class Kernel>
+class PRangeTask: public QRunnable
+{
+public:
+    PRangeTask(Kernel *k, int b, int e, QSemaphore *s)
+    { kernel = k;    begin = b;    end = e;    done = s; }
+
+    void run()
+    {
+        (*kernel)(begin, end);
+        done->release();
+    }
+
+protected:
+    Kernel *kernel;
+    int begin, end;
+    QSemaphore *done;
+};
+
+
+// Split [0, n) into chunks of at least grain items and call
+// kernel(begin, end) on each chunk.  The calling thread runs the first
+// chunk itself and returns when all chunks are done.
+
+template <class Kernel>
+void parallelFor(int n, Kernel &kernel, int grain = 4096)
+{
+    if (n <= 0)
+        return;
+
+    QThreadPool *pool = parallelPool();
+    int numChunks = qMin(4 * parallelThreadCount(), (n + grain - 1) / grain);
+    if (numChunks <= 1)
+    {
+        kernel(0, n);
+        return;
+    }
+
+    int chunk = (n + numChunks - 1) / numChunks;
+    QSemaphore done;
+    int numTasks = 0;
+    for (int begin = chunk; begin < n; begin += chunk)
+    {
+        pool->start(new PRangeTask<Kernel>(&kernel, begin,
+            qMin(begin + chunk, n), &done));
+        ++numTasks;
+    }
+
+    kernel(0, chunk);
+    done.acquire(numTasks);
+}
+
+#endif
@@ -0,0 +1,1030 @@
+/* PRayCastMapper.cpp
+
+   Multi-threaded CPU ray casting volume mapper.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PRayCastMapper.h"
+#include "PParallel.h"
+#include "vtkObjectFactory.h"
+#include "vtkRenderer.h"
+#include "vtkCamera.h"
+#include "vtkVolume.h"
+#include "vtkVolumeProperty.h"
+#include "vtkMatrix4x4.h"
+#include "vtkPointData.h"
+#include "vtkDataArray.h"
+#include "vtkTimerLog.h"
+#include "vtkRayCastImageDisplayHelper.h"
+#include "vtkPlaneCollection.h"
+#include "vtkPlane.h"
+#include <QtConcurrentRun>
+
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+#define MaxTableSize 65536   // Integer scalars with a wider range are binned
+#define FloatTableSize 4096
+#define MaxAlpha 0.99f       // Early ray termination
+#define InteractiveTime 1.0  // Longest allocated time of an interactive frame
+#define MaxImageSampleDistance 4.0
+#define MaxSampleScale 4.0
+#define AxisTolerance 1e-6   // Relative size of a negligible normal component
+
+
+static inline int clampIndex(double t, int size)
+{
+    return t < 0.0 ? 0 : (t > size - 1 ? size - 1 : (int) t);
+}
+
+
+// Parallel kernels
+
+// Minimum and maximum table index of each brick.  A brick covers the
+// cells starting in it, so it includes the first voxel layer of the next
+// brick, which trilinear interpolation also reads.
+
+template <class T>
+struct PRayCastBrickKernel
+{
+    PRayCastMapper *m;
+    const T *data;
+
+    void operator()(int begin, int end)
+    {
+        const int *dim = m->dim;
+        const int *bd = m->brickDim;
+        int sliceSize = dim[0] * dim[1];
+
+        for (int b = begin; b < end; ++b)
+        {
+            int x0 = (b % bd[0]) * PRayCastMapper::BrickSize;
+            int y0 = (b / bd[0] % bd[1]) * PRayCastMapper::BrickSize;
+            int z0 = (b / (bd[0] * bd[1])) * PRayCastMapper::BrickSize;
+            int x1 = min(x0 + PRayCastMapper::BrickSize, dim[0] - 1);
+            int y1 = min(y0 + PRayCastMapper::BrickSize, dim[1] - 1);
+            int z1 = min(z0 + PRayCastMapper::BrickSize, dim[2] - 1);
+
+            T lo = data[z0 * sliceSize + y0 * dim[0] + x0];
+            T hi = lo;
+            for (int z = z0; z <= z1; ++z)
+                for (int y = y0; y <= y1; ++y)
+                {
+                    const T *row = data + z * sliceSize + y * dim[0];
+                    for (int x = x0; x <= x1; ++x)
+                    {
+                        lo = min(lo, row[x]);
+                        hi = max(hi, row[x]);
+                    }
+                }
+
+            m->brickMin[b] = clampIndex(
+                floor((lo - m->tableLow) * m->tableScale), m->tableSize);
+            m->brickMax[b] = clampIndex(
+                ceil((hi - m->tableLow) * m->tableScale), m->tableSize);
+        }
+    }
+
+    static void run(PRayCastMapper *m, const T *data)
+    {
+        PRayCastBrickKernel<T> kernel;
+        kernel.m = m;
+        kernel.data = data;
+        parallelFor(m->brickMin.size(), kernel, 64);
+    }
+};
+
+
+// Each call is one worker that takes tiles until none are left or the
+// frame is cancelled.  A pass casts the pixels on a grid of the given step
+// and copies each over its step by step block; a refining pass skips the
+// pixels of the coarser grid.  Rays are cast in index space and
+// parametrised by s in [0, 1] from the near to the far clipping plane.
+
+template <class T>
+struct PRayCastKernel
+{
+    PRayCastMapper *m;
+    const T *data;
+    int step;
+    bool refining;
+    int generation;
+
+    void operator()(int begin, int end)
+    {
+        int tileSize = PRayCastMapper::TileSize;
+        int width = m->imageMemorySize[0];
+        for (;;)
+        {
+            int tile = m->nextTile.fetchAndAddRelaxed(1);
+            if (tile >= m->numTiles || m->generation != generation)
+                return;
+
+            int x0 = tile % m->tilesX * tileSize;
+            int y0 = tile / m->tilesX * tileSize;
+            int x1 = min(x0 + tileSize, m->imageInUseSize[0]);
+            int y1 = min(y0 + tileSize, m->imageInUseSize[1]);
+            for (int y = y0; y < y1; y += step)
+                for (int x = x0; x < x1; x += step)
+                {
+                    if (refining && x % (2 * step) == 0 &&
+                        y % (2 * step) == 0)
+                        continue;
+
+                    unsigned char *pixel = &m->image[4 * (y * width + x)];
+                    castRay(x, y, pixel);
+                    if (step == 1)
+                        continue;
+
+                    int bx = min(step, x1 - x), by = min(step, y1 - y);
+                    for (int j = 0; j < by; ++j)
+                        for (int i = 0; i < bx; ++i)
+                            memcpy(pixel + 4 * (j * width + i), pixel, 4);
+                }
+        }
+    }
+
+    float interpolate(const float *p)
+    {
+        const int *dim = m->dim;
+        if (!m->linear)
+            return data[((int) (p[2] + 0.5f) * dim[1] +
+                (int) (p[1] + 0.5f)) * dim[0] + (int) (p[0] + 0.5f)];
+
+        int i = min((int) p[0], dim[0] - 2);
+        int j = min((int) p[1], dim[1] - 2);
+        int k = min((int) p[2], dim[2] - 2);
+        float fx = p[0] - i, fy = p[1] - j, fz = p[2] - k;
+
+        int dy = dim[0], dz = dim[0] * dim[1];
+        const T *v = data + k * dz + j * dy + i;
+        float c00 = v[0] + fx * ((float) v[1] - v[0]);
+        float c10 = v[dy] + fx * ((float) v[dy + 1] - v[dy]);
+        float c01 = v[dz] + fx * ((float) v[dz + 1] - v[dz]);
+        float c11 = v[dz + dy] + fx * ((float) v[dz + dy + 1] - v[dz + dy]);
+        float c0 = c00 + fy * (c10 - c00);
+        float c1 = c01 + fy * (c11 - c01);
+        return c0 + fz * (c1 - c0);
+    }
+
+    void castRay(int x, int y, unsigned char *pixel)
+    {
+        pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+
+        // End points on the near and far planes
+        double nx = 2.0 * (m->imageOrigin[0] + x + 0.5) /
+            m->imageViewportSize[0] - 1.0;
+        double ny = 2.0 * (m->imageOrigin[1] + y + 0.5) /
+            m->imageViewportSize[1] - 1.0;
+        double a[3], d[3];
+        m->unprojectPoint(nx, ny, -1.0, a);
+        m->unprojectPoint(nx, ny, 1.0, d);
+        for (int i = 0; i < 3; ++i)
+            d[i] -= a[i];
+
+        // Clip to the volume and the clipping box, then to other planes
+        if (m->clipEmpty)
+            return;
+        double s0 = 0.0, s1 = 1.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            double lo = m->clipBox[2*i], hi = m->clipBox[2*i + 1];
+            if (fabs(d[i]) < 1e-12)
+            {
+                if (a[i] < lo || a[i] > hi)
+                    return;
+                continue;
+            }
+            double t0 = (lo - a[i]) / d[i], t1 = (hi - a[i]) / d[i];
+            if (t0 > t1)
+                swap(t0, t1);
+            s0 = max(s0, t0);
+            s1 = min(s1, t1);
+        }
+
+        const double *plane = m->clipPlanes.empty() ? NULL :
+            &m->clipPlanes[0];
+        for (int k = 0; k < m->clipPlanes.size(); k += 4)
+        {
+            const double *n = plane + k;
+            double f = a[0] * n[0] + a[1] * n[1] + a[2] * n[2] + n[3];
+            double df = d[0] * n[0] + d[1] * n[1] + d[2] * n[2];
+            if (fabs(df) < 1e-12)
+            {
+                if (f < 0.0)
+                    return;
+                continue;
+            }
+            if (df > 0.0)
+                s0 = max(s0, -f / df);
+            else
+                s1 = min(s1, -f / df);
+        }
+        if (s0 >= s1)
+            return;
+
+        // Step so that samples are frameDistance apart in world space
+        const double *w = m->indexToWorld;
+        double dw[3], length = 0.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            dw[i] = w[4*i] * d[0] + w[4*i + 1] * d[1] + w[4*i + 2] * d[2];
+            length += dw[i] * dw[i];
+        }
+        length = sqrt(length);
+        float ds = m->frameDistance / length;
+
+        float rgba[4];
+        int blendMode = m->GetBlendMode();
+        if (blendMode == vtkVolumeMapper::MAXIMUM_INTENSITY_BLEND)
+            project(a, d, s0, s1, ds, false, rgba);
+        else if (blendMode == vtkVolumeMapper::MINIMUM_INTENSITY_BLEND)
+            project(a, d, s0, s1, ds, true, rgba);
+        else
+            composite(a, d, s0, s1, ds, rgba);
+
+        for (int i = 0; i < 4; ++i)
+            pixel[i] = (unsigned char) (min(rgba[i], 1.0f) * 255.0f + 0.5f);
+    }
+
+    // Parameter of the first sample past the brick that holds p
+
+    float skipBrick(const double *d, const float *p, const int *brick,
+        float s, float s1, float ds)
+    {
+        float exit = s1 - s + ds;
+        for (int i = 0; i < 3; ++i)
+        {
+            float e;
+            if (d[i] > 0.0)
+                e = ((brick[i] + 1) * PRayCastMapper::BrickSize - p[i]) / d[i];
+            else if (d[i] < 0.0)
+                e = (brick[i] * PRayCastMapper::BrickSize - p[i]) / d[i];
+            else
+                continue;
+            exit = min(exit, e);
+        }
+        return s + max(1.0f, ceil(exit / ds)) * ds;
+    }
+
+    // Sample position clamped to the volume against rounding
+
+    void position(const double *a, const double *d, float s, float *p)
+    {
+        for (int i = 0; i < 3; ++i)
+            p[i] = min(max((float) (a[i] + s * d[i]), 0.0f),
+                (float) (m->dim[i] - 1));
+    }
+
+    // Front-to-back compositing with premultiplied colour.  Samples in an
+    // invisible brick are skipped to the first one past it.  A shaded
+    // sample looks up the lighting of the normal of its nearest voxel.
+
+    void composite(const double *a, const double *d, float s0, float s1,
+        float ds, float *rgba)
+    {
+        const float *table = &m->table->rgba[0];
+        const unsigned char *visible = &m->brickVisible[0];
+        const int *bd = m->brickDim;
+        float low = m->tableLow, scale = m->tableScale;
+        int size = m->tableSize;
+        const unsigned short *normals = m->frameNormals;
+        const float *shading = m->frameShading;
+        const int *dim = m->dim;
+
+        float r = 0.0f, g = 0.0f, b = 0.0f, alpha = 0.0f;
+        float p[3];
+        for (float s = s0; s <= s1; )
+        {
+            position(a, d, s, p);
+
+            int brick[3];
+            for (int i = 0; i < 3; ++i)
+                brick[i] = min((int) p[i] / PRayCastMapper::BrickSize,
+                    bd[i] - 1);
+            if (!visible[(brick[2] * bd[1] + brick[1]) * bd[0] + brick[0]])
+            {
+                s = skipBrick(d, p, brick, s, s1, ds);
+                continue;
+            }
+
+            const float *e = table +
+                4 * clampIndex((interpolate(p) - low) * scale + 0.5f, size);
+            if (e[3] > 0.0f)
+            {
+                float cr = e[0], cg = e[1], cb = e[2];
+                if (normals)
+                {
+                    int v = ((int) (p[2] + 0.5f) * dim[1] +
+                        (int) (p[1] + 0.5f)) * dim[0] + (int) (p[0] + 0.5f);
+                    const float *l = shading + 2 * normals[v];
+                    float k = l[0], specular = l[1];
+                    cr = cr * k + specular;
+                    cg = cg * k + specular;
+                    cb = cb * k + specular;
+                }
+
+                float weight = e[3] * (1.0f - alpha);
+                r += cr * weight;
+                g += cg * weight;
+                b += cb * weight;
+                alpha += weight;
+                if (alpha >= MaxAlpha)
+                    break;
+            }
+            s += ds;
+        }
+
+        rgba[0] = r;
+        rgba[1] = g;
+        rgba[2] = b;
+        rgba[3] = alpha;
+    }
+
+    // Maximum or minimum intensity along the ray, mapped through the
+    // transfer functions without opacity correction.  Once a value has
+    // been found, a brick whose range cannot beat it is skipped, and the
+    // ray stops at the end of the scalar range.
+
+    void project(const double *a, const double *d, float s0, float s1,
+        float ds, bool minimum, float *rgba)
+    {
+        const unsigned short *bound = minimum ?
+            &m->brickMin[0] : &m->brickMax[0];
+        const int *bd = m->brickDim;
+        float low = m->tableLow, scale = m->tableScale;
+        float limit = m->scalarRange[minimum ? 0 : 1];
+
+        float p[3], peak = 0.0f, peakIndex = 0.0f;
+        bool found = false;
+        for (float s = s0; s <= s1; )
+        {
+            position(a, d, s, p);
+
+            if (found)
+            {
+                int brick[3];
+                for (int i = 0; i < 3; ++i)
+                    brick[i] = min((int) p[i] / PRayCastMapper::BrickSize,
+                        bd[i] - 1);
+                int b = bound[(brick[2] * bd[1] + brick[1]) * bd[0] +
+                    brick[0]];
+                if (minimum ? b > peakIndex : b < peakIndex)
+                {
+                    s = skipBrick(d, p, brick, s, s1, ds);
+                    continue;
+                }
+            }
+
+            float v = interpolate(p);
+            if (!found || (minimum ? v < peak : v > peak))
+            {
+                peak = v;
+                peakIndex = (v - low) * scale;
+                found = true;
+                if (minimum ? peak <= limit : peak >= limit)
+                    break;
+            }
+            s += ds;
+        }
+
+        rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0.0f;
+        if (!found)
+            return;
+
+        int i = clampIndex((peak - low) * scale + 0.5, m->tableSize);
+        float alpha = min(max(m->table->opacity[i], 0.0f), 1.0f);
+        for (int c = 0; c < 3; ++c)
+            rgba[c] = m->table->rgba[4*i + c] * alpha;
+        rgba[3] = alpha;
+    }
+
+    static void run(PRayCastMapper *m, const T *data, int step,
+        bool refining, int generation)
+    {
+        PRayCastKernel<T> kernel;
+        kernel.m = m;
+        kernel.data = data;
+        kernel.step = step;
+        kernel.refining = refining;
+        kernel.generation = generation;
+        m->nextTile = 0;
+        parallelFor(parallelThreadCount(), kernel, 1);
+    }
+};
+
+
+// PRayCastMapper class
+
+vtkStandardNewMacro(PRayCastMapper);
+
+
+PRayCastMapper::PRayCastMapper()
+{
+    sampleDistance = 1.0;
+    autoAdjust = false;
+    work = 1.0;
+    progressive = false;
+    slabThickness = 0.0;
+    notifier = new PRayCastNotifier;
+    frameDistance = 1.0;
+    imageSampleDistance = 1.0;
+    imageDisplayHelper = vtkRayCastImageDisplayHelper::New();
+    imageDisplayHelper->PreMultipliedColorsOn();
+
+    brickInput = NULL;
+    brickTime = 0;
+    table = NULL;
+    tableSize = 1;
+    tableLow = 0.0;
+    tableScale = 0.0;
+    imageMemorySize[0] = imageMemorySize[1] = 0;
+    frameNormals = NULL;
+    frameShading = NULL;
+}
+
+
+PRayCastMapper::~PRayCastMapper()
+{
+    cancelRefinement();
+    delete notifier;
+    imageDisplayHelper->Delete();
+    qDeleteAll(tables);
+}
+
+
+void PRayCastMapper::setSampleDistance(float distance)
+{
+    if (distance == sampleDistance)
+        return;
+    sampleDistance = distance;
+    Modified();
+}
+
+
+float PRayCastMapper::getSampleDistance()
+{
+    return sampleDistance;
+}
+
+
+void PRayCastMapper::setAutoAdjust(bool on)
+{
+    autoAdjust = on;
+}
+
+
+bool PRayCastMapper::getAutoAdjust()
+{
+    return autoAdjust;
+}
+
+
+void PRayCastMapper::setProgressive(bool on)
+{
+    progressive = on;
+}
+
+
+bool PRayCastMapper::getProgressive()
+{
+    return progressive;
+}
+
+
+void PRayCastMapper::setSlabThickness(double thickness)
+{
+    if (thickness == slabThickness)
+        return;
+    slabThickness = thickness;
+    Modified();
+}
+
+
+double PRayCastMapper::getSlabThickness()
+{
+    return slabThickness;
+}
+
+
+PRayCastNotifier *PRayCastMapper::getNotifier()
+{
+    return notifier;
+}
+
+
+void PRayCastMapper::Render(vtkRenderer *ren, vtkVolume *vol)
+{
+    vtkImageData *input = GetInput();
+    if (!input)
+        return;
+
+    // Show the latest pass if only the window is being redrawn
+    bool still = !autoAdjust ||
+        vol->GetAllocatedRenderTime() >= InteractiveTime;
+    if (progressive && still && !frameKey.empty())
+    {
+        vector<double> key;
+        getFrameKey(ren, vol, input, key);
+        if (key == frameKey)
+        {
+            QMutexLocker locker(&imageLock);
+            drawImage(ren, vol, &displayImage[0]);
+            return;
+        }
+    }
+    cancelRefinement();
+    frameKey.clear();
+
+    input->UpdateInformation();
+    input->SetUpdateExtentToWholeExtent();
+    input->Update();
+
+    vtkDataArray *scalars = input->GetPointData()->GetScalars();
+    if (!scalars || scalars->GetNumberOfComponents() != 1)
+    {
+        vtkErrorMacro("Only single-component scalars can be rendered");
+        return;
+    }
+
+    int *size = input->GetDimensions();
+    if (size[0] < 2 || size[1] < 2 || size[2] < 2)
+        return;
+
+    vtkTimerLog *timer = vtkTimerLog::New();
+    timer->StartTimer();
+
+    adjustQuality(vol);
+    bool newBricks = updateBricks(input, scalars);
+    bool newTable = updateTable(vol->GetProperty());
+    if (newBricks || newTable)
+        updateVisibility();
+    setupFrame(ren, vol, input);
+    frameData = scalars->GetVoidPointer(0);
+    frameType = scalars->GetDataType();
+
+    // Normals are kept while shading is off so that turning it back on
+    // costs nothing
+    frameNormals = NULL;
+    if (shadeOn && GetBlendMode() == vtkVolumeMapper::COMPOSITE_BLEND)
+    {
+        gradients.update(input);
+        gradients.updateShading(light, shade);
+        frameNormals = gradients.getNormals();
+        frameShading = gradients.getShading();
+    }
+
+    if (progressive && still)
+    {
+        int gen = generation;
+        castPass(ProgressiveStep, false, gen);
+        imageLock.lock();
+        displayImage = image;
+        drawImage(ren, vol, &displayImage[0]);
+        imageLock.unlock();
+
+        getFrameKey(ren, vol, input, frameKey);
+        refinement = QtConcurrent::run(this, &PRayCastMapper::refine, gen);
+    }
+    else
+    {
+        castPass(1, false, generation);
+        drawImage(ren, vol, &image[0]);
+    }
+
+    timer->StopTimer();
+    TimeToDraw = timer->GetElapsedTime();
+    timer->Delete();
+
+    // The next interactive frame is estimated from this one
+    if (progressive && still)
+        work = ProgressiveStep * ProgressiveStep;
+}
+
+
+// Supporting methods
+
+// The table range follows the scalar range, so new scalars also
+// invalidate the tables.
+
+bool PRayCastMapper::updateBricks(vtkImageData *input, vtkDataArray *scalars)
+{
+    unsigned long time = input->GetMTime();
+    if (input == brickInput && time == brickTime)
+        return false;
+
+    brickInput = input;
+    brickTime = time;
+    input->GetDimensions(dim);
+    scalars->GetRange(scalarRange, 0);
+
+    int type = scalars->GetDataType();
+    double span = scalarRange[1] - scalarRange[0];
+    tableLow = scalarRange[0];
+    if (type != VTK_FLOAT && type != VTK_DOUBLE && span < MaxTableSize)
+    {
+        tableSize = (int) span + 1;
+        tableScale = 1.0;
+    }
+    else
+    {
+        tableSize = FloatTableSize;
+        tableScale = span > 0.0 ? (tableSize - 1) / span : 0.0;
+    }
+    qDeleteAll(tables);
+    tables.clear();
+    table = NULL;
+
+    for (int i = 0; i < 3; ++i)
+        brickDim[i] = (dim[i] - 1 + BrickSize - 1) / BrickSize;
+    int numBricks = brickDim[0] * brickDim[1] * brickDim[2];
+    brickMin.resize(numBricks);
+    brickMax.resize(numBricks);
+
+    void *data = scalars->GetVoidPointer(0);
+    switch (type)
+    {
+        vtkTemplateMacro(
+            PRayCastBrickKernel<VTK_TT>::run(this, (const VTK_TT *) data));
+    }
+    return true;
+}
+
+
+// Sample the transfer functions over the scalar range.  Opacities are
+// given per unit distance and are corrected for the sample distance.  A
+// table compiled before for the same functions and distances is reused,
+// and the least recently used one makes room for a new table.
+
+bool PRayCastMapper::updateTable(vtkVolumeProperty *property)
+{
+    Table key;
+    key.opacityFn = property->GetScalarOpacity(0);
+    bool gray = property->GetColorChannels(0) == 1;
+    key.colorFn = gray ?
+        (vtkObject *) property->GetGrayTransferFunction(0) :
+        (vtkObject *) property->GetRGBTransferFunction(0);
+    key.opacityTime = key.opacityFn->GetMTime();
+    key.colorTime = key.colorFn->GetMTime();
+    key.unit = property->GetScalarOpacityUnitDistance(0);
+    key.distance = frameDistance;
+
+    if (table && table->sameKey(key))
+        return false;
+
+    for (int i = 1; i < tables.size(); ++i)
+        if (tables[i]->sameKey(key))
+        {
+            tables.move(i, 0);
+            table = tables.first();
+            return true;
+        }
+
+    table = tables.size() < MaxTables ? new Table : tables.takeLast();
+    tables.prepend(table);
+    table->opacityFn = key.opacityFn;
+    table->colorFn = key.colorFn;
+    table->opacityTime = key.opacityTime;
+    table->colorTime = key.colorTime;
+    table->unit = key.unit;
+    table->distance = key.distance;
+
+    vtkObject *colorFn = key.colorFn;
+    vector<float> &opacity = table->opacity;
+    vector<float> &rgba = table->rgba;
+    vector<int> &opaqueCount = table->opaqueCount;
+    double high = tableScale > 0.0 ?
+        tableLow + (tableSize - 1) / tableScale : tableLow;
+    opacity.resize(tableSize);
+    key.opacityFn->GetTable(tableLow, high, tableSize, &opacity[0]);
+
+    vector<float> rgb(3 * tableSize);
+    if (gray)
+    {
+        vtkPiecewiseFunction *grayFn = (vtkPiecewiseFunction *) colorFn;
+        for (int c = 0; c < 3; ++c)
+            grayFn->GetTable(tableLow, high, tableSize, &rgb[c], 3);
+    }
+    else
+        ((vtkColorTransferFunction *) colorFn)->GetTable(tableLow, high,
+            tableSize, &rgb[0]);
+
+    double exponent = frameDistance / key.unit;
+    rgba.resize(4 * tableSize);
+    opaqueCount.resize(tableSize + 1);
+    opaqueCount[0] = 0;
+    for (int i = 0; i < tableSize; ++i)
+    {
+        double a = min(max((double) opacity[i], 0.0), 1.0);
+        rgba[4*i] = rgb[3*i];
+        rgba[4*i + 1] = rgb[3*i + 1];
+        rgba[4*i + 2] = rgb[3*i + 2];
+        rgba[4*i + 3] = 1.0 - pow(1.0 - a, exponent);
+        opaqueCount[i + 1] = opaqueCount[i] + (rgba[4*i + 3] > 0.0f);
+    }
+    return true;
+}
+
+
+// A brick is visible if any table entry in its index range is not
+// transparent.
+
+void PRayCastMapper::updateVisibility()
+{
+    const int *opaqueCount = &table->opaqueCount[0];
+    brickVisible.resize(brickMin.size());
+    for (int b = 0; b < brickVisible.size(); ++b)
+        brickVisible[b] =
+            opaqueCount[brickMax[b] + 1] - opaqueCount[brickMin[b]] > 0;
+}
+
+
+// Everything the image depends on, to tell a redraw from a new frame.
+
+void PRayCastMapper::getFrameKey(vtkRenderer *ren, vtkVolume *vol,
+    vtkImageData *input, vector<double> &key)
+{
+    int width, height, x, y;
+    ren->GetTiledSizeAndOrigin(&width, &height, &x, &y);
+    vtkMatrix4x4 *projection = ren->GetActiveCamera()->
+        GetCompositeProjectionTransformMatrix(ren->GetTiledAspectRatio(),
+        -1.0, 1.0);
+
+    key.clear();
+    key.push_back(width);
+    key.push_back(height);
+    key.push_back(input->GetPipelineMTime());
+    key.push_back(input->GetMTime());
+    key.push_back(GetMTime());
+    key.push_back(vol->GetMTime());
+    key.push_back(vol->GetProperty()->GetMTime());
+    if (ClippingPlanes)
+    {
+        key.push_back(ClippingPlanes->GetMTime());
+        ClippingPlanes->InitTraversal();
+        while (vtkPlane *plane = ClippingPlanes->GetNextItem())
+            key.push_back(plane->GetMTime());
+    }
+    if (slabThickness > 0.0)
+    {
+        double *focus = ren->GetActiveCamera()->GetFocalPoint();
+        key.insert(key.end(), focus, focus + 3);
+    }
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            key.push_back(projection->GetElement(i, j));
+}
+
+
+void PRayCastMapper::castPass(int step, bool refining, int gen)
+{
+    switch (frameType)
+    {
+        vtkTemplateMacro(PRayCastKernel<VTK_TT>::run(this,
+            (const VTK_TT *) frameData, step, refining, gen));
+    }
+}
+
+
+// Runs in the global thread pool.  Frame state is not changed until the
+// refinement has been cancelled.
+
+void PRayCastMapper::refine(int gen)
+{
+    for (int step = ProgressiveStep / 2; step >= 1; step /= 2)
+    {
+        castPass(step, true, gen);
+        if (generation != gen)
+            return;
+
+        imageLock.lock();
+        displayImage = image;
+        imageLock.unlock();
+        notifier->notify();
+    }
+}
+
+
+void PRayCastMapper::cancelRefinement()
+{
+    generation.ref();
+    refinement.waitForFinished();
+}
+
+
+void PRayCastMapper::drawImage(vtkRenderer *ren, vtkVolume *vol,
+    unsigned char *pixels)
+{
+    imageDisplayHelper->RenderTexture(vol, ren, imageMemorySize,
+        imageViewportSize, imageInUseSize, imageOrigin, -1.0f, pixels);
+}
+
+
+// Clipping planes keep the side their normal points to.  In index space
+// the volume is usually axis-aligned with the box widget, so most planes
+// just narrow the box that rays are clipped to, and the bricks outside it
+// are never visited.  Other planes are kept in index space as (n, c) with
+// q.n + c >= 0 inside and clip each ray once.  A thick slab for the
+// projections is a pair of planes facing each other across the focal
+// point.
+
+void PRayCastMapper::setupClipping(vtkRenderer *ren)
+{
+    clipPlanes.clear();
+    clipEmpty = false;
+    for (int i = 0; i < 3; ++i)
+    {
+        clipBox[2*i] = 0.0;
+        clipBox[2*i + 1] = dim[i] - 1;
+    }
+
+    if (ClippingPlanes)
+    {
+        ClippingPlanes->InitTraversal();
+        while (vtkPlane *plane = ClippingPlanes->GetNextItem())
+            addClipPlane(plane->GetOrigin(), plane->GetNormal());
+    }
+
+    if (slabThickness > 0.0 && GetBlendMode() != COMPOSITE_BLEND)
+    {
+        vtkCamera *camera = ren->GetActiveCamera();
+        double *focus = camera->GetFocalPoint();
+        double n[3], o[3];
+        camera->GetDirectionOfProjection(n);
+        for (int i = 0; i < 3; ++i)
+            o[i] = focus[i] - 0.5 * slabThickness * n[i];
+        addClipPlane(o, n);
+        for (int i = 0; i < 3; ++i)
+        {
+            o[i] = focus[i] + 0.5 * slabThickness * n[i];
+            n[i] = -n[i];
+        }
+        addClipPlane(o, n);
+    }
+
+    for (int i = 0; i < 3; ++i)
+        clipEmpty = clipEmpty || clipBox[2*i] > clipBox[2*i + 1];
+}
+
+
+// Add the world plane through o with normal n.
+
+void PRayCastMapper::addClipPlane(const double *o, const double *n)
+{
+    const double *w = indexToWorld;
+    double q[4], norm = 0.0;
+    for (int i = 0; i < 3; ++i)
+    {
+        q[i] = w[i] * n[0] + w[4 + i] * n[1] + w[8 + i] * n[2];
+        norm = max(norm, fabs(q[i]));
+    }
+    q[3] = (w[3] - o[0]) * n[0] + (w[7] - o[1]) * n[1] +
+        (w[11] - o[2]) * n[2];
+    if (norm == 0.0)
+        return;
+
+    int axis = -1;
+    for (int i = 0; i < 3; ++i)
+        if (fabs(q[i]) > AxisTolerance * norm)
+            axis = axis < 0 ? i : 3;
+    if (axis == 3)
+    {
+        clipPlanes.insert(clipPlanes.end(), q, q + 4);
+        return;
+    }
+
+    double bound = -q[3] / q[axis];
+    if (q[axis] > 0.0)
+        clipBox[2*axis] = max(clipBox[2*axis], bound);
+    else
+        clipBox[2*axis + 1] = min(clipBox[2*axis + 1], bound);
+}
+
+
+// Frame time is taken as inversely proportional to work, the product of
+// the sample distance scale and the square of the image sample distance,
+// so the work that fits the allocation follows from the last frame.  The
+// sample distance scale moves in powers of two so that the transfer table
+// is rebuilt only when it changes.
+
+void PRayCastMapper::adjustQuality(vtkVolume *vol)
+{
+    double allocated = vol->GetAllocatedRenderTime();
+    if (!autoAdjust || allocated >= InteractiveTime)
+    {
+        work = 1.0;
+        frameDistance = sampleDistance;
+        imageSampleDistance = 1.0;
+        return;
+    }
+
+    double maxWork = MaxSampleScale * MaxImageSampleDistance *
+        MaxImageSampleDistance;
+    if (TimeToDraw > 0.0 && allocated > 0.0)
+        work = min(max(work * TimeToDraw / allocated, 1.0), maxWork);
+
+    double scale = 1.0;
+    double maxArea = MaxImageSampleDistance * MaxImageSampleDistance;
+    while (2.0 * scale <= MaxSampleScale &&
+        (8.0 * scale * scale * scale <= work || work / scale > maxArea))
+        scale *= 2.0;
+    frameDistance = sampleDistance * scale;
+    imageSampleDistance = min(sqrt(work / scale), MaxImageSampleDistance);
+    work = scale * imageSampleDistance * imageSampleDistance;
+}
+
+
+// Image size, the view-to-index transform and the shading terms.
+
+void PRayCastMapper::setupFrame(vtkRenderer *ren, vtkVolume *vol,
+    vtkImageData *input)
+{
+    int width, height, x, y;
+    ren->GetTiledSizeAndOrigin(&width, &height, &x, &y);
+    imageViewportSize[0] = imageInUseSize[0] =
+        max((int) (width / imageSampleDistance), 1);
+    imageViewportSize[1] = imageInUseSize[1] =
+        max((int) (height / imageSampleDistance), 1);
+    imageOrigin[0] = imageOrigin[1] = 0;
+
+    // Texture sizes are powers of two
+    for (int i = 0; i < 2; ++i)
+    {
+        int n = 32;
+        while (n < imageInUseSize[i])
+            n *= 2;
+        imageMemorySize[i] = n;
+    }
+    image.resize(4 * imageMemorySize[0] * imageMemorySize[1]);
+    tilesX = (imageInUseSize[0] + TileSize - 1) / TileSize;
+    numTiles = tilesX * ((imageInUseSize[1] + TileSize - 1) / TileSize);
+
+    // Index space starts at the first voxel of the extent
+    double *origin = input->GetOrigin();
+    int *extent = input->GetExtent();
+    input->GetSpacing(spacing);
+    vtkMatrix4x4 *indexToData = vtkMatrix4x4::New();
+    for (int i = 0; i < 3; ++i)
+    {
+        indexToData->SetElement(i, i, spacing[i]);
+        indexToData->SetElement(i, 3, origin[i] + extent[2*i] * spacing[i]);
+    }
+
+    vtkMatrix4x4 *toWorld = vtkMatrix4x4::New();
+    vtkMatrix4x4::Multiply4x4(vol->GetMatrix(), indexToData, toWorld);
+    vtkMatrix4x4::DeepCopy(indexToWorld, toWorld);
+
+    vtkMatrix4x4 *toView = vtkMatrix4x4::New();
+    vtkMatrix4x4 *projection = ren->GetActiveCamera()->
+        GetCompositeProjectionTransformMatrix(ren->GetTiledAspectRatio(),
+        -1.0, 1.0);
+    vtkMatrix4x4::Multiply4x4(projection, toWorld, toView);
+    toView->Invert();
+    vtkMatrix4x4::DeepCopy(viewToIndex, toView);
+    setupClipping(ren);
+
+    // Headlight along the central ray, taken into data space.  The
+    // gradients there are the index-space ones divided by the spacing.
+    double a[3], d[3], dw[3];
+    unprojectPoint(0.0, 0.0, -1.0, a);
+    unprojectPoint(0.0, 0.0, 1.0, d);
+    for (int i = 0; i < 3; ++i)
+        d[i] -= a[i];
+    for (int i = 0; i < 3; ++i)
+        dw[i] = indexToWorld[4*i] * d[0] + indexToWorld[4*i + 1] * d[1] +
+            indexToWorld[4*i + 2] * d[2];
+    double length = 0.0;
+    for (int i = 0; i < 3; ++i)
+    {
+        light[i] = -(indexToWorld[i] * dw[0] + indexToWorld[4 + i] * dw[1] +
+            indexToWorld[8 + i] * dw[2]) / spacing[i];
+        length += light[i] * light[i];
+    }
+    length = sqrt(length);
+    for (int i = 0; i < 3; ++i)
+        light[i] = length > 0.0 ? light[i] / length : 0.0;
+
+    indexToData->Delete();
+    toWorld->Delete();
+    toView->Delete();
+
+    vtkVolumeProperty *property = vol->GetProperty();
+    linear = property->GetInterpolationType() != VTK_NEAREST_INTERPOLATION;
+    shadeOn = property->GetShade(0) != 0;
+    shade[0] = property->GetAmbient(0);
+    shade[1] = property->GetDiffuse(0);
+    shade[2] = property->GetSpecular(0);
+    shade[3] = property->GetSpecularPower(0);
+}
+
+
+void PRayCastMapper::unprojectPoint(double x, double y, double z, double *p)
+{
+    const double *v = viewToIndex;
+    double w = v[12] * x + v[13] * y + v[14] * z + v[15];
+    for (int i = 0; i < 3; ++i)
+        p[i] = (v[4*i] * x + v[4*i + 1] * y + v[4*i + 2] * z +
+            v[4*i + 3]) / w;
+}
@@ -0,0 +1,208 @@
+/* PRayCastMapper.h
+
+   Multi-threaded CPU ray casting volume mapper.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PRAYCASTMAPPER_H
+#define PRAYCASTMAPPER_H
+
+#include <QObject>
+#include <QList>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QFuture>
+#include "vtkVolumeMapper.h"
+#include "vtkImageData.h"
+#include "vtkPiecewiseFunction.h"
+#include "vtkColorTransferFunction.h"
+#include "PGradientCache.h"
+#include <vector>
+
+class vtkDataArray;
+class vtkVolumeProperty;
+class vtkRayCastImageDisplayHelper;
+
+
+// Casts one ray per image pixel through the volume on all cores and draws
+// the image as a texture.  The volume is divided into bricks of BrickSize
+// voxels a side with the minimum and maximum scalar of each; a brick in
+// which the opacity function is zero over that range is stepped over
+// whole.  Rays stop once they are nearly opaque.  The image is cut into
+// tiles that threads take from a shared counter, so threads that finish
+// early take more tiles.
+//
+// With automatic adjustment on, interactive frames, those allocated less
+// than a second by the render window's desired update rate, are cast at a
+// coarser image resolution and sample distance chosen from the cost of the
+// previous frame to fit the allocation.  Still frames are always cast in
+// full.
+//
+// With progressive rendering on, a still frame casts only every
+// ProgressiveStep-th pixel in each direction and returns.  Passes on
+// grids twice as fine, each casting only pixels that are new, then run
+// in the background, and the notifier signals after each one.  Drawing
+// the same view again shows the latest pass; any change of view, data
+// or property cancels the passes still to run.
+//
+// Clipping planes aligned with the volume axes, such as those of a box
+// widget, become a sub-extent that rays start and end at.
+//
+// Maximum and minimum intensity projections skip bricks whose maximum,
+// or minimum, cannot improve on the value the ray already holds.  With a
+// slab thickness set, they project only the slab of that thickness
+// centred on the focal point and facing the camera.
+//
+// Shading looks up the normal of the nearest voxel, computed once per
+// input, in a table of the lighting of each normal, so changing the
+// lighting rebuilds only the table.  The headlight is taken along the
+// central ray of the view.
+//
+// The transfer functions are compiled into a table over the scalar range
+// of the input, corrected for the sample distance.  The last MaxTables
+// tables are kept with the functions, modification times and distances
+// they were compiled for, so switching back to a preset or sample
+// distance used before only swaps tables.  New scalars drop them all.
+
+// Tells the viewer, in its own thread, that a refinement pass has finished
+// and the volume should be drawn again.
+
+class PRayCastNotifier: public QObject
+{
+    Q_OBJECT
+
+public:
+    void notify() { emit refined(); }
+
+signals:
+    void refined();
+};
+
+
+class PRayCastMapper: public vtkVolumeMapper
+{
+public:
+    static PRayCastMapper *New();
+    vtkTypeMacro(PRayCastMapper, vtkVolumeMapper);
+
+    void setSampleDistance(float distance);  // In world units
+    float getSampleDistance();
+    void setAutoAdjust(bool on);
+    bool getAutoAdjust();
+    void setProgressive(bool on);
+    bool getProgressive();
+    PRayCastNotifier *getNotifier();
+    void setSlabThickness(double thickness);  // In world units, 0 for all
+    double getSlabThickness();
+
+    virtual void Render(vtkRenderer *ren, vtkVolume *vol);
+
+    enum { BrickSize = 8, TileSize = 16, ProgressiveStep = 4,
+        MaxTables = 16 };
+
+protected:
+    PRayCastMapper();
+    ~PRayCastMapper();
+
+    template <class T> friend struct PRayCastBrickKernel;
+    template <class T> friend struct PRayCastKernel;
+
+    float sampleDistance;
+    bool autoAdjust;
+    double work;  // Cost reduction of the last frame
+    bool progressive;
+    double slabThickness;
+    PRayCastNotifier *notifier;
+    vtkRayCastImageDisplayHelper *imageDisplayHelper;
+
+    // Bricks, valid for brickInput at brickTime
+    vtkImageData *brickInput;
+    unsigned long brickTime;
+    int dim[3], brickDim[3];
+    double scalarRange[2];
+    std::vector<unsigned short> brickMin, brickMax;  // Table indices
+
+    // Transfer table over the scalar range; entry i is scalar value
+    // tableLow + i / tableScale
+    struct Table
+    {
+        vtkPiecewiseFunction *opacityFn;
+        vtkObject *colorFn;
+        unsigned long opacityTime, colorTime;
+        double unit;
+        float distance;
+        std::vector<float> rgba;         // RGBA, opacity per sample
+        std::vector<float> opacity;      // Opacity per unit distance
+        std::vector<int> opaqueCount;    // Entries with opacity before i
+
+        bool sameKey(const Table &t) const
+        {
+            return opacityFn == t.opacityFn && colorFn == t.colorFn &&
+                opacityTime == t.opacityTime && colorTime == t.colorTime &&
+                unit == t.unit && distance == t.distance;
+        }
+    };
+
+    int tableSize;
+    double tableLow, tableScale;
+    Table *table;          // The current table, first of tables
+    QList<Table *> tables;  // Most recently used first
+    std::vector<unsigned char> brickVisible;
+
+    // Normals of the input, built on the first shaded frame unless another
+    // mapper already holds them
+    PGradientCache gradients;
+
+    // Frame state shared by the workers
+    float frameDistance;
+    float imageSampleDistance;
+    double viewToIndex[16];
+    double indexToWorld[16];
+    double spacing[3];
+    float shade[4];  // Ambient, diffuse, specular, specular power
+    double light[3];  // Headlight in data space
+    bool shadeOn, linear;
+    int imageViewportSize[2], imageMemorySize[2];
+    int imageInUseSize[2], imageOrigin[2];
+    int tilesX, numTiles;
+    double clipBox[6];                // Index-space bounds of the rays
+    std::vector<double> clipPlanes;   // Index-space planes not on an axis
+    bool clipEmpty;
+    void *frameData;
+    int frameType;
+    const unsigned short *frameNormals;  // NULL if unshaded
+    const float *frameShading;
+    QAtomicInt nextTile;
+    std::vector<unsigned char> image;
+
+    // Progressive refinement.  The passes of a frame run while generation
+    // is unchanged.
+    QAtomicInt generation;
+    QFuture<void> refinement;
+    QMutex imageLock;  // Guards displayImage
+    std::vector<unsigned char> displayImage;
+    std::vector<double> frameKey;
+
+    // Supporting methods
+    bool updateBricks(vtkImageData *input, vtkDataArray *scalars);
+    bool updateTable(vtkVolumeProperty *property);
+    void updateVisibility();
+    void adjustQuality(vtkVolume *vol);
+    void setupFrame(vtkRenderer *ren, vtkVolume *vol, vtkImageData *input);
+    void setupClipping(vtkRenderer *ren);
+    void addClipPlane(const double *o, const double *n);
+    void unprojectPoint(double x, double y, double z, double *p);
+    void getFrameKey(vtkRenderer *ren, vtkVolume *vol, vtkImageData *input,
+        std::vector<double> &key);
+    void castPass(int step, bool refining, int gen);
+    void refine(int gen);
+    void cancelRefinement();
+    void drawImage(vtkRenderer *ren, vtkVolume *vol, unsigned char *pixels);
+
+private:
+    PRayCastMapper(const PRayCastMapper &);  // Not implemented
+    void operator=(const PRayCastMapper &);  // Not implemented
+};
+
+#endif
@@ -0,0 +1,184 @@
+/* PVolumePresets.cpp
+
+   Cached transfer function presets for volume rendering.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#include "PVolumePresets.h"
+#include "vtkVolumeMapper.h"
+
+using namespace std;
+
+
+PVolumePresets::PVolumePresets()
+{
+}
+
+
+PVolumePresets::~PVolumePresets()
+{
+    for (int i = 0; i < presets.size(); ++i)
+    {
+        presets[i]->opacity->Delete();
+        presets[i]->color->Delete();
+        delete presets[i];
+    }
+}
+
+
+// Register an empty preset and return its index.  Fill it through
+// getOpacity() and getColor().
+
+int PVolumePresets::add(const QString &name, int blendMode)
+{
+    PVolumePreset *preset = new PVolumePreset;
+    preset->name = name;
+    preset->blendMode = blendMode;
+    preset->opacity = vtkPiecewiseFunction::New();
+    preset->color = vtkColorTransferFunction::New();
+    presets.append(preset);
+    return presets.size() - 1;
+}
+
+
+// The presets of the volume renderer, also used by the batch renderer:
+// MIP, MinIP, CT All, CT Skin, CT Muscle, CT Organ and CT Bone.
+
+void PVolumePresets::addStandard()
+{
+    double opacityLevel = 1048;
+    double opacityWindow = 2048;
+    int i;
+
+    // Maximum Intensity Projection
+    // Create an opacity ramp from the window and level values.
+    // Color is white. Blending is MIP.
+    i = add("MIP", vtkVolumeMapper::MAXIMUM_INTENSITY_BLEND);
+    getOpacity(i)->AddSegment(opacityLevel - 0.5*opacityWindow, 0.0,
+                              opacityLevel + 0.5*opacityWindow, 1.0);
+    getColor(i)->AddRGBSegment(0, 1.0, 1.0, 1.0, 500, 1.0, 1.0, 1.0);
+
+    // Minimum Intensity Projection
+    // Same ramp as MIP, for airways and low-density lesions.
+    i = add("MinIP", vtkVolumeMapper::MINIMUM_INTENSITY_BLEND);
+    getOpacity(i)->AddSegment(opacityLevel - 0.5*opacityWindow, 0.0,
+                              opacityLevel + 0.5*opacityWindow, 1.0);
+    getColor(i)->AddRGBSegment(0, 1.0, 1.0, 1.0, 500, 1.0, 1.0, 1.0);
+
+    // CT All
+    // Use compositing and functions set to highlight skin in CT data.
+    i = add("CT All", vtkVolumeMapper::COMPOSITE_BLEND);
+    getOpacity(i)->AddPoint(-2000, 0.0, 0.5, 0.0);
+    getOpacity(i)->AddPoint(-1000, 0.0, 0.5, 0.5);
+    getOpacity(i)->AddPoint( -500, 1.0, 0.5, 0.0);
+    getOpacity(i)->AddPoint( 2000, 1.0, 0.5, 0.0);
+
+    getColor(i)->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
+    getColor(i)->AddRGBPoint(-1000, 0.6, 0.6, 0.6, 0.5, 0.5);
+    getColor(i)->AddRGBPoint( -500, 0.8, 0.8, 0.8, 0.5, 0.0);
+    getColor(i)->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
+
+    // CT Skin
+    // Use compositing and functions set to highlight skin in CT data.
+    i = add("CT Skin", vtkVolumeMapper::COMPOSITE_BLEND);
+    getOpacity(i)->AddPoint(-2000, 0.0, 0.5, 0.0);
+    getOpacity(i)->AddPoint( -300, 0.0, 0.5, 0.5);
+    getOpacity(i)->AddPoint( -100, 1.0, 0.5, 0.0);
+    getOpacity(i)->AddPoint( 2000, 1.0, 0.5, 0.0);
+
+    getColor(i)->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
+    getColor(i)->AddRGBPoint( -300, 0.6, 0.4, 0.2, 0.5, 0.5);
+    getColor(i)->AddRGBPoint( -100, 0.9, 0.8, 0.5, 0.5, 0.0);
+    getColor(i)->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
+
+    // CT Muscle
+    // Use compositing and functions set to highlight muscle in CT data.
+    i = add("CT Muscle", vtkVolumeMapper::COMPOSITE_BLEND);
+    getOpacity(i)->AddPoint(-2000, 0.0, 0.5, 0.0);
+    getOpacity(i)->AddPoint(  -70, 0.0, 0.5, 0.5);
+    getOpacity(i)->AddPoint(  200, 1.0, 0.5, 0.0);
+    getOpacity(i)->AddPoint( 2000, 1.0, 0.5, 0.0);
+
+    getColor(i)->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
+    getColor(i)->AddRGBPoint(  -70, 1.0, 0.3, 0.3, 0.5, 0.5);
+    getColor(i)->AddRGBPoint(  200, 1.0, 1.0, 1.0, 0.5, 0.0);
+    getColor(i)->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
+
+    // CT Organ
+    // Use compositing and functions set to highlight muscle in CT data.
+    i = add("CT Organ", vtkVolumeMapper::COMPOSITE_BLEND);
+    getOpacity(i)->AddPoint(-2000, 0.0, 0.5, 0.0);
+    getOpacity(i)->AddPoint(    0, 0.0, 0.5, 0.5);
+    getOpacity(i)->AddPoint(  300, 1.0, 0.5, 0.0);
+    getOpacity(i)->AddPoint( 2000, 1.0, 0.5, 0.0);
+
+    getColor(i)->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
+    getColor(i)->AddRGBPoint(    0, 1.0, 0.3, 0.3, 0.5, 0.5);
+    getColor(i)->AddRGBPoint(  300, 1.0, 1.0, 1.0, 0.5, 0.0);
+    getColor(i)->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
+
+    // CT Bone
+    // Use compositing and functions set to highlight bone in CT data.
+    i = add("CT Bone", vtkVolumeMapper::COMPOSITE_BLEND);
+    getOpacity(i)->AddPoint(-2000, 0.0, 0.5, 0.0);
+    getOpacity(i)->AddPoint(  -20, 0.0, 0.5, 0.5);
+    getOpacity(i)->AddPoint(  600, 1.0, 0.5, 0.0);
+    getOpacity(i)->AddPoint( 2000, 1.0, 0.5, 0.0);
+
+    getColor(i)->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
+    getColor(i)->AddRGBPoint(  -20, 1.0, 0.3, 0.3, 0.5, 0.5);
+    getColor(i)->AddRGBPoint(  600, 1.0, 1.0, 1.0, 0.5, 0.0);
+    getColor(i)->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
+}
+
+
+// Index of the preset with the given name, or -1.
+
+int PVolumePresets::find(const QString &name)
+{
+    for (int i = 0; i < presets.size(); ++i)
+        if (presets[i]->name == name)
+            return i;
+    return -1;
+}
+
+
+int PVolumePresets::count()
+{
+    return presets.size();
+}
+
+
+QString PVolumePresets::getName(int preset)
+{
+    return presets[preset]->name;
+}
+
+
+int PVolumePresets::getBlendMode(int preset)
+{
+    return presets[preset]->blendMode;
+}
+
+
+vtkPiecewiseFunction *PVolumePresets::getOpacity(int preset)
+{
+    return presets[preset]->opacity;
+}
+
+
+vtkColorTransferFunction *PVolumePresets::getColor(int preset)
+{
+    return presets[preset]->color;
+}
+
+
+// Point the property at the functions of the preset.
+
+void PVolumePresets::apply(int preset, vtkVolumeProperty *property)
+{
+    PVolumePreset *p = presets[preset];
+    property->SetScalarOpacity(p->opacity);
+    property->SetColor(p->color);
+}
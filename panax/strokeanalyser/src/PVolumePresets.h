@@ -0,0 +1,52 @@
+/* PVolumePresets.h
+
+   Cached transfer function presets for volume rendering.
+
+   Copyright 2013, National University of Singapore
+*/
+
+#ifndef PVOLUMEPRESETS_H
+#define PVOLUMEPRESETS_H
+
+#include <QString>
+#include <QList>
+#include "vtkPiecewiseFunction.h"
+#include "vtkColorTransferFunction.h"
+#include "vtkVolumeProperty.h"
+
+
+// Each preset owns its opacity and colour functions, filled once when the
+// viewer registers it.  Applying a preset points the volume property at
+// them, so switching presets rebuilds nothing.
+
+class PVolumePreset
+{
+    friend class PVolumePresets;
+    QString name;
+    int blendMode;
+    vtkPiecewiseFunction *opacity;
+    vtkColorTransferFunction *color;
+};
+
+
+class PVolumePresets
+{
+public:
+    PVolumePresets();
+    ~PVolumePresets();
+
+    int add(const QString &name, int blendMode);
+    void addStandard();
+    int count();
+    int find(const QString &name);
+    QString getName(int preset);
+    int getBlendMode(int preset);  // vtkVolumeMapper blend mode
+    vtkPiecewiseFunction *getOpacity(int preset);
+    vtkColorTransferFunction *getColor(int preset);
+    void apply(int preset, vtkVolumeProperty *property);
+
+protected:
+    QList<PVolumePreset *> presets;
+};
+
+#endif
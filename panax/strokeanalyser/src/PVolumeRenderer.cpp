@@ -12,19 +12,21 @@
 #include "vtkRenderWindow.h"
 #include "vtkRenderWindowInteractor.h"
 #include "vtkInteractorStyleTrackballCamera.h"
-#include "vtkWindowToImageFilter.h"
-#include "vtkJPEGWriter.h"
-#include "vtkPNGWriter.h"
-#include "vtkTIFFWriter.h"
 #include "vtkCamera.h"
 #include "vtkCommand.h"
 #include "vtkPlanes.h"
+#include "vtkPlane.h"
+#include "vtkPlaneCollection.h"
 #include "vtkProperty.h"
 
 using namespace std;
 
+#define CpuOption 5  // First sampleDistanceBox entry drawn by PRayCastMapper
+#define DefaultFrameTime 100.0  // Target interactive frame time in ms
 
-// Callback for box widget
+
+// Callback for box widget.  The mappers share one collection of six
+// planes that is updated in place on every drag.
 
 class vtkBoxWidgetCallback: public vtkCommand
 {
@@ -35,24 +37,48 @@ public:
     virtual void Execute(vtkObject *caller, unsigned long, void*)
     {
         vtkBoxWidget *widget = reinterpret_cast<vtkBoxWidget*>(caller);
-        if (this->mapper1 && this->mapper2)
-        {
-            vtkPlanes *planes = vtkPlanes::New();
-            widget->GetPlanes(planes);
-            this->mapper1->SetClippingPlanes(planes);
-            this->mapper2->SetClippingPlanes(planes);
-            planes->Delete();
-        }
+        widget->GetPlanes(this->planes);
+        for (int i = 0; i < 6; ++i)
+            this->planes->GetPlane(i, this->plane[i]);
+            
+        for (int i = 0; i < 3; ++i)
+            if (this->mapper[i] &&
+                this->mapper[i]->GetClippingPlanes() != this->clipping)
+                this->mapper[i]->SetClippingPlanes(this->clipping);
     }
     
-    void SetMapper(vtkVolumeMapper *m1, vtkVolumeMapper *m2)
-    { this->mapper1 = m1;    this->mapper2 = m2; }
+    void SetMapper(vtkVolumeMapper *m1, vtkVolumeMapper *m2,
+        vtkVolumeMapper *m3)
+    {
+        this->mapper[0] = m1;
+        this->mapper[1] = m2;
+        this->mapper[2] = m3;
+    }
 
 protected:
     vtkBoxWidgetCallback() 
-    { this->mapper1 = 0;    this->mapper2 = 0; }
+    {
+        this->mapper[0] = this->mapper[1] = this->mapper[2] = 0;
+        this->planes = vtkPlanes::New();
+        this->clipping = vtkPlaneCollection::New();
+        for (int i = 0; i < 6; ++i)
+        {
+            this->plane[i] = vtkPlane::New();
+            this->clipping->AddItem(this->plane[i]);
+            this->plane[i]->Delete();
+        }
+    }
+    
+    ~vtkBoxWidgetCallback()
+    {
+        this->planes->Delete();
+        this->clipping->Delete();
+    }
 
-    vtkVolumeMapper *mapper1, *mapper2;
+    vtkVolumeMapper *mapper[3];
+    vtkPlanes *planes;
+    vtkPlane *plane[6];
+    vtkPlaneCollection *clipping;
 };
 
 
@@ -66,12 +92,22 @@ PVolumeRenderer::PVolumeRenderer()
     reader = NULL;
     mapper = NULL;
     rcmapper = NULL;
+    cpumapper = NULL;
     volumeRenderer = NULL;
     boxWidget = NULL;
     boxCallback = NULL;
     appName = QString("Volume Renderer");
     loaded = false;
     
+    // Movies are rendered by batchrender beside this program
+    movieRenderer = new PBatchRenderer;
+    movieRenderer->setProgram(QCoreApplication::applicationDirPath() +
+        "/batchrender");
+    connect(movieRenderer, SIGNAL(progress(int, int)),
+        this, SLOT(showMovieProgress(int, int)));
+    connect(movieRenderer, SIGNAL(finished(int)),
+        this, SLOT(movieFinished(int)));
+    
     // Create GUI
     createWidgets();
     createActions();
@@ -79,17 +115,22 @@ PVolumeRenderer::PVolumeRenderer()
     createToolBars();
     createStatusBar();
     initSize();
+
+    // Screenshots are written in the background
+    imageSaver = new PImageSaver;
+    connect(imageSaver, SIGNAL(message(const QString &)),
+        statusBar(), SLOT(showMessage(const QString &)));
 }
 
 
 PVolumeRenderer::~PVolumeRenderer()
 {
-    colorFn->Delete();
-    opacityFn->Delete();
     property->Delete();
     actor->Delete();
     boxWidget->Delete();
     boxCallback->Delete();
+    delete movieRenderer;
+    delete imageSaver;
     uninstallPipeline();
 }
 
@@ -124,14 +165,12 @@ void PVolumeRenderer::createWidgets()
     boxWidget->AddObserver(vtkCommand::InteractionEvent, boxCallback);
         
     // Create transfer functions
-    opacityFn = vtkPiecewiseFunction::New();
-    colorFn = vtkColorTransferFunction::New();
+    createPresets();
   
     // Create volume property and attach transfer functions
     property = vtkVolumeProperty::New();
     property->SetIndependentComponents(true);
-    property->SetScalarOpacity(opacityFn);
-    property->SetColor(colorFn);
+    presets.apply(0, property);
     property->SetInterpolationTypeToLinear();
     
     // Create actor
@@ -148,19 +187,39 @@ void PVolumeRenderer::createWidgets()
     // Create combo boxes
     viewTypeBox = new QComboBox(this);
     QStringList choices;
-    choices << "MIP" << "CT All" << "CT Skin" << "CT Muscle" << "CT Organ" 
-        << "CT Bone";
+    choices << "MIP" << "MinIP" << "CT All" << "CT Skin" << "CT Muscle"
+        << "CT Organ" << "CT Bone";
     viewTypeBox->insertItems(0, choices);
     connect(viewTypeBox, SIGNAL(activated(int)),
         this, SLOT(apply()));
             
     sampleDistanceBox = new QComboBox(this);
     choices.clear();
-    choices << "1" << "1/2" << "1/4" << "1/8" << "1/16";
+    choices << "1" << "1/2" << "1/4" << "1/8" << "1/16" << "CPU 1"
+        << "CPU 1/2" << "CPU 1/4" << "CPU 1/8";
     sampleDistanceBox->insertItems(0, choices);
     connect(sampleDistanceBox, SIGNAL(activated(int)),
         this, SLOT(setSampleDistance(int)));
         
+    frameTimeBox = new QDoubleSpinBox(this);
+    frameTimeBox->setDecimals(0);
+    frameTimeBox->setRange(20.0, 1000.0);
+    frameTimeBox->setSingleStep(10.0);
+    frameTimeBox->setSuffix(" ms");
+    frameTimeBox->setValue(DefaultFrameTime);
+    connect(frameTimeBox, SIGNAL(valueChanged(double)),
+        this, SLOT(setAdaptiveSampling()));
+        
+    slabBox = new QDoubleSpinBox(this);
+    slabBox->setDecimals(0);
+    slabBox->setRange(0.0, 500.0);
+    slabBox->setSingleStep(5.0);
+    slabBox->setSuffix(" mm");
+    slabBox->setSpecialValueText("All");
+    slabBox->setValue(0.0);
+    connect(slabBox, SIGNAL(valueChanged(double)),
+        this, SLOT(apply()));
+        
     // Overall
     setWindowTitle(appName);
     setWindowIcon(QIcon(":/images/panax-icon.png"));
@@ -251,6 +310,12 @@ void PVolumeRenderer::createActions()
     connect(saveViewAction, SIGNAL(triggered()),
         this, SLOT(saveView()));
         
+    exportMovieAction = new QAction(tr("Export &Movie"), this);
+    exportMovieAction->setStatusTip(
+        tr("Render a turntable or cine movie in the background"));
+    connect(exportMovieAction, SIGNAL(triggered()),
+        this, SLOT(exportMovie()));
+        
     setVOIAction = new QAction(tr("Volume of interest"), this);
     setVOIAction->setIcon(QIcon(":/images/roi.png"));
     setVOIAction->setStatusTip(tr("Toggle volume of interest"));
@@ -266,6 +331,14 @@ void PVolumeRenderer::createActions()
     connect(closeButton, SIGNAL(clicked()),
         setLightAction, SLOT(toggle()));
        
+    adaptiveAction = new QAction(tr("&Adaptive Sampling"), this);
+    adaptiveAction->setStatusTip(
+        tr("Lower the quality while moving to keep the frame time"));
+    adaptiveAction->setCheckable(true);
+    adaptiveAction->setChecked(true);
+    connect(adaptiveAction, SIGNAL(triggered()),
+        this, SLOT(setAdaptiveSampling()));
+       
     infoAction = new QAction(tr("&Info"), this);
     infoAction->setIcon(QIcon(":/images/info.png"));
     infoAction->setShortcut(tr("Ctrl+I"));
@@ -295,8 +368,10 @@ void PVolumeRenderer::createMenus()
 
     viewMenu = menuBar()->addMenu(tr("&View"));
     viewMenu->addAction(saveViewAction);
+    viewMenu->addAction(exportMovieAction);
     viewMenu->addAction(setVOIAction);
     viewMenu->addAction(setLightAction);
+    viewMenu->addAction(adaptiveAction);
     viewMenu->addAction(infoAction);
 
     menuBar()->addSeparator();
@@ -318,8 +393,12 @@ void PVolumeRenderer::createToolBars()
     viewToolBar->addAction(setVOIAction);
     viewToolBar->addWidget(viewTypeBox);
     viewToolBar->addAction(setLightAction);
+    viewToolBar->addWidget(new QLabel("  Slab ", this));
+    viewToolBar->addWidget(slabBox);
     viewToolBar->addWidget(new QLabel("  Step ", this));
     viewToolBar->addWidget(sampleDistanceBox);
+    viewToolBar->addAction(adaptiveAction);
+    viewToolBar->addWidget(frameTimeBox);
     viewToolBar->addAction(infoAction);
     
     helpToolBar = addToolBar(tr("&Help"));
@@ -370,6 +449,78 @@ void PVolumeRenderer::saveView()
 }
 
 
+// The movie is described by a job file beside it, which batchrender can
+// also run again later.  Frames are rendered offscreen in parallel child
+// processes, so the viewer stays responsive.
+
+void PVolumeRenderer::exportMovie()
+{
+    if (!loaded)
+        return;
+        
+    if (movieRenderer->isRunning())
+    {
+        QMessageBox::information(this, appName,
+            "A movie is still being exported.");
+        return;
+    }
+    
+    QStringList types;
+    types << "Turntable" << "Cine";
+    bool ok;
+    QString type = QInputDialog::getItem(this, appName, "Movie type:",
+        types, 0, false, &ok);
+    if (!ok)
+        return;
+    int frames = QInputDialog::getInt(this, appName, "Number of frames:",
+        36, 2, 720, 1, &ok);
+    if (!ok)
+        return;
+        
+    QString fileName = QFileDialog::getSaveFileName(this,
+        tr("Export movie"), ".",
+        tr("Movie files (*.mp4 *.avi);;Image sequences (*.png *.jpg *.tif)"));
+    if (fileName.isEmpty())
+        return;
+        
+    QFileInfo info(fileName);
+    QString jobFile = info.absolutePath() + "/" + info.completeBaseName() +
+        ".ini";
+    QSettings job(jobFile, QSettings::IniFormat);
+    job.clear();
+    job.setValue("input/dicom", fullDirName);
+    job.setValue("render/width", volumeWidget->width());
+    job.setValue("render/height", volumeWidget->height());
+    job.setValue("render/preset",
+        presets.getName(viewTypeBox->currentIndex()));
+    job.setValue("render/sampleDistance", cpumapper->getSampleDistance());
+    job.setValue("render/slab", slabBox->value());
+    job.setValue("render/ambient", ambientBox->value());
+    job.setValue("render/specular", specularBox->value());
+    PBatchRenderer::setCamera(job, volumeRenderer->GetActiveCamera());
+    job.setValue(type == "Cine" ? "camera/cine" : "camera/turntable",
+        frames);
+    PBatchRenderer::setOutput(job, fileName);
+    job.sync();
+    
+    movieRenderer->start(QStringList(jobFile));
+}
+
+
+void PVolumeRenderer::showMovieProgress(int done, int total)
+{
+    statusBar()->showMessage(QString("Exporting movie: %1 of %2 parts done").
+        arg(done).arg(total));
+}
+
+
+void PVolumeRenderer::movieFinished(int failed)
+{
+    statusBar()->showMessage(failed ? "Movie export failed" :
+        "Movie exported", 5000);
+}
+
+
 void PVolumeRenderer::showLightDialog()
 {
     bool visible = setLightAction->isChecked();
@@ -395,13 +546,21 @@ void PVolumeRenderer::setSampleDistance(int option)
     if (!loaded)
         return;
 
-    if (option == 0)
-        actor->SetMapper(mapper);
+    if (option >= CpuOption)
+    {
+        actor->SetMapper(cpumapper);
+        cpumapper->setSampleDistance(1.0 / (1 << (option - CpuOption)));
+    }
     else
-        actor->SetMapper(rcmapper);
+    {
+        if (option == 0)
+            actor->SetMapper(mapper);
+        else
+            actor->SetMapper(rcmapper);
         
-    float distance = 1.0 / (1 << option);
-    rcmapper->SetSampleDistance(distance);
+        float distance = 1.0 / (1 << option);
+        rcmapper->SetSampleDistance(distance);
+    }
 
     QApplication::setOverrideCursor(Qt::WaitCursor);
     volumeWidget->GetRenderWindow()->Render();
@@ -409,6 +568,35 @@ void PVolumeRenderer::setSampleDistance(int option)
 }
 
 
+// The interactor switches the render window to the desired update rate
+// while the camera or the box widget moves and back to the still rate
+// after, rendering once more at full quality.  Mappers that adjust their
+// sample distances fit each frame into the time this allows.
+
+void PVolumeRenderer::setAdaptiveSampling()
+{
+    vtkRenderWindowInteractor *interactor =
+        volumeWidget->GetRenderWindow()->GetInteractor();
+    interactor->SetDesiredUpdateRate(1000.0 / frameTimeBox->value());
+    
+    if (!loaded)
+        return;
+        
+    bool adaptive = adaptiveAction->isChecked();
+    rcmapper->SetAutoAdjustSampleDistances(adaptive);
+    cpumapper->setAutoAdjust(adaptive);
+}
+
+
+// Draw the latest refinement pass of the CPU ray caster.
+
+void PVolumeRenderer::refineView()
+{
+    if (loaded)
+        volumeWidget->GetRenderWindow()->Render();
+}
+
+
 void PVolumeRenderer::apply()
 {
     if (!loaded)
@@ -491,7 +679,7 @@ void PVolumeRenderer::installPipeline()
     boxWidget->SetInput(reader->GetOutput());
     boxWidget->SetDefaultRenderer(volumeRenderer);
     boxWidget->PlaceWidget();
-    boxCallback->SetMapper(mapper, rcmapper);
+    boxCallback->SetMapper(mapper, rcmapper, cpumapper);
     // boxWidget->EnabledOn();
     
     loaded = true;
@@ -518,6 +706,12 @@ void PVolumeRenderer::uninstallPipeline()
         rcmapper = NULL;
     }
     
+    if (cpumapper)
+    {
+        cpumapper->Delete();
+        cpumapper = NULL;
+    }
+    
     if (volumeRenderer)
     {
         volumeRenderer->Delete();
@@ -559,14 +753,21 @@ void PVolumeRenderer::loadVolume(const QString &dirName)
     // Create mapper
     mapper = vtkSmartVolumeMapper::New();
     rcmapper = vtkFixedPointVolumeRayCastMapper::New();
+    cpumapper = PRayCastMapper::New();
+    cpumapper->setProgressive(true);
+    connect(cpumapper->getNotifier(), SIGNAL(refined()),
+        this, SLOT(refineView()));
     viewTypeBox->setCurrentIndex(0);
     setBlendType();
     rcmapper->SetSampleDistance(1.0);
+    cpumapper->setSampleDistance(1.0);
     mapper->SetInputConnection(reader->GetOutputPort());
     rcmapper->SetInputConnection(reader->GetOutputPort());
+    cpumapper->SetInputConnection(reader->GetOutputPort());
     actor->SetMapper(mapper);  // Default mapper.
 
     installPipeline();
+    setAdaptiveSampling();
     volumeRenderer->ResetCamera();
 
     vtkRenderWindow *renderWindow = volumeWidget->GetRenderWindow();
@@ -579,175 +780,55 @@ void PVolumeRenderer::loadVolume(const QString &dirName)
 
 bool PVolumeRenderer::saveView(const QString &fileName)
 {
-    vtkWindowToImageFilter *filter = vtkWindowToImageFilter::New();
-    filter->SetInput(volumeWidget->GetRenderWindow());
-
-    QString suffix = QFileInfo(fileName).suffix();
-    vtkImageWriter *writer;
-    if (suffix == "jpg")
-        writer = vtkJPEGWriter::New();
-    else if (suffix == "png")
-        writer = vtkPNGWriter::New();
-    else if (suffix == "tif")
-        writer = vtkTIFFWriter::New();
-    else
+    if (!PImageSaver::isSupported(fileName))
     {
         QMessageBox::critical(this, appName,
-            QString("File type %1 is unsupported.").arg(suffix));
+            QString("File type %1 is unsupported.").
+            arg(QFileInfo(fileName).suffix()));
         return false;
     }
 
-    writer->SetInput(filter->GetOutput());
-    writer->SetFileName(fileName.toAscii().data());
-    writer->Write();
-    writer->Delete();
-    filter->Delete();
-    return true;
+    return imageSaver->save(volumeWidget->GetRenderWindow(), fileName);
+}
+
+
+// Transfer functions for the view types, in viewTypeBox order.  They are
+// built once here; setBlendType() only switches between them.
+
+void PVolumeRenderer::createPresets()
+{
+    presets.addStandard();
 }
 
 
 void PVolumeRenderer::setBlendType()
 {       
-    // Init
-    opacityFn->RemoveAllPoints();
-    colorFn->RemoveAllPoints();
-    double opacityLevel = 1048;
-    double opacityWindow = 2048;
-    
     int blendType = viewTypeBox->currentIndex();
+    if (blendType < 0 || blendType >= presets.count())
+        blendType = 0;  // MIP
     double ambient = ambientBox->value();
     double specular = specularBox->value();
     
-    // Add function points
-    switch (blendType)
-    {      
-        // Maximum Intensity Projection
-        // Create an opacity ramp from the window and level values.
-        // Color is white. Blending is MIP.
-        case 0:
-            opacityFn->AddSegment(opacityLevel - 0.5*opacityWindow, 0.0, 
-                                  opacityLevel + 0.5*opacityWindow, 1.0 );
-            colorFn->AddRGBSegment(0, 1.0, 1.0, 1.0, 500, 1.0, 1.0, 1.0);
-            mapper->SetBlendModeToMaximumIntensity();
-            rcmapper->SetBlendModeToMaximumIntensity();
-            break;
-
-        // CT All
-        // Use compositing and functions set to highlight skin in CT data.
-        case 1:     
-            opacityFn->AddPoint(-2000, 0.0, 0.5, 0.0);
-            opacityFn->AddPoint(-1000, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint( -500, 1.0, 0.5, 0.0);
-            opacityFn->AddPoint( 2000, 1.0, 0.5, 0.0);
-                  
-            colorFn->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
-            colorFn->AddRGBPoint(-1000, 0.6, 0.6, 0.6, 0.5, 0.5);
-            colorFn->AddRGBPoint( -500, 0.8, 0.8, 0.8, 0.5, 0.0);
-            colorFn->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
-  
-            mapper->SetBlendModeToComposite();
-            rcmapper->SetBlendModeToComposite();
-            property->ShadeOn();
-            property->SetAmbient(ambient);
-            property->SetDiffuse(0.9);
-            property->SetSpecular(specular);
-            property->SetSpecularPower(10.0);
-            break;
-            
-        // CT Skin
-        // Use compositing and functions set to highlight skin in CT data.
-        case 2:     
-            opacityFn->AddPoint(-2000, 0.0, 0.5, 0.0);
-            opacityFn->AddPoint( -300, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint( -100, 1.0, 0.5, 0.0);
-            opacityFn->AddPoint( 2000, 1.0, 0.5, 0.0);
-                  
-            colorFn->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
-            colorFn->AddRGBPoint( -300, 0.6, 0.4, 0.2, 0.5, 0.5);
-            colorFn->AddRGBPoint( -100, 0.9, 0.8, 0.5, 0.5, 0.0);
-            colorFn->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
-  
-            mapper->SetBlendModeToComposite();
-            rcmapper->SetBlendModeToComposite();
-            property->ShadeOn();
-            property->SetAmbient(ambient);
-            property->SetDiffuse(0.9);
-            property->SetSpecular(specular);
-            property->SetSpecularPower(10.0);
-            break;
-  
-        // CT Muscle
-        // Use compositing and functions set to highlight muscle in CT data.
-        case 3:     
-            opacityFn->AddPoint(-2000, 0.0, 0.5, 0.0);
-            opacityFn->AddPoint(  -70, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint(  200, 1.0, 0.5, 0.0);
-            opacityFn->AddPoint( 2000, 1.0, 0.5, 0.0);
-                  
-            colorFn->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
-            colorFn->AddRGBPoint(  -70, 1.0, 0.3, 0.3, 0.5, 0.5);
-            colorFn->AddRGBPoint(  200, 1.0, 1.0, 1.0, 0.5, 0.0);
-            colorFn->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
-
-            mapper->SetBlendModeToComposite();
-            rcmapper->SetBlendModeToComposite();
-            property->ShadeOn();
-            property->SetAmbient(ambient);
-            property->SetDiffuse(0.9);
-            property->SetSpecular(specular);
-            property->SetSpecularPower(10.0);
-            break;
-            
-        // CT Organ
-        // Use compositing and functions set to highlight muscle in CT data.
-        case 4:
-            opacityFn->AddPoint(-2000, 0.0, 0.5, 0.0);
-            opacityFn->AddPoint(    0, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint(  300, 1.0, 0.5, 0.0);
-            opacityFn->AddPoint( 2000, 1.0, 0.5, 0.0);
-            
-            colorFn->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
-            colorFn->AddRGBPoint(    0, 1.0, 0.3, 0.3, 0.5, 0.5);
-            colorFn->AddRGBPoint(  300, 1.0, 1.0, 1.0, 0.5, 0.0);
-            colorFn->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
-
-            mapper->SetBlendModeToComposite();
-            rcmapper->SetBlendModeToComposite();
-            property->ShadeOn();
-            property->SetAmbient(ambient);
-            property->SetDiffuse(0.9);
-            property->SetSpecular(specular);
-            property->SetSpecularPower(10.0);
-            break;
-            
-        // CT Bone
-        // Use compositing and functions set to highlight bone in CT data.
-        case 5:
-            opacityFn->AddPoint(-2000, 0.0, 0.5, 0.0);
-            opacityFn->AddPoint(  -20, 0.0, 0.5, 0.5);
-            opacityFn->AddPoint(  600, 1.0, 0.5, 0.0);
-            opacityFn->AddPoint( 2000, 1.0, 0.5, 0.0);
-
-            colorFn->AddRGBPoint(-2000, 0.0, 0.0, 0.0, 0.5, 0.0);
-            colorFn->AddRGBPoint(  -20, 1.0, 0.3, 0.3, 0.5, 0.5);
-            colorFn->AddRGBPoint(  600, 1.0, 1.0, 1.0, 0.5, 0.0);
-            colorFn->AddRGBPoint( 2000, 1.0, 1.0, 1.0, 0.5, 0.0);
-  
-            mapper->SetBlendModeToComposite();
-            rcmapper->SetBlendModeToComposite();
-            property->ShadeOn();
-            property->SetAmbient(ambient);
-            property->SetDiffuse(0.9);
-            property->SetSpecular(specular);
-            property->SetSpecularPower(10.0);
-            break;
-  
-        default: // Case 0
-            opacityFn->AddSegment(opacityLevel - 0.5*opacityWindow, 0.0, 
-                                  opacityLevel + 0.5*opacityWindow, 1.0 );
-            colorFn->AddRGBSegment(0, 1.0, 1.0, 1.0, 500, 1.0, 1.0, 1.0);
-            mapper->SetBlendModeToMaximumIntensity();
-            rcmapper->SetBlendModeToMaximumIntensity();
-            break;
+    // Switch to the cached transfer functions
+    presets.apply(blendType, property);
+
+    int mode = presets.getBlendMode(blendType);
+    mapper->SetBlendMode(mode);
+    rcmapper->SetBlendMode(mode);
+    cpumapper->SetBlendMode(mode);
+    
+    // Only the CPU ray caster projects a slab; the others project the
+    // whole volume, cropped by the box widget.
+    cpumapper->setSlabThickness(slabBox->value());
+    
+    if (mode == vtkVolumeMapper::COMPOSITE_BLEND)
+    {
+        property->ShadeOn();
+        property->SetAmbient(ambient);
+        property->SetDiffuse(0.9);
+        property->SetSpecular(specular);
+        property->SetSpecularPower(10.0);
     }
+    else
+        property->ShadeOff();
 }
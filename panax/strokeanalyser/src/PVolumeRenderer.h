@@ -29,6 +29,10 @@ class QPushButton;
 #include "vtkVolume.h"
 #include "vtkRenderer.h"
 #include "vtkBoxWidget.h"
+#include "PVolumePresets.h"
+#include "PRayCastMapper.h"
+#include "PBatchRenderer.h"
+#include "PImageSaver.h"
 
 class vtkBoxWidgetCallback;
 
@@ -49,9 +53,14 @@ protected slots:
     void loadDir();
     void saveDir();
     void saveView();
+    void exportMovie();
+    void showMovieProgress(int done, int total);
+    void movieFinished(int failed);
     void setVOI();
     void showLightDialog();
     void setSampleDistance(int option);
+    void setAdaptiveSampling();
+    void refineView();
     void apply();
     void info();
     void help();
@@ -68,8 +77,10 @@ protected:
     QAction *saveDirAction;
     QAction *exitAction;
     QAction *saveViewAction;
+    QAction *exportMovieAction;
     QAction *setVOIAction;
     QAction *setLightAction;
+    QAction *adaptiveAction;
     QAction *infoAction;
     QAction *helpAction;
     QAction *aboutAction;
@@ -87,16 +98,20 @@ protected:
     vtkDICOMImageReader *reader;
     vtkSmartVolumeMapper *mapper;
     vtkFixedPointVolumeRayCastMapper *rcmapper;
-    vtkPiecewiseFunction *opacityFn;
-    vtkColorTransferFunction *colorFn;
+    PRayCastMapper *cpumapper;
+    PVolumePresets presets;
     vtkVolumeProperty *property;
     vtkVolume *actor;
     vtkRenderer* volumeRenderer;
     QComboBox *viewTypeBox;
     QComboBox *sampleDistanceBox;
+    QDoubleSpinBox *frameTimeBox;
+    QDoubleSpinBox *slabBox;
     // QComboBox *saveViewBox;
     vtkBoxWidget *boxWidget;
     vtkBoxWidgetCallback *boxCallback;
+    PBatchRenderer *movieRenderer;
+    PImageSaver *imageSaver;
     
     // Lighting dialog
     QWidget *lightDialog;
@@ -113,6 +128,7 @@ protected:
     
     // Supporting methods
     void createLightDialog();
+    void createPresets();
     void initSize();
     void installPipeline();
     void uninstallPipeline();